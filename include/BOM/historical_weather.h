@@ -6,10 +6,13 @@
 #include <ctype.h>
 #include <libpq-fe.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include "transform.h"
 #include "BOM/stations.h"
 #include "ftp.h"
+#include "fetch.h"
+#include "bulk.h"
 
 /// Max number of items in weather dataset
 #define BOM_RESPONSE_BUFFER_SIZE        200
@@ -17,9 +20,26 @@
 /// Max number of chars in timestamp buffer
 #define BOM_TIME_STR_BUFFER_SIZE        30
 
+/// Max characters in a BOM FTP URL
+#define BOM_URL_SIZE                    250
+
 /// Max buffer size to read into memory (size of .csv file from BOM FTP server)
 #define BOM_MAX_RESPONSE_SIZE           10000
 
+/// Request every month from the start date (see BOM_TimeseriesToDB())
+#define BOM_SYNC_FULL                   0
+/// Only request months from the latest stored row of each station
+#define BOM_SYNC_INCREMENTAL            1
+
+/// Max characters in a row of a BOM .csv file
+#define BOM_CSV_LINE_SIZE               500
+
+/// Directory downloaded .csv files are archived to (when enabled)
+#define BOM_CSV_ARCHIVE_DIRECTORY       "datasets/bom/historical"
+
+/// Max characters in an archived .csv file path
+#define BOM_CSV_PATH_SIZE               400
+
 typedef struct {
     uint16_t count; ///< Number of values in dataset
     time_t timestamps[BOM_RESPONSE_BUFFER_SIZE]; ///< Timestamps of each datapoint
@@ -30,21 +50,71 @@ typedef struct {
     double min_temperature[BOM_RESPONSE_BUFFER_SIZE]; ///< Min temperature data
 }BOM_WeatherDataset_TypeDef;
 
+/// Incremental parser of a BOM .csv file (rows may be split across chunks)
+typedef struct {
+    BOM_WeatherDataset_TypeDef* dataset; ///< Dataset to populate
+    /// Location expected in each row e.g. MORUYA AIRPORT
+    char location[BOM_STATION_FILENAME_SIZE];
+    char line[BOM_CSV_LINE_SIZE]; ///< Partial row carried between chunks
+    size_t line_length; ///< Characters in partial row
+    bool line_truncated; ///< Row is longer than line (the rest is skipped)
+    uint16_t dropped; ///< Rows that didn't fit in the dataset
+    /// Copy of the file to archive (memory is NULL if not archived)
+    Utils_ReqData_TypeDef archive;
+    char archive_path[BOM_CSV_PATH_SIZE]; ///< Path of the archived file
+}BOM_CSVParser_TypeDef;
+
 /// Get historical weather for a particular BOM weather station
 CURLcode BOM_GetWeather(BOM_WeatherDataset_TypeDef* dataset,
-                        BOM_WeatherStation_TypeDef* station,
+                        const BOM_WeatherStation_TypeDef* station,
                         const char* year_month);
 
+/// Start parsing a stations .csv file into a dataset
+void BOM_CSVParserInit(BOM_CSVParser_TypeDef* parser,
+                       BOM_WeatherDataset_TypeDef* dataset,
+                       const BOM_WeatherStation_TypeDef* station,
+                       const char* year_month);
+
+/// Parse the next chunk of a .csv file
+size_t BOM_CSVParserFeed(BOM_CSVParser_TypeDef* parser, const char* data,
+                         size_t size);
+
+/// Parse the last row and archive the file (if enabled)
+int8_t BOM_CSVParserFinish(BOM_CSVParser_TypeDef* parser);
+
+/// Abandon a parser without archiving the file
+void BOM_CSVParserDiscard(BOM_CSVParser_TypeDef* parser);
+
+/// cURL write callback feeding a BOM_CSVParser_TypeDef
+size_t BOM_CSVWriteCallback(void* contents, size_t size, size_t nmemb,
+                            void* userp);
+
+/// Archive downloaded .csv files to a directory (NULL to disable)
+void BOM_SetCSVArchive(const char* directory);
+
+/// Wait for archived .csv files to be written
+void BOM_WaitForCSVArchive(void);
+
 /// Load BOM weather station dataset from .csv file
 int8_t BOM_LoadWeatherFromCSV(const char* filename,
                               BOM_WeatherDataset_TypeDef* dataset,
-                              BOM_WeatherStation_TypeDef* station);
+                              const BOM_WeatherStation_TypeDef* station);
 
 /// Write observed weather to PostgreSQL table (weather_bom)
-void BOM_HistoricalWeatherToDB(BOM_WeatherStation_TypeDef* weather_station,
+void BOM_HistoricalWeatherToDB(const BOM_WeatherStation_TypeDef* weather_station,
                                BOM_WeatherDataset_TypeDef* dataset,
                                PGconn* psql_conn);
 
-void BOM_TimeseriesToDB(const char* start_time, PGconn* psql_conn);
+/// Start a bulk load into the weather_bom table
+int8_t BOM_BeginWeatherLoad(Bulk_Load_TypeDef* load, PGconn* psql_conn);
+
+/// Add a BOM weather station dataset to a bulk load
+int8_t BOM_HistoricalWeatherToBulk(
+        const BOM_WeatherStation_TypeDef* weather_station,
+        BOM_WeatherDataset_TypeDef* dataset, Bulk_Load_TypeDef* load);
+
+/// Build weather_bom table for each station in harvest_lookup
+void BOM_TimeseriesToDB(const char* start_time, uint8_t sync_mode,
+                        PGconn* psql_conn);
 
 #endif //PROGRAM_HISTORICAL_WEATHER_H
@@ -0,0 +1,52 @@
+#ifndef PROGRAM_STATION_INDEX_H
+#define PROGRAM_STATION_INDEX_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <log.h>
+
+#include "BOM/stations.h"
+
+/// Mean radius of the earth in km (half the diameter in Utils_PointsDistance)
+#define BOM_STATION_EARTH_RADIUS            6371.0
+
+/// Station found by a spatial query
+typedef struct {
+    int16_t index; ///< Index of station in BOM_WeatherStations_TypeDef
+    double distance; ///< Distance from the query point (km)
+} BOM_StationMatch_TypeDef;
+
+/// k-d tree over the positions of a list of stations (built once)
+typedef struct {
+    const BOM_WeatherStations_TypeDef* stations; ///< Indexed stations
+    int16_t count; ///< Number of stations in tree
+    /// Station held by each node (the median of each range is its root)
+    int16_t nodes[BOM_STATION_MAX_RESPONSES];
+    uint8_t axes[BOM_STATION_MAX_RESPONSES]; ///< Split axis of each node
+    /// Position of each node as a unit vector (x, y, z)
+    double points[BOM_STATION_MAX_RESPONSES][3];
+} BOM_StationIndex_TypeDef;
+
+/// Build a spatial index over a list of stations
+int8_t BOM_StationIndexBuild(BOM_StationIndex_TypeDef* index,
+                             const BOM_WeatherStations_TypeDef* stations);
+
+/// Closest station to a latitude and longitude (-1 if index is empty)
+int16_t BOM_StationIndexNearest(const BOM_StationIndex_TypeDef* index,
+                                double latitude, double longitude,
+                                double* distance);
+
+/// The k closest stations to a latitude and longitude (closest first)
+uint16_t BOM_StationIndexKNearest(const BOM_StationIndex_TypeDef* index,
+                                  double latitude, double longitude,
+                                  uint16_t k,
+                                  BOM_StationMatch_TypeDef* matches);
+
+/// Stations within a radius of a latitude and longitude (closest first)
+uint16_t BOM_StationIndexWithin(const BOM_StationIndex_TypeDef* index,
+                                double latitude, double longitude,
+                                double radius, uint16_t max_matches,
+                                BOM_StationMatch_TypeDef* matches);
+
+#endif //PROGRAM_STATION_INDEX_H
@@ -3,8 +3,10 @@
 
 #include <math.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "ftp.h"
+#include "snapshot.h"
 #include "utils.h"
 
 /// Max number of BOM sites to hold
@@ -17,6 +19,16 @@
 #define BOM_STATION_NAME_SIZE               150
 /// BOM filename max size
 #define BOM_STATION_FILENAME_SIZE           150
+/// Slots in each station hash table (power of 2, at least 2x max stations)
+#define BOM_STATION_HASH_SIZE               1024
+
+/// Distance (km) beyond which the closest station is reported as too far
+#define BOM_STATION_WARN_DISTANCE           40.0
+
+/// Cached BOM station list (.txt from the BOM FTP server)
+#define BOM_STATIONS_FILE                   "tmp/bom_weather_stations.txt"
+/// Binary snapshot of the parsed station list (see BOM_MapStations())
+#define BOM_STATIONS_SNAPSHOT               "tmp/bom_weather_stations.snapshot"
 
 /// Static location of BOM sites .txt file on BOM FTP server
 #define BOM_FTP_STATIONS_URL "ftp://ftp.bom.gov.au/anon/gen/clim_data/IDCKWCDEA0/tables/stations_db.txt"
@@ -35,6 +47,8 @@ typedef struct {
 typedef struct {
     int16_t count; /// Number of stations in record
     BOM_WeatherStation_TypeDef stations[BOM_STATION_MAX_RESPONSES]; /// List of stations
+    int16_t id_slots[BOM_STATION_HASH_SIZE]; /// Station index by id (-1 empty)
+    int16_t filename_slots[BOM_STATION_HASH_SIZE]; /// Station index by filename (-1 empty)
 }BOM_WeatherStations_TypeDef;
 
 /// Get a list of NSW BOM weather stations
@@ -44,6 +58,20 @@ CURLcode BOM_GetWeatherStations(BOM_WeatherStations_TypeDef* stations);
 int8_t BOM_LoadStationsFromTxt(const char* filename,
                                 BOM_WeatherStations_TypeDef* stations);
 
+/// Map the parsed BOM station list (shared, read-only)
+const BOM_WeatherStations_TypeDef* BOM_MapStations(const char* filename);
+
+/// Unmap the station list from BOM_MapStations()
+void BOM_UnmapStations(void);
+
+/// Index of a BOM station by id (-1 if not found)
+int16_t BOM_FindStationByID(const BOM_WeatherStations_TypeDef* stations,
+                            const char* id);
+
+/// Index of a BOM station by filename (-1 if not found)
+int16_t BOM_FindStationByFilename(const BOM_WeatherStations_TypeDef* stations,
+                                  const char* filename);
+
 /// Index of the closest BOM station to a define latitude and longitude
 int16_t BOM_ClosestStationIndex(double latitude,
                                 double longitude,
@@ -10,14 +10,20 @@
 #include "FoodAuthority/harvest_area.h"
 #include "transform.h"
 #include "http.h"
+#include "fetch.h"
+#include "bulk.h"
 #include "utils.h"
 #include "WillyWeather/location.h"
 #include "BOM/stations.h"
+#include "BOM/station_index.h"
+#include "snapshot.h"
 
 /// Harvest areas directory
 #define FA_DEFAULT_DIRECTORY "datasets/nsw_food_authority"
 /// Harvest area statuses filename
 #define FA_DEFAULT_FILENAME "datasets/nsw_food_authority/statuses.csv"
+/// Binary snapshot of the harvest_lookup table (see FA_UniqueLocations())
+#define FA_LOCATIONS_SNAPSHOT "tmp/harvest_lookup.snapshot"
 
 /// Maxiumum number of oyster harvest areas in response
 #define FA_MAX_NUMBER_HARVEST_AREAS             120
@@ -46,4 +52,8 @@ void FA_CreateLocationsLookupDB(PGconn* psql_conn);
 void FA_UniqueLocationsFromDB(T_LocationsLookup_TypeDef* locations,
                               PGconn* psql_conn);
 
+/// Get unique harvest area locations (from a snapshot or the DB)
+void FA_UniqueLocations(T_LocationsLookup_TypeDef* locations,
+                        PGconn* psql_conn);
+
 #endif //PROGRAM_HARVEST_AREAS_H
@@ -11,6 +11,8 @@
 #include "IBM_EIS/authenticate.h"
 #include "transform.h"
 #include "http.h"
+#include "fetch.h"
+#include "bulk.h"
 #include "utils.h"
 
 /// Max characters in formulated URL.
@@ -21,6 +23,14 @@
 #define IBM_MIN_TEMPERATURE_ID      26019
 #define IBM_MAX_TEMPERATURE_ID      26018
 
+/// Daily precipitation layer identifier on the primary endpoint
+#define IBM_PRECIPITATION_PRIMARY_ID    16700
+
+/// Endpoint selection (alt_flag of IBM_GetTimeseries())
+#define IBM_ENDPOINT_PRIMARY        0
+#define IBM_ENDPOINT_ALT            1
+#define IBM_ENDPOINT_HEDGED         2
+
 /// Max number of values in response.
 #define IBM_MAX_RESPONSE_LENGTH 2000
 
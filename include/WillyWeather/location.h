@@ -41,5 +41,13 @@ typedef struct {
 CURLcode WillyWeather_GetLocationByName(char *name,
                                         WW_Location_TypeDef *location_info);
 
+/// Build a Willy Weather location search URL
+void WillyWeather_BuildLocationURL(const char *name, char *url,
+                                   size_t url_size);
+
+/// Parse a Willy Weather location search response
+void WillyWeather_ParseLocation(cJSON *response,
+                                WW_Location_TypeDef *location_info);
+
 
 #endif //HA_CLOSURE_ANALYSIS_LOCATION_H
@@ -10,6 +10,7 @@
 #include "WillyWeather/forecast.h"
 #include "WillyWeather/location.h"
 #include "utils.h"
+#include "bulk.h"
 
 /// Willy Weather range code (e.g. 0-15 or 5-10 or <0) max size
 #define WW_RANGE_CODE_SIZE                      6
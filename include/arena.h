@@ -0,0 +1,47 @@
+#ifndef PROGRAM_ARENA_H
+#define PROGRAM_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <log.h>
+
+/// Size of each block allocated by an arena (larger requests get their own)
+#define ARENA_BLOCK_SIZE                65536
+/// Alignment of every allocation (enough for any scalar type)
+#define ARENA_ALIGN                     16
+/// Initial number of slots in the string intern table (power of two)
+#define ARENA_INTERN_MIN_SLOTS          64
+
+/// Block of memory owned by an arena
+typedef struct Arena_Block {
+    struct Arena_Block* next; ///< Previously allocated block
+    size_t size; ///< Bytes available after the header
+    size_t used; ///< Bytes handed out
+} Arena_Block_TypeDef;
+
+/// Allocations freed together with a single call
+typedef struct {
+    Arena_Block_TypeDef* blocks; ///< Most recent block first
+    const char** interned; ///< Intern table (open addressing, NULL = empty)
+    size_t intern_slots; ///< Slots in the intern table (power of two)
+    size_t intern_count; ///< Strings in the intern table
+    size_t allocated; ///< Bytes allocated from the system
+} Arena_TypeDef;
+
+/// Start an empty arena (nothing is allocated until it is used)
+void Arena_Init(Arena_TypeDef* arena);
+
+/// Allocate memory from an arena (aligned to ARENA_ALIGN)
+void* Arena_Alloc(Arena_TypeDef* arena, size_t size);
+
+/// Copy a string into an arena, identical strings share one copy
+const char* Arena_Intern(Arena_TypeDef* arena, const char* string,
+                         size_t length);
+
+/// Free everything allocated from an arena
+void Arena_Free(Arena_TypeDef* arena);
+
+#endif //PROGRAM_ARENA_H
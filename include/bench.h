@@ -0,0 +1,37 @@
+#ifndef PROGRAM_BENCH_H
+#define PROGRAM_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <log.h>
+
+#include "utils.h"
+#include "fetch.h"
+#include "BOM/stations.h"
+#include "BOM/historical_weather.h"
+
+/// Size of each chunk handed to a write callback (matches CURL_MAX_WRITE_SIZE)
+#define BENCH_CHUNK_SIZE                16384
+/// Max number of recorded bodies replayed by a benchmark
+#define BENCH_MAX_FILES                 256
+/// Max characters in a benchmark file path
+#define BENCH_PATH_SIZE                 512
+/// Query points along each side of the distance benchmark grid
+#define BENCH_GRID_SIZE                 40
+/// Characters in a month of a BOM file name e.g. 202206 (+ null)
+#define BENCH_MONTH_SIZE                7
+
+/// Replay recorded response bodies through the response write callback
+int8_t Bench_WriteCallback(const char* directory, uint16_t iterations);
+
+/// Compare the scalar and batched station distance functions
+int8_t Bench_PointsDistance(const char* stations_file, uint16_t iterations);
+
+/// Check recorded BOM months still yield rows once served from the cache
+int8_t Bench_CachedMonths(const char* corpus, const char* cache_directory);
+
+#endif //PROGRAM_BENCH_H
@@ -0,0 +1,49 @@
+#ifndef PROGRAM_BULK_H
+#define PROGRAM_BULK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <libpq-fe.h>
+#include <log.h>
+
+#include "utils.h"
+#include "pg_binary.h"
+#include "transaction.h"
+
+/// Buffered COPY data is sent once it reaches this size
+#define BULK_FLUSH_SIZE                 65536
+/// Binary COPY file signature (followed by flags and header extension)
+#define BULK_COPY_SIGNATURE             "PGCOPY\n\377\r\n"
+/// Bytes in BULK_COPY_SIGNATURE (including its null)
+#define BULK_COPY_SIGNATURE_SIZE        11
+/// Max characters in a bulk load statement (create, copy or merge)
+#define BULK_STMT_SIZE                  1024
+
+/// Bulk load of rows through a temporary staging table
+typedef struct {
+    PGconn* psql_conn; ///< Connection the rows are copied over
+    const char* staging; ///< Staging table (e.g. bulk_weather_bom)
+    const char* merge; ///< INSERT ... SELECT ... FROM staging ON CONFLICT ...
+    uint16_t n_columns; ///< Values in each row
+    Utils_ReqData_TypeDef buffer; ///< Rows not yet sent (COPY binary format)
+    uint32_t rows; ///< Rows added
+    bool copying; ///< COPY is in progress
+    bool failed; ///< A row could not be sent (the load is abandoned)
+} Bulk_Load_TypeDef;
+
+/// Start a bulk load (creates the staging table and starts a COPY)
+int8_t Bulk_Begin(Bulk_Load_TypeDef* load, PGconn* psql_conn,
+                  const char* staging, const char* columns,
+                  uint16_t n_columns, const char* merge);
+
+/// Add a row to a bulk load (one value per staging table column)
+int8_t Bulk_AddRow(Bulk_Load_TypeDef* load,
+                   const PGBinary_Params_TypeDef* row);
+
+/// Finish the COPY and merge the staging table into its target
+int64_t Bulk_End(Bulk_Load_TypeDef* load);
+
+#endif //PROGRAM_BULK_H
@@ -0,0 +1,72 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <log.h>
+
+#include "utils.h"
+
+/// Default directory holding cached responses
+#define CACHE_DEFAULT_DIRECTORY         "tmp/cache"
+/// Characters in a cache key (64 bit hash as hex + null)
+#define CACHE_KEY_SIZE                  17
+/// Max characters in a validator (ETag or Last-Modified)
+#define CACHE_VALIDATOR_SIZE            128
+/// Max characters in a cache file path
+#define CACHE_PATH_SIZE                 256
+/// Size of chunks read when restoring a cached body
+#define CACHE_READ_CHUNK_SIZE           16384
+/// FTP modification time of files served from the corpus in replay mode
+#define CACHE_REPLAY_FILETIME           0
+
+/// Cache state of a single request (URL + body)
+typedef struct {
+    char key[CACHE_KEY_SIZE]; ///< Hash of URL and body
+    bool found; ///< A cached response exists
+    bool ftp; ///< Request is an FTP transfer (validated with MDTM/SIZE)
+    char etag[CACHE_VALIDATOR_SIZE]; ///< HTTP ETag
+    char last_modified[CACHE_VALIDATOR_SIZE]; ///< HTTP Last-Modified
+    curl_off_t filetime; ///< FTP modification time (-1 if unknown)
+    curl_off_t size; ///< FTP file size (-1 if unknown)
+} Cache_Entry_TypeDef;
+
+/// Cache statistics
+typedef struct {
+    uint32_t hits; ///< Responses served from cache (304 or unchanged file)
+    uint32_t stored; ///< Responses written to the cache
+    uint32_t misses; ///< Cacheable requests with no usable cached response
+} Cache_Stats_TypeDef;
+
+/// Enable the on-disk response cache
+int8_t Cache_Init(const char* directory);
+
+/// Check if the response cache has been enabled
+bool Cache_Enabled(void);
+
+/// Find the cached validators of a request
+bool Cache_Lookup(Cache_Entry_TypeDef* entry, const char* url,
+                  const char* body);
+
+/// Add conditional headers (HTTP) or MDTM (FTP) to a transfer
+struct curl_slist* Cache_Setup(Cache_Entry_TypeDef* entry, CURL* curl,
+                               struct curl_slist* headers);
+
+/// Check a NOBODY probe of an FTP file and restore the cached body if unchanged
+bool Cache_ProbeUnchanged(Cache_Entry_TypeDef* entry, CURL* curl,
+                          Utils_ReqData_TypeDef* data);
+
+/// Store a new response or restore the cached body after a 304
+void Cache_Finish(Cache_Entry_TypeDef* entry, CURL* curl, CURLcode result,
+                  Utils_ReqData_TypeDef* data);
+
+/// Log the cache statistics
+void Cache_LogStats(void);
+
+#endif //PROGRAM_CACHE_H
@@ -0,0 +1,85 @@
+#ifndef PROGRAM_FETCH_H
+#define PROGRAM_FETCH_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <curl/curl.h>
+#include <log.h>
+
+#include "utils.h"
+#include "http_pool.h"
+#include "cache.h"
+#include "rate_limit.h"
+#include "transport.h"
+
+/// Default max number of requests in flight to a single host
+#define FETCH_DEFAULT_MAX_PER_HOST          4
+/// Default max number of requests in flight across all hosts
+#define FETCH_DEFAULT_MAX_TOTAL             16
+/// Max characters in a host name
+#define FETCH_HOST_SIZE                     100
+/// Latency percentile of the primary endpoint used as the hedge delay
+#define FETCH_HEDGE_PERCENTILE              95.0
+/// Hedge delay used until an endpoint has enough latency samples (ms)
+#define FETCH_DEFAULT_HEDGE_MS              2000
+
+typedef struct Fetch_Request Fetch_Request_TypeDef;
+
+/// Completion callback. The response is only valid during the callback.
+typedef void (*Fetch_Callback)(Fetch_Request_TypeDef* request,
+                               CURLcode result,
+                               Utils_ReqData_TypeDef* response);
+
+/// Streaming callback (return size to continue, anything else aborts)
+typedef size_t (*Fetch_DataCallback)(Fetch_Request_TypeDef* request,
+                                     const char* data, size_t size);
+
+/// Request descriptor for a batch of concurrent requests (HTTP or FTP)
+struct Fetch_Request {
+    const char* url; ///< Request URL (http(s):// or ftp://)
+    struct curl_slist* headers; ///< Request headers (may be NULL)
+    const char* body; ///< POST body (NULL for GET requests)
+    Fetch_Callback on_complete; ///< Called once the request has completed
+    void* userdata; ///< Caller data passed back through the callback
+    const char* alt_url; ///< Equivalent request to hedge with (may be NULL)
+    struct curl_slist* alt_headers; ///< Headers of the alternative request
+    /// Hedge after this long (0 = latency percentile of primary endpoint)
+    uint32_t hedge_after_ms;
+    bool used_alt; ///< Set if the response came from alt_url
+    /// Send alt_url first while its host has the lower median latency
+    bool prefer_faster;
+    /// Receives the body as it arrives (optional, not used with alt_url)
+    Fetch_DataCallback on_data;
+    /// @privatesection
+    HttpPool_Handle_TypeDef* handle; ///< Handle (and response buffer) in use
+    HttpPool_Handle_TypeDef* alt_handle; ///< Handle of the hedged request
+    bool hedged; ///< Alternative request has been sent
+    bool ordered; ///< Endpoint to send first has been chosen
+    bool swapped; ///< url and alt_url are swapped until completion
+    double started; ///< Time the request was sent (s)
+    double alt_started; ///< Time the alternative request was sent (s)
+    double hedge_at; ///< Time to send the alternative request (s)
+    Cache_Entry_TypeDef cache; ///< Cached validators of the response
+    struct curl_slist* cache_headers; ///< Conditional request headers
+    bool probing; ///< FTP file time/size is being checked before RETR
+    uint8_t attempts; ///< Retries after being throttled
+    bool keep_body; ///< Body is buffered as well as streamed (cache/record)
+    char host[FETCH_HOST_SIZE]; ///< Host name (used for per host limits)
+    char alt_host[FETCH_HOST_SIZE]; ///< Host name of alt_url
+};
+
+/// Limits applied to a batch of requests
+typedef struct {
+    uint16_t max_per_host; ///< Max requests in flight to the same host
+    uint16_t max_total; ///< Max requests in flight across all hosts
+} Fetch_Options_TypeDef;
+
+/// Set the limits used when a batch is run without options
+void Fetch_SetDefaultOptions(const Fetch_Options_TypeDef* options);
+
+/// Run a batch of requests concurrently (returns once all have completed)
+int8_t Fetch_Batch(Fetch_Request_TypeDef* requests, size_t n_requests,
+                   const Fetch_Options_TypeDef* options);
+
+#endif //PROGRAM_FETCH_H
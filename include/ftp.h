@@ -7,6 +7,10 @@
 #include <errno.h>
 
 #include "utils.h"
+#include "http_pool.h"
+#include "cache.h"
+#include "rate_limit.h"
+#include "transport.h"
 
 /// File Transfer Protocol request
 CURLcode FTPRequest(const char* url, Utils_ReqData_TypeDef* stream);
@@ -6,9 +6,18 @@
 #include <curl/curl.h>
 
 #include "utils.h"
+#include "http_pool.h"
+#include "cache.h"
+#include "rate_limit.h"
+#include "transport.h"
 
 /// HTTP GET & POST request using cURL.
 CURLcode HttpRequest(cJSON **response, const char *URL,
                      struct curl_slist *headers, int8_t post, const char* body);
 
+/// HTTP GET & POST request returning the raw response (caller owns buffer).
+CURLcode HttpRequestRaw(Utils_ReqData_TypeDef *response, const char *URL,
+                        struct curl_slist *headers, int8_t post,
+                        const char* body);
+
 #endif //PROGRAM_HTTP_H
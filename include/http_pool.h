@@ -0,0 +1,56 @@
+#ifndef PROGRAM_HTTP_POOL_H
+#define PROGRAM_HTTP_POOL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <log.h>
+
+#include "utils.h"
+
+/// Max number of idle cURL easy handles kept warm in the pool
+#define HTTP_POOL_SIZE                  16
+/// Response buffers larger than this are freed when a handle is released
+#define HTTP_POOL_MAX_BUFFER_SIZE       (8 * 1024 * 1024)
+
+/// Pooled cURL easy handle and its reusable response buffer
+typedef struct {
+    CURL* curl; ///< cURL easy handle
+    Utils_ReqData_TypeDef buffer; ///< Response buffer reused between requests
+} HttpPool_Handle_TypeDef;
+
+/// Transfer statistics for pooled cURL handles
+typedef struct {
+    uint32_t requests; ///< Transfers performed with pooled handles
+    uint32_t reused; ///< Transfers that reused an existing connection
+    uint32_t handles_created; ///< Easy handles created by the pool
+} HttpPool_Stats_TypeDef;
+
+/// Create the shared DNS, TLS session and connection cache
+int8_t HttpPool_Init(void);
+
+/// Free all pooled handles and the shared cache
+void HttpPool_Cleanup(void);
+
+/// Take a cURL easy handle from the pool (or create a new one)
+HttpPool_Handle_TypeDef* HttpPool_Acquire(void);
+
+/// Return a cURL easy handle to the pool
+void HttpPool_Release(HttpPool_Handle_TypeDef* handle);
+
+/// Take ownership of a handles response buffer
+void HttpPool_DetachBuffer(HttpPool_Handle_TypeDef* handle,
+                           Utils_ReqData_TypeDef* data);
+
+/// Update reuse statistics after a transfer has completed
+void HttpPool_RecordTransfer(CURL* curl);
+
+/// Snapshot of the pool statistics
+HttpPool_Stats_TypeDef HttpPool_GetStats(void);
+
+/// Log the pool statistics
+void HttpPool_LogStats(void);
+
+#endif //PROGRAM_HTTP_POOL_H
@@ -22,5 +22,12 @@
 #include "transform.h"
 #include "http.h"
 #include "ftp.h"
+#include "http_pool.h"
+#include "bench.h"
+#include "cache.h"
+#include "rate_limit.h"
+#include "transport.h"
+#include "statements.h"
+#include "transaction.h"
 
 #endif // HA_CLOSURE_ANALYSIS_MAIN_H
@@ -0,0 +1,120 @@
+#ifndef PROGRAM_PG_BINARY_H
+#define PROGRAM_PG_BINARY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+#include <libpq-fe.h>
+#include <log.h>
+
+#include "arena.h"
+
+/// Max parameters (or COPY columns) in one statement
+#define PG_BINARY_MAX_PARAMS            16
+/// Bytes held for each fixed size value (float8, int4 and timestamptz)
+#define PG_BINARY_VALUE_SIZE            8
+/// Seconds from the UNIX epoch to the PostgreSQL epoch (2000-01-01 UTC)
+#define PG_BINARY_EPOCH_OFFSET          946684800LL
+/// Microseconds in a second (PostgreSQL timestamps are in microseconds)
+#define PG_BINARY_USECS_PER_SEC         1000000LL
+
+/// Type OID of float8 (elements of a float8[] parameter)
+#define PG_BINARY_OID_FLOAT8            701
+/// Type OID of timestamptz (elements of a timestamptz[] parameter)
+#define PG_BINARY_OID_TIMESTAMPTZ       1184
+/// Bytes before the elements of a one dimensional binary array
+#define PG_BINARY_ARRAY_HEADER_SIZE     20
+
+/// Decode a timestamptz column as int64_t UNIX time
+#define PG_BINARY_COLUMN_EPOCH          0
+/// Decode a float8 (or float4) column as float
+#define PG_BINARY_COLUMN_FLOAT          1
+/// Decode an int4 column as int32_t
+#define PG_BINARY_COLUMN_INT            2
+/// Decode a text column as interned strings (NULL is read as "")
+#define PG_BINARY_COLUMN_STRING         3
+/// Decode a float8 (or float4) column as double (NULL is read as NAN)
+#define PG_BINARY_COLUMN_DOUBLE         4
+
+/// Parameters of a statement (or values of a COPY row) in binary format
+typedef struct {
+    int count; ///< Number of parameters
+    const char* values[PG_BINARY_MAX_PARAMS]; ///< Value of each (NULL = NULL)
+    int lengths[PG_BINARY_MAX_PARAMS]; ///< Length of each value in bytes
+    int formats[PG_BINARY_MAX_PARAMS]; ///< 0 = text, 1 = binary
+    /// Network byte order copy of each fixed size value
+    char data[PG_BINARY_MAX_PARAMS][PG_BINARY_VALUE_SIZE];
+} PGBinary_Params_TypeDef;
+
+/// Column of a query result decoded into an array
+typedef struct {
+    uint8_t type; ///< How to decode the column (e.g. PG_BINARY_COLUMN_FLOAT)
+    /// Value of each row (allocated from the arena passed to the decoder)
+    union {
+        int64_t* epochs; ///< PG_BINARY_COLUMN_EPOCH
+        float* floats; ///< PG_BINARY_COLUMN_FLOAT
+        int32_t* ints; ///< PG_BINARY_COLUMN_INT
+        const char** strings; ///< PG_BINARY_COLUMN_STRING
+        double* doubles; ///< PG_BINARY_COLUMN_DOUBLE
+    };
+} PGBinary_Column_TypeDef;
+
+/// Remove all parameters (so the struct can be reused for the next row)
+void PGBinary_Reset(PGBinary_Params_TypeDef* params);
+
+/// Add a float8 parameter
+int8_t PGBinary_AddFloat8(PGBinary_Params_TypeDef* params, double value);
+
+/// Add an int4 parameter
+int8_t PGBinary_AddInt4(PGBinary_Params_TypeDef* params, int32_t value);
+
+/// Add a timestamptz parameter (from UNIX time)
+int8_t PGBinary_AddTimestamp(PGBinary_Params_TypeDef* params, time_t value);
+
+/// Add a text parameter (NULL for NULL, the string isn't copied)
+int8_t PGBinary_AddText(PGBinary_Params_TypeDef* params, const char* value);
+
+/// Add a NULL parameter
+int8_t PGBinary_AddNull(PGBinary_Params_TypeDef* params);
+
+/// Add a float8[] parameter (copied into the arena)
+int8_t PGBinary_AddFloat8Array(PGBinary_Params_TypeDef* params,
+                               const double* values, int count,
+                               Arena_TypeDef* arena);
+
+/// Add a timestamptz[] parameter from UNIX times (copied into the arena)
+int8_t PGBinary_AddTimestampArray(PGBinary_Params_TypeDef* params,
+                                  const int64_t* values, int count,
+                                  Arena_TypeDef* arena);
+
+/// Add a value from a binary result as is (the result must outlive params)
+int8_t PGBinary_AddValue(PGBinary_Params_TypeDef* params, const PGresult* res,
+                         int row, int column);
+
+/// Run a statement with binary parameters and results
+PGresult* PGBinary_Exec(PGconn* psql_conn, const char* query,
+                        const PGBinary_Params_TypeDef* params);
+
+/// Run a prepared statement with binary parameters and results
+PGresult* PGBinary_ExecPrepared(PGconn* psql_conn, const char* stmt_name,
+                                const PGBinary_Params_TypeDef* params);
+
+/// Value of a float8 (or float4) column (0 if NULL)
+double PGBinary_GetFloat8(const PGresult* res, int row, int column);
+
+/// Value of an int4 column (0 if NULL)
+int32_t PGBinary_GetInt4(const PGresult* res, int row, int column);
+
+/// Value of a timestamptz column as UNIX time (0 if NULL)
+time_t PGBinary_GetTimestamp(const PGresult* res, int row, int column);
+
+/// Decode the first n_columns of a result into arrays (returns rows, -1 error)
+int PGBinary_DecodeColumns(const PGresult* res,
+                           PGBinary_Column_TypeDef* columns, int n_columns,
+                           Arena_TypeDef* arena);
+
+#endif //PROGRAM_PG_BINARY_H
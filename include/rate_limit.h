@@ -0,0 +1,60 @@
+#ifndef PROGRAM_RATE_LIMIT_H
+#define PROGRAM_RATE_LIMIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <log.h>
+
+/// Max characters in a host name
+#define RATE_LIMIT_HOST_SIZE            100
+/// Max number of hosts tracked by the rate limiter
+#define RATE_LIMIT_MAX_HOSTS            32
+/// Max times a throttled (429/503) request is retried
+#define RATE_LIMIT_MAX_RETRIES          4
+/// Back-off applied to a throttled host without a Retry-After header (s)
+#define RATE_LIMIT_DEFAULT_BACKOFF      1.0
+/// Longest back-off applied to a throttled host (s)
+#define RATE_LIMIT_MAX_BACKOFF          60.0
+/// Number of recent latencies kept per host (for percentiles)
+#define RATE_LIMIT_LATENCY_SAMPLES      64
+/// Min number of latencies needed before a percentile is reported
+#define RATE_LIMIT_MIN_SAMPLES          5
+
+/// Quota of a data provider
+typedef struct {
+    const char* host; ///< Host name (or domain suffix) of the provider
+    double rate; ///< Requests per second
+    uint16_t burst; ///< Requests that may be sent at once (bucket size)
+    uint16_t initial_in_flight; ///< Concurrency limit to start with
+    uint16_t max_in_flight; ///< Concurrency limit is never raised above this
+} RateLimit_Provider_TypeDef;
+
+/// Extract the host name from a URL
+void RateLimit_ParseHost(const char* url, char* host, size_t host_size);
+
+/// Take a request slot for a host without blocking
+double RateLimit_TryAcquire(const char* host);
+
+/// Take a request slot for a host (blocks until one is available)
+void RateLimit_Acquire(const char* host);
+
+/// Give back a request slot and adapt the limits (true = retry request)
+bool RateLimit_Release(const char* host, CURL* curl, CURLcode result);
+
+/// Record the latency of a request that was abandoned before completing
+void RateLimit_RecordLatency(const char* host, double latency);
+
+/// Latency percentile of recent requests to a host (-1 if not enough data)
+double RateLimit_LatencyPercentile(const char* host, double percentile);
+
+/// Log the requests sent and throttled per host
+void RateLimit_LogStats(void);
+
+#endif //PROGRAM_RATE_LIMIT_H
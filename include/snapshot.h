@@ -0,0 +1,66 @@
+#ifndef PROGRAM_SNAPSHOT_H
+#define PROGRAM_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <log.h>
+
+/// Identifies a snapshot file
+#define SNAPSHOT_MAGIC                  "PSNAPSH"
+/// Characters in SNAPSHOT_MAGIC (including null)
+#define SNAPSHOT_MAGIC_SIZE             8
+/// Format version (bump when a snapshot struct changes layout)
+#define SNAPSHOT_VERSION                1
+/// Bytes before the payload (keeps the payload aligned within the mapping)
+#define SNAPSHOT_HEADER_SIZE            64
+/// Max characters in a snapshot file path
+#define SNAPSHOT_PATH_SIZE              256
+
+/// BOM_WeatherStations_TypeDef payload
+#define SNAPSHOT_TYPE_STATIONS          1
+/// T_LocationsLookup_TypeDef payload
+#define SNAPSHOT_TYPE_LOCATIONS         2
+
+/// Header at the start of every snapshot file
+typedef struct {
+    char magic[SNAPSHOT_MAGIC_SIZE]; ///< SNAPSHOT_MAGIC
+    uint32_t version; ///< SNAPSHOT_VERSION when written
+    uint32_t type; ///< Payload type (e.g. SNAPSHOT_TYPE_STATIONS)
+    uint64_t size; ///< Payload size (sizeof the payload struct)
+    uint64_t source; ///< Checksum of the data the payload was built from
+    uint64_t checksum; ///< Checksum of the payload
+} Snapshot_Header_TypeDef;
+
+/// Read-only mapping of a snapshot
+typedef struct {
+    const void* data; ///< Payload (NULL if not mapped)
+    size_t size; ///< Payload size
+    void* map; ///< Start of mapping
+    size_t map_size; ///< Size of mapping
+} Snapshot_TypeDef;
+
+/// Checksum of a file (e.g. the source of a snapshot)
+int8_t Snapshot_FileChecksum(const char* path, uint64_t* checksum);
+
+/// Write a payload to a snapshot file
+int8_t Snapshot_Write(const char* path, uint32_t type, uint64_t source,
+                      const void* data, size_t size);
+
+/// Map a snapshot file read-only (after validating it)
+int8_t Snapshot_Map(Snapshot_TypeDef* snapshot, const char* path,
+                    uint32_t type, const uint64_t* source, size_t size);
+
+/// Unmap a snapshot
+void Snapshot_Unmap(Snapshot_TypeDef* snapshot);
+
+/// Remove a snapshot file (so it is rebuilt)
+void Snapshot_Remove(const char* path);
+
+#endif //PROGRAM_SNAPSHOT_H
@@ -0,0 +1,40 @@
+#ifndef PROGRAM_STATEMENTS_H
+#define PROGRAM_STATEMENTS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <libpq-fe.h>
+#include <log.h>
+
+#include "pg_binary.h"
+#include "transaction.h"
+
+/// Max connections statements are tracked for (e.g. one per worker)
+#define STATEMENTS_MAX_CONNECTIONS      16
+/// SQLSTATE of "prepared statement does not exist"
+#define STATEMENTS_SQLSTATE_MISSING     "26000"
+/// SQLSTATE of "prepared statement already exists"
+#define STATEMENTS_SQLSTATE_DUPLICATE   "42P05"
+
+/// Statement prepared on every connection
+typedef struct {
+    const char* name; ///< Prepared statement name
+    const char* sql; ///< Statement ($1, $2 ... cast to their types)
+    int nparams; ///< Number of parameters
+} Statements_Statement_TypeDef;
+
+/// Prepare every known statement on a connection (once per session)
+int8_t Statements_Prepare(PGconn* psql_conn);
+
+/// Run a known statement with binary parameters and results
+PGresult* Statements_Exec(PGconn* psql_conn, const char* stmt_name,
+                          const PGBinary_Params_TypeDef* params);
+
+/// Stop tracking a connection (call before PQfinish())
+void Statements_Forget(PGconn* psql_conn);
+
+#endif //PROGRAM_STATEMENTS_H
@@ -0,0 +1,57 @@
+#ifndef PROGRAM_TRANSACTION_H
+#define PROGRAM_TRANSACTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <libpq-fe.h>
+#include <log.h>
+
+#include "transport.h"
+
+/// Environment variable holding the rows written per commit
+#define TRANSACTION_ROWS_ENV                "TRANSACTION_ROWS_PER_COMMIT"
+/// Rows written per commit if not set in the environment
+#define TRANSACTION_DEFAULT_ROWS_PER_COMMIT 50000
+/// Max connections with a transaction open at once (e.g. one per worker)
+#define TRANSACTION_MAX_ACTIVE              16
+/// Max stages in the run summary
+#define TRANSACTION_MAX_STAGES              16
+/// Savepoint set before each unit of work (e.g. a bulk load)
+#define TRANSACTION_SAVEPOINT               "transaction_unit"
+
+/// Writes of a stage (e.g. BOM) over the run
+typedef struct {
+    const char* name; ///< Stage name
+    uint32_t units; ///< Units of work kept
+    uint32_t rollbacks; ///< Units rolled back to their savepoint
+    uint32_t commits; ///< Transactions committed
+    uint64_t rows; ///< Rows written by the units kept
+    double commit_time; ///< Time waiting for commits to be flushed (s)
+} Transaction_Stats_TypeDef;
+
+/// Read the rows written per commit from the environment
+void Transaction_Init(void);
+
+/// Start the transaction of a stage (nested calls join the open one)
+int8_t Transaction_Begin(PGconn* psql_conn, const char* stage);
+
+/// Commit the transaction of a stage
+int8_t Transaction_End(PGconn* psql_conn);
+
+/// Set a savepoint before a unit of work (no-op outside a transaction)
+int8_t Transaction_UnitBegin(PGconn* psql_conn);
+
+/// Release (or roll back, if rows < 0) a unit and commit every n rows
+int8_t Transaction_UnitEnd(PGconn* psql_conn, int64_t rows);
+
+/// Start the transaction of a stage again after its connection was reset
+int8_t Transaction_Reconnected(PGconn* psql_conn);
+
+/// Log the units, rows, commits and commit time of each stage
+void Transaction_LogStats(void);
+
+#endif //PROGRAM_TRANSACTION_H
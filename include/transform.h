@@ -10,6 +10,10 @@
 #include "FoodAuthority/harvest_area.h"
 #include "WillyWeather/location.h"
 #include "utils.h"
+#include "bulk.h"
+#include "statements.h"
+#include "workers.h"
+#include "weather_store.h"
 
 /// Maximum number of locations
 #define T_MAX_N_LOCATIONS           50
@@ -26,6 +30,14 @@
 /// Data type size
 #define T_DATA_TYPE_SIZE            30
 
+/// Merge the weather of every program (see T_MergeWeatherDB())
+#define T_ALL_PROGRAMS              (-1)
+
+/// Days before each day in its precipitation window
+#define T_WINDOW_START              5
+/// Days from each day in its precipitation window (including the day)
+#define T_WINDOW_END                8
+
 #define T_DATA_QUERY_LENGTH         15
 #define T_DATA_WINDOW_SIZE          7
 
@@ -83,13 +95,10 @@ typedef struct{
 void T_BuildWeatherDB(T_LocationsLookup_TypeDef* locations,
                       PGconn* psql_conn);
 
+/// Merge changed forecast and observed rows into weather on the server
+int64_t T_MergeWeatherDB(PGconn* psql_conn, int program_id);
+
 /// Transforms data from all harvest programs into flood prediction
 void T_FloodPrediction(PGconn* psql_conn);
 
-/// Window transform Z-Score values into a probability of flooding event
-void T_WindowDataset(PGconn* psql_conn, int program_id);
-
-/// Normalise summed moving window precipitation between 0 and 1
-void T_NormaliseWindowedPrecipitation(PGconn* psql_conn, int program_id);
-
 #endif //PROGRAM_TRANSFORM_H
@@ -0,0 +1,91 @@
+#ifndef PROGRAM_TRANSPORT_H
+#define PROGRAM_TRANSPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <log.h>
+
+#include "utils.h"
+
+/// Environment variable selecting the mode (live, record or replay)
+#define TRANSPORT_MODE_ENV              "TRANSPORT_MODE"
+/// Environment variable holding the corpus directory
+#define TRANSPORT_CORPUS_ENV            "TRANSPORT_CORPUS"
+/// Environment variable holding the latency injected in replay mode (ms)
+#define TRANSPORT_LATENCY_ENV           "TRANSPORT_REPLAY_LATENCY_MS"
+/// Default corpus directory
+#define TRANSPORT_DEFAULT_CORPUS        "tmp/corpus"
+/// Max characters in a corpus file path
+#define TRANSPORT_PATH_SIZE             256
+/// Size of chunks read when replaying a response
+#define TRANSPORT_READ_CHUNK_SIZE       16384
+/// Max number of secrets (API keys, tokens) hidden from corpus keys
+#define TRANSPORT_MAX_SECRETS           8
+/// Credential used in replay mode when a token is not in the environment
+#define TRANSPORT_REPLAY_SECRET         "transport-replay-secret"
+
+/// Requests go to the network as normal
+#define TRANSPORT_LIVE                  0
+/// Requests go to the network and every response is saved to the corpus
+#define TRANSPORT_RECORD                1
+/// Responses are served from the corpus (no network access)
+#define TRANSPORT_REPLAY                2
+
+/// Timer for a stage of the pipeline (e.g. building weather_bom)
+typedef struct {
+    const char* name; ///< Stage name
+    double started; ///< Time the stage started (s)
+    double network_at_start; ///< Network time recorded before the stage (s)
+} Transport_Stage_TypeDef;
+
+/// Read the transport mode from the environment
+int8_t Transport_Init(void);
+
+/// Current transport mode (TRANSPORT_LIVE, TRANSPORT_RECORD, ...)
+uint8_t Transport_Mode(void);
+
+/// Latency injected for each replayed response (s)
+double Transport_ReplayLatency(void);
+
+/// Hide a credential found in URLs or bodies from corpus keys
+void Transport_AddSecret(const char* secret);
+
+/// Check if a request has been recorded
+bool Transport_Recorded(const char* url, const char* body);
+
+/// Load a recorded response (without injecting latency)
+CURLcode Transport_Load(const char* url, const char* body,
+                        Utils_ReqData_TypeDef* data);
+
+/// Load a recorded response and wait for the injected latency
+CURLcode Transport_Replay(const char* url, const char* body,
+                          Utils_ReqData_TypeDef* data);
+
+/// Wait for the latency injected in replay mode
+void Transport_InjectLatency(void);
+
+/// Save a response to the corpus (record mode only)
+void Transport_Record(const char* url, const char* body, CURL* curl,
+                      CURLcode result, const Utils_ReqData_TypeDef* data);
+
+/// Add time spent waiting on the network (or replayed latency)
+void Transport_AddNetworkTime(double seconds);
+
+/// Monotonic time in seconds
+double Transport_Now(void);
+
+/// Start timing a stage of the pipeline
+void Transport_StageBegin(Transport_Stage_TypeDef* stage, const char* name);
+
+/// Log the time of a stage split into network and processing time
+void Transport_StageEnd(Transport_Stage_TypeDef* stage);
+
+#endif //PROGRAM_TRANSPORT_H
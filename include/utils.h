@@ -2,9 +2,11 @@
 #define HA_CLOSURE_ANALYSIS_UTILS_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <curl/curl.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <cjson/cJSON.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -12,15 +14,57 @@
 #include <math.h>
 #include <log.h>
 #include <libpq-fe.h>
+#include "pg_binary.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define USER_AGENT "EnvMonitoring/0.1 (NSW Department of Primary Industries)"
 
+/// Initial allocation of a response buffer
+#define UTILS_REQ_DATA_MIN_SIZE         4096
+/// Largest Content-Length used to pre-size a response buffer
+#define UTILS_REQ_DATA_MAX_PRESIZE      (64 * 1024 * 1024)
+
+/// Points are stored in multiples of this (doubles in the widest vector)
+#define UTILS_POINTS_ALIGN              4
+
+/// Pipelined statements sent per sync point (one block)
+#define UTILS_PIPELINE_MAX_QUEUED       256
+/// Max characters in the label of a pipelined statement
+#define UTILS_PIPELINE_LABEL_SIZE       100
+/// Savepoint set around each block inside an explicit transaction
+#define UTILS_PIPELINE_SAVEPOINT        "utils_pipeline"
+
 /// Holds HTTP response data before converting these data into cJSON objects.
 typedef struct {
 	char *memory; ///< The (response) data
 	size_t size; ///< Size of the (response) data
+	size_t capacity; ///< Allocated size of memory
+	size_t expected; ///< Expected size of the data (0 if unknown)
+	CURL *curl; ///< Handle receiving the data (used to get Content-Length)
+	bool not_modified; ///< Data was restored from the cache (see cache.h)
 } Utils_ReqData_TypeDef;
 
+/// Points on earth packed as arrays with their trigonometry precomputed
+/// (brute force reference, see Bench_PointsDistance())
+typedef struct {
+    size_t count; ///< Number of points
+    size_t capacity; ///< Allocated points (multiple of UTILS_POINTS_ALIGN)
+    double* sin_latitude; ///< sin(latitude) of each point
+    double* cos_latitude; ///< cos(latitude) of each point
+    double* sin_longitude; ///< sin(longitude) of each point
+    double* cos_longitude; ///< cos(longitude) of each point
+} Utils_Points_TypeDef;
+
+/// Allocate an empty response buffer
+int8_t Utils_ReqDataInit(Utils_ReqData_TypeDef *data, CURL *curl);
+
+/// Empty a response buffer (keeping its allocation) so it can be reused
+void Utils_ReqDataReset(Utils_ReqData_TypeDef *data, CURL *curl);
+
 /// Helper function to handle a CURL request response which normally gets
 /// written to stdout.
 size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb,
@@ -34,7 +78,7 @@ void WriteTimeseriesToFile(const char* filename, time_t* dates, double* values,
                            int16_t max_n_values);
 
 /// Modified minify function from cJSON
-void cJSON_Minify_Mod(char *json);
+size_t cJSON_Minify_Mod(char *json);
 
 /// Distance between two points on earth
 double Utils_PointsDistance(double latitude,
@@ -42,7 +86,57 @@ double Utils_PointsDistance(double latitude,
                             double station_latitude,
                             double station_longitude);
 
-void Utils_PrepareStatement(PGconn* psql_conn, const char* stmt_name,
-                            const char* stmt, const int nparams);
+/// Statement of a pipeline block (kept until the block is collected)
+typedef struct {
+    const char* stmt_name; ///< Prepared statement
+    PGBinary_Params_TypeDef params; ///< Copy of the parameters
+    char label[UTILS_PIPELINE_LABEL_SIZE]; ///< Logged if the statement fails
+    bool failed; ///< Statement failed (it isn't sent again)
+} Utils_PipelineRow_TypeDef;
+
+/// Prepared statements sent in blocks without waiting for each result
+typedef struct {
+    PGconn* psql_conn; ///< Connection in pipeline mode
+    bool savepoint; ///< Blocks run inside a transaction (see Begin)
+    uint16_t queued; ///< Statements in the current block
+    Utils_PipelineRow_TypeDef* rows; ///< Statements of the current block
+    Arena_TypeDef arena; ///< Text parameters of the current block
+    uint32_t sent; ///< Statements queued
+    uint32_t failed; ///< Statements that failed
+    uint32_t resent; ///< Statements sent again after a failure in the block
+} Utils_Pipeline_TypeDef;
+
+/// Allocate packed points
+int8_t Utils_PointsInit(Utils_Points_TypeDef* points, size_t capacity);
+
+/// Add a point (latitude and longitude in degrees)
+int8_t Utils_PointsAdd(Utils_Points_TypeDef* points, double latitude,
+                       double longitude);
+
+/// Free packed points
+void Utils_PointsFree(Utils_Points_TypeDef* points);
+
+/// Distance between a point and every packed point (SIMD)
+void Utils_PointsDistanceBatch(double latitude, double longitude,
+                               const Utils_Points_TypeDef* points,
+                               double* distances);
+
+/// Index of the closest packed point (-1 if there are no points)
+int64_t Utils_PointsNearest(double latitude, double longitude,
+                            const Utils_Points_TypeDef* points,
+                            double* distance);
+
+/// Put a connection into pipeline mode
+int8_t Utils_PipelineBegin(Utils_Pipeline_TypeDef* pipeline,
+                           PGconn* psql_conn);
+
+/// Queue a prepared statement (label identifies it if it fails)
+int8_t Utils_PipelineExecPrepared(Utils_Pipeline_TypeDef* pipeline,
+                                  const char* stmt_name,
+                                  const PGBinary_Params_TypeDef* params,
+                                  const char* label);
+
+/// Collect the remaining results and leave pipeline mode
+uint32_t Utils_PipelineEnd(Utils_Pipeline_TypeDef* pipeline);
 
 #endif // HA_CLOSURE_ANALYSIS_UTILS_H
@@ -0,0 +1,57 @@
+#ifndef PROGRAM_WEATHER_STORE_H
+#define PROGRAM_WEATHER_STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <libpq-fe.h>
+#include <log.h>
+
+#include "arena.h"
+#include "pg_binary.h"
+#include "statements.h"
+
+/// Weather of one program (slices of the store columns)
+typedef struct {
+    int32_t program_id; ///< Unique ID of the program (see harvest_lookup)
+    const char* program_name; ///< NSW Food Authority program name
+    int count; ///< Number of rows
+    int64_t* timestamps; ///< Time of each row (UNIX time, as stored)
+    int32_t* days; ///< Day of each row (days since 1970-01-01, local time)
+    double* observed; ///< Observed precipitation (NAN if not observed)
+    double* forecast; ///< Forecast precipitation (NAN if not forecast)
+    double* merged; ///< Observed precipitation, otherwise the forecast
+    double* window_sum; ///< Windowed forecast sum (NAN without a full window)
+    double* normalised; ///< Window sum normalised between 0 and 1 (or NAN)
+} WeatherStore_Series_TypeDef;
+
+/// Weather of every program, held in contiguous columns
+typedef struct {
+    Arena_TypeDef arena; ///< Holds every column and program name
+    int n_series; ///< Number of programs
+    WeatherStore_Series_TypeDef* series; ///< Weather of each program
+    int n_rows; ///< Rows of every program together
+} WeatherStore_TypeDef;
+
+/// Load the weather of every program in harvest_lookup from the weather table
+int8_t WeatherStore_Load(WeatherStore_TypeDef* store, PGconn* psql_conn);
+
+/// Sum every full window of a daily series (returns the number of sums)
+int WeatherStore_WindowSum(const double* values, int n_values, int w_start,
+                           int w_end, double* sums);
+
+/// Window and normalise the forecast of a program by calendar day
+int8_t WeatherStore_Window(WeatherStore_Series_TypeDef* series, int w_start,
+                           int w_end);
+
+/// Write the window sums of a program back to the weather table
+int8_t WeatherStore_Save(const WeatherStore_Series_TypeDef* series,
+                         PGconn* psql_conn);
+
+/// Free every column of the store
+void WeatherStore_Free(WeatherStore_TypeDef* store);
+
+#endif //PROGRAM_WEATHER_STORE_H
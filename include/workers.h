@@ -0,0 +1,35 @@
+#ifndef PROGRAM_WORKERS_H
+#define PROGRAM_WORKERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libpq-fe.h>
+#include <log.h>
+
+#include "utils.h"
+#include "statements.h"
+
+/// Environment variable holding the number of workers
+#define WORKERS_THREADS_ENV             "WORKERS_THREADS"
+/// Max workers (each holds a connection, see STATEMENTS_MAX_CONNECTIONS)
+#define WORKERS_MAX_THREADS             8
+/// Max characters in one buffered log line
+#define WORKERS_LOG_LINE_SIZE           1024
+
+/// Run one task (e.g. one program) on the connection of a worker
+typedef void (*Workers_TaskFn)(PGconn* psql_conn, int task, void* userdata);
+
+/// Number of workers used by Workers_Run()
+uint16_t Workers_Count(void);
+
+/// Run tasks 0 ... n_tasks - 1 on a pool of workers with a connection each
+int8_t Workers_Run(PGconn* psql_conn, int n_tasks, Workers_TaskFn task_fn,
+                   void* userdata);
+
+#endif //PROGRAM_WORKERS_H
@@ -1,15 +1,62 @@
 #include "BOM/historical_weather.h"
 
-static int8_t BOM_ParseWeather(Utils_ReqData_TypeDef *stream,
-                               BOM_WeatherDataset_TypeDef *dataset,
-                               BOM_WeatherStation_TypeDef *station);
+/// Build FTP URL of a stations monthly .csv file
+static void BOM_BuildURL(const BOM_WeatherStation_TypeDef *station,
+                         const char *year_month, char *url, size_t url_size);
+
+/// Append part of a row to the parsers partial row
+static void BOM_CSVAppend(BOM_CSVParser_TypeDef *parser, const char *data,
+                          size_t size);
+
+/// Parse the parsers (complete) row into its dataset
+static void BOM_CSVParseRow(BOM_CSVParser_TypeDef *parser);
+
+/// Write an archived .csv file (run on its own thread)
+static void *BOM_CSVArchiveWrite(void *arg);
+
+/// Monthly dataset request for a station in a batch of requests
+typedef struct {
+    const BOM_WeatherStation_TypeDef *station; ///< Station being requested
+    char year_month[BOM_TIME_STR_BUFFER_SIZE]; ///< Month e.g. 202206
+    char url[BOM_URL_SIZE]; ///< Request URL
+    Bulk_Load_TypeDef *load; ///< Bulk load to write results to
+    BOM_CSVParser_TypeDef parser; ///< Parses the file as it arrives
+    /// Dataset being parsed (allocated once the first chunk arrives)
+    BOM_WeatherDataset_TypeDef *dataset;
+} BOM_BatchItem_TypeDef;
+
+/// .csv file waiting to be written to the archive
+typedef struct {
+    Utils_ReqData_TypeDef data; ///< File contents
+    char path[BOM_CSV_PATH_SIZE]; ///< File to write
+} BOM_CSVArchiveJob_TypeDef;
+
+/// Archive settings and files still being written
+static struct {
+    bool enabled; ///< Downloaded .csv files are archived
+    char directory[BOM_CSV_PATH_SIZE]; ///< Directory to archive files to
+    pthread_mutex_t lock; ///< Protects pending
+    pthread_cond_t idle; ///< Signalled when pending reaches zero
+    uint32_t pending; ///< Files still being written
+} BOM_CSVArchive = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                    .idle = PTHREAD_COND_INITIALIZER};
+
+/// Streaming callback for a monthly dataset request in a batch
+static size_t BOM_OnWeatherData(Fetch_Request_TypeDef *request,
+                                const char *data, size_t size);
+
+/// Completion callback for a monthly dataset request in a batch
+static void BOM_OnWeather(Fetch_Request_TypeDef *request, CURLcode result,
+                          Utils_ReqData_TypeDef *response);
 
 /**
  * Get a file from the Bureau of Meterology FTP server.
  *
  * The BOM provides formatted .csv files for certain locations in Australia.
  * These .csv files can be downloaded from the BOM's FTP server. Currently,
- * it is unknown when the data is updated (sometime daily).
+ * it is unknown when the data is updated (sometime daily). The file is
+ * parsed straight from the response (see BOM_CSVParserFeed()) and archived
+ * to disk in the background if enabled (see BOM_SetCSVArchive()).
  *
  * @see http://www.bom.gov.au/catalogue/anon-ftp.shtml
  *
@@ -19,16 +66,12 @@ static int8_t BOM_ParseWeather(Utils_ReqData_TypeDef *stream,
  * @return Returns cURL status code.
  */
 CURLcode BOM_GetWeather(BOM_WeatherDataset_TypeDef *dataset,
-                        BOM_WeatherStation_TypeDef *station,
+                        const BOM_WeatherStation_TypeDef *station,
                         const char *year_month) {
 
     // Build URL from filename and year_month
-    char url[250];
-    snprintf(url, sizeof(url), "ftp://ftp.bom.gov.au/anon/gen/clim_data/"
-                            "IDCKWCDEA0/tables/nsw/%s/%s-%s.csv",
-             station->filename,
-             station->filename,
-             year_month);
+    char url[BOM_URL_SIZE];
+    BOM_BuildURL(station, year_month, url, sizeof(url));
 
     log_info("Getting location data from BOM FTP server in directory: %s\n",
              url);
@@ -37,7 +80,10 @@ CURLcode BOM_GetWeather(BOM_WeatherDataset_TypeDef *dataset,
     CURLcode result = FTPRequest(url, &stream);
 
     if (result == CURLE_OK) {
-        BOM_ParseWeather(&stream, dataset, station);
+        BOM_CSVParser_TypeDef parser;
+        BOM_CSVParserInit(&parser, dataset, station, year_month);
+        BOM_CSVParserFeed(&parser, stream.memory, stream.size);
+        BOM_CSVParserFinish(&parser);
     } else {
         log_error("Unable to get dataset from "
                   "Bureau of Meterology FTP Server.\n");
@@ -48,39 +94,245 @@ CURLcode BOM_GetWeather(BOM_WeatherDataset_TypeDef *dataset,
 }
 
 /**
- * Saves a downloaded .csv dataset to a file. Also parses the data into a BOM
- * dataset struct.
+ * Build the FTP URL of a stations monthly .csv file.
  *
- * @param stream Contains raw string with .csv file.
- * @param dataset Dataset to populate.
- * @return Status code OK = 0 ... ERROR = -1
+ * @param station Station to build URL for.
+ * @param year_month Year and month of interest e.g. 202206.
+ * @param url URL to populate.
+ * @param url_size Size of URL buffer.
  */
-static int8_t BOM_ParseWeather(Utils_ReqData_TypeDef *stream,
-                               BOM_WeatherDataset_TypeDef *dataset,
-                               BOM_WeatherStation_TypeDef *station) {
-
-    // Construct tempory file from raw stream
-    MakeDirectory("datasets");
-    MakeDirectory("datasets/bom");
-    MakeDirectory("datasets/bom/historical");
-
-    size_t full_filename_size = (size_t)(BOM_STATION_FILENAME_SIZE * 2);
-    char filename[full_filename_size];
-    snprintf(filename, sizeof(filename),
-             "datasets/bom/historical/%s.csv",
-             station->filename);
-    FILE *write_file = fopen(filename, "w");
-    if (write_file != NULL) {
-        fputs(stream->memory, write_file);
-        fclose(write_file);
-    } else {
-        log_error("Unable to write BOM weather data to file.\n");
-        return -1;
+static void BOM_BuildURL(const BOM_WeatherStation_TypeDef *station,
+                         const char *year_month, char *url, size_t url_size) {
+    snprintf(url, url_size, "ftp://ftp.bom.gov.au/anon/gen/clim_data/"
+                            "IDCKWCDEA0/tables/nsw/%s/%s-%s.csv",
+             station->filename,
+             station->filename,
+             year_month);
+}
+
+/**
+ * Start parsing a stations .csv file into a dataset.
+ *
+ * The parser is fed the file in chunks of any size (e.g. straight from a
+ * cURL write callback) so the file never needs to be held in memory or
+ * written to disk before it is parsed. Rows split across chunks are carried
+ * over to the next chunk.
+ *
+ * @code
+ * BOM_WeatherDataset_TypeDef dataset = {0};
+ * BOM_CSVParser_TypeDef parser;
+ * BOM_CSVParserInit(&parser, &dataset, station, "202206");
+ * curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BOM_CSVWriteCallback);
+ * curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&parser);
+ * if (curl_easy_perform(curl) == CURLE_OK) {
+ *     BOM_CSVParserFinish(&parser);
+ * } else {
+ *     BOM_CSVParserDiscard(&parser);
+ * }
+ * @endcode
+ *
+ * @param parser Parser to initialise.
+ * @param dataset Dataset to populate (count should start at zero).
+ * @param station Station the file belongs to.
+ * @param year_month Month of the file e.g. 202206 (NULL to never archive).
+ */
+void BOM_CSVParserInit(BOM_CSVParser_TypeDef *parser,
+                       BOM_WeatherDataset_TypeDef *dataset,
+                       const BOM_WeatherStation_TypeDef *station,
+                       const char *year_month) {
+    memset(parser, 0, sizeof(BOM_CSVParser_TypeDef));
+    parser->dataset = dataset;
+
+    // Convert filename to uppercase location (could be done better)
+    // E.g. moruya_airport -> MORUYA AIRPORT
+    for (int16_t i = 0; i < BOM_STATION_FILENAME_SIZE - 1; i++) {
+        if (station->filename[i] == '\0') break;
+
+        // Conver to uppercase
+        if (isalpha(station->filename[i])) {
+            parser->location[i] = (char) toupper(station->filename[i]);
+        } else {
+            if (station->filename[i] == '_') {
+                parser->location[i] = ' ';
+            } else {
+                parser->location[i] = station->filename[i];
+            }
+        }
     }
 
-    BOM_LoadWeatherFromCSV(filename, dataset, station);
+    if (BOM_CSVArchive.enabled && year_month != NULL &&
+        Utils_ReqDataInit(&parser->archive, NULL) == 0) {
+        snprintf(parser->archive_path, sizeof(parser->archive_path),
+                 "%s/%s-%s.csv", BOM_CSVArchive.directory,
+                 station->filename, year_month);
+    }
+}
 
-    return 0;
+/**
+ * Parse the next chunk of a .csv file.
+ *
+ * Each complete row is added to the dataset straight away. Rows that don't
+ * belong to the parsers station (e.g. headers) are skipped.
+ *
+ * @param parser Parser from BOM_CSVParserInit().
+ * @param data Chunk of the file.
+ * @param size Size of chunk.
+ * @return Number of bytes consumed (always size).
+ */
+size_t BOM_CSVParserFeed(BOM_CSVParser_TypeDef *parser, const char *data,
+                         size_t size) {
+    if (parser->archive.memory != NULL && size > 0) {
+        // Only read, the callback takes a non-const pointer
+        WriteMemoryCallback((void *) (uintptr_t) data, 1, size,
+                            &parser->archive);
+    }
+
+    const char *end = data + size;
+    while (data < end) {
+        const char *newline = memchr(data, '\n', (size_t)(end - data));
+        const char *row_end = (newline != NULL) ? newline : end;
+        BOM_CSVAppend(parser, data, (size_t)(row_end - data));
+        if (newline == NULL) break;
+
+        BOM_CSVParseRow(parser);
+        data = newline + 1;
+    }
+
+    return size;
+}
+
+/**
+ * Parse the last row of a .csv file and archive the file.
+ *
+ * The archived copy (if enabled) is written on a background thread so the
+ * caller doesn't wait on the disk (see BOM_WaitForCSVArchive()).
+ *
+ * @param parser Parser from BOM_CSVParserInit().
+ * @return Status code OK = 0 ... ERROR = -1 (nothing was parsed)
+ */
+int8_t BOM_CSVParserFinish(BOM_CSVParser_TypeDef *parser) {
+    // Last row may not end with a newline
+    if (parser->line_length > 0) {
+        BOM_CSVParseRow(parser);
+    }
+
+    if (parser->dropped > 0) {
+        log_warn("%u rows of %s did not fit in the BOM dataset.\n",
+                 parser->dropped, parser->location);
+    }
+
+    if (parser->archive.memory != NULL) {
+        BOM_CSVArchiveJob_TypeDef *job = malloc(
+                sizeof(BOM_CSVArchiveJob_TypeDef));
+        if (job != NULL) {
+            job->data = parser->archive;
+            memcpy(job->path, parser->archive_path, sizeof(job->path));
+            parser->archive.memory = NULL;
+
+            pthread_mutex_lock(&BOM_CSVArchive.lock);
+            BOM_CSVArchive.pending++;
+            pthread_mutex_unlock(&BOM_CSVArchive.lock);
+
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, BOM_CSVArchiveWrite, job) == 0) {
+                pthread_detach(thread);
+            } else {
+                BOM_CSVArchiveWrite(job);
+            }
+        }
+        BOM_CSVParserDiscard(parser);
+    }
+
+    if (parser->dataset->count != 0) {
+        log_info("BOM dataset successfully parsed and loaded.\n");
+        return 0;
+    }
+
+    log_error("BOM dataset could not be loaded.\n");
+    return -1;
+}
+
+/**
+ * Abandon a parser (e.g. the transfer failed) without archiving the file.
+ *
+ * @param parser Parser from BOM_CSVParserInit().
+ */
+void BOM_CSVParserDiscard(BOM_CSVParser_TypeDef *parser) {
+    free(parser->archive.memory);
+    parser->archive.memory = NULL;
+    parser->line_length = 0;
+}
+
+/**
+ * cURL write callback feeding a BOM_CSVParser_TypeDef.
+ *
+ * @param contents The chunk received.
+ * @param size The size of items received.
+ * @param nmemb The number of members (data size).
+ * @param userp Parser from BOM_CSVParserInit().
+ * @return The size of received data.
+ */
+size_t BOM_CSVWriteCallback(void *contents, size_t size, size_t nmemb,
+                            void *userp) {
+    return BOM_CSVParserFeed((BOM_CSVParser_TypeDef *) userp,
+                             (const char *) contents, size * nmemb);
+}
+
+/**
+ * Archive downloaded .csv files to a directory.
+ *
+ * Archiving is off by default. When enabled each file parsed with a month
+ * (see BOM_CSVParserInit()) is written to `<directory>/<station>-<month>.csv`
+ * on a background thread once it has been parsed.
+ *
+ * @code
+ * BOM_SetCSVArchive(BOM_CSV_ARCHIVE_DIRECTORY);
+ * BOM_TimeseriesToDB(start_dt, BOM_SYNC_FULL, psql_conn);
+ * BOM_WaitForCSVArchive();
+ * @endcode
+ *
+ * @param directory Directory to archive to (NULL to disable archiving).
+ */
+void BOM_SetCSVArchive(const char *directory) {
+    if (directory == NULL) {
+        BOM_CSVArchive.enabled = false;
+        return;
+    }
+
+    // Create each parent directory (e.g. datasets then datasets/bom)
+    char path[BOM_CSV_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s", directory);
+    for (char *c = path + 1; *c != '\0'; c++) {
+        if (*c == '/') {
+            *c = '\0';
+            MakeDirectory(path);
+            *c = '/';
+        }
+    }
+    if (MakeDirectory(path) != 0) {
+        log_error("Unable to create %s. BOM .csv files will not be "
+                  "archived.\n", directory);
+        BOM_CSVArchive.enabled = false;
+        return;
+    }
+
+    snprintf(BOM_CSVArchive.directory, sizeof(BOM_CSVArchive.directory),
+             "%s", directory);
+    BOM_CSVArchive.enabled = true;
+}
+
+/**
+ * Wait for archived .csv files to be written.
+ *
+ * Should be called before the program exits (or before the archive is
+ * read) so no file is left half written.
+ */
+void BOM_WaitForCSVArchive(void) {
+    pthread_mutex_lock(&BOM_CSVArchive.lock);
+    while (BOM_CSVArchive.pending > 0) {
+        pthread_cond_wait(&BOM_CSVArchive.idle, &BOM_CSVArchive.lock);
+    }
+    pthread_mutex_unlock(&BOM_CSVArchive.lock);
 }
 
 /**
@@ -92,7 +344,7 @@ static int8_t BOM_ParseWeather(Utils_ReqData_TypeDef *stream,
  */
 int8_t BOM_LoadWeatherFromCSV(const char *filename,
                               BOM_WeatherDataset_TypeDef *dataset,
-                              BOM_WeatherStation_TypeDef *station) {
+                              const BOM_WeatherStation_TypeDef *station) {
 
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
@@ -100,90 +352,123 @@ int8_t BOM_LoadWeatherFromCSV(const char *filename,
         return -1;
     }
 
-    // Convert filename to uppercase location (could be done better)
-    // E.g. moruya_airport -> MORUYA AIRPORT
-    char location[BOM_STATION_FILENAME_SIZE];
-    memset(location, 0, sizeof(location));
-    for (int16_t i = 0; i < BOM_STATION_FILENAME_SIZE; i++) {
-        if (station->filename[i] == '\0') break;
+    BOM_CSVParser_TypeDef parser;
+    BOM_CSVParserInit(&parser, dataset, station, NULL);
 
-        // Conver to uppercase
-        if (isalpha(station->filename[i])) {
-            location[i] = (char) toupper(station->filename[i]);
-        } else {
-            if (station->filename[i] == '_') {
-                location[i] = ' ';
-            } else {
-                location[i] = station->filename[i];
-            }
-        }
+    log_info("Loading %s from .csv file.\n", parser.location);
+
+    char chunk[BOM_CSV_LINE_SIZE * 8];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        BOM_CSVParserFeed(&parser, chunk, n);
     }
+    fclose(file);
 
-    log_info("Loading %s from .csv file.\n", location);
-
-    // Extract location, timestamp, rainfall, max temp, min temp
-    char buffer[500];
-    char loc[BOM_STATION_NAME_SIZE]; // Location name
-    memset(loc, 0, sizeof(loc));
-    char ts[11]; // Timestamp of values
-    char precip_buf[8]; // Daily precipitaion
-    char max_t_buf[8]; // Daily max temperature
-    char min_t_buf[8]; // Daily min temperature
-    char *ptr;
-
-    while (fgets(buffer, sizeof(buffer), file) != NULL) {
-        sscanf(buffer, "%99[^,],%10[^,],%*[^,],%7[^,], "
-                       ",%7[^,],%7[^,],%*[^\n]\n",
-               loc, ts, precip_buf, max_t_buf, min_t_buf);
-
-        // Check if timestamp is correct (then assuming rest is correct...)
-        if (strncmp(loc, location, BOM_STATION_FILENAME_SIZE) == 0) {
-            if (dataset->count < BOM_MAX_RESPONSE_SIZE) {
-                dataset->precipitation[dataset->count] =
-                        strtod(precip_buf, &ptr);
-                dataset->max_temperature[dataset->count] =
-                        strtod(max_t_buf, &ptr);
-                dataset->min_temperature[dataset->count] =
-                        strtod(min_t_buf, &ptr);
-
-                // Timestamp
-                struct tm dt = {0};
-                strptime(ts, "%d/%m/%Y", &dt);
-                // As UNIX time minus one day as values are 9am to 9am on the
-                // day prior
-                time_t unix_time = mktime(&dt) - 86400;
-                dataset->timestamps[dataset->count] = unix_time;
-
-                // As timestamp with timezone of psql
-                char time_str[BOM_TIME_STR_BUFFER_SIZE];
-                strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S%z",
-                         &dt);
-                strncpy(dataset->timestr[dataset->count], time_str,
-                        sizeof(time_str));
-
-                // Debug output
-                log_debug("Location: %s, "
-                          "Date: %s, "
-                          "Rainfall: %0.2f mm, "
-                          "Max Temp: %0.2f C, "
-                          "Min Temp: %0.2f C\n",
-                          loc, ts, dataset->precipitation[dataset->count],
-                          dataset->max_temperature[dataset->count],
-                          dataset->min_temperature[dataset->count]);
-            }
-            dataset->count++;
+    BOM_CSVParserFinish(&parser);
+
+    return 0;
+}
+
+static void BOM_CSVAppend(BOM_CSVParser_TypeDef *parser, const char *data,
+                          size_t size) {
+    size_t space = BOM_CSV_LINE_SIZE - 1 - parser->line_length;
+    if (size > space) {
+        size = space;
+        parser->line_truncated = true;
+    }
+    memcpy(parser->line + parser->line_length, data, size);
+    parser->line_length += size;
+}
+
+/**
+ * Parse a row into the dataset.
+ *
+ * Rows are `location,date,...,rainfall,evaporation,max temp,min temp,...`.
+ * Only rows whose location matches the station are used.
+ *
+ * @param parser Parser holding a complete row.
+ */
+static void BOM_CSVParseRow(BOM_CSVParser_TypeDef *parser) {
+    bool truncated = parser->line_truncated;
+    char *line = parser->line;
+    line[parser->line_length] = '\0';
+    parser->line_length = 0;
+    parser->line_truncated = false;
+    if (truncated) return;
+
+    // Split the first 7 columns in place
+    char *fields[7];
+    uint8_t n_fields = 0;
+    fields[n_fields++] = line;
+    for (char *c = line; *c != '\0' && *c != '\r'; c++) {
+        if (*c == ',') {
+            *c = '\0';
+            if (n_fields == 7) break;
+            fields[n_fields++] = c + 1;
         }
     }
+    if (n_fields < 7) return;
+    fields[6][strcspn(fields[6], "\r")] = '\0';
 
-    if(dataset->count != 0){
-        log_info("BOM dataset successfully parsed and loaded.\n");
-    } else {
-        log_error("BOM dataset could not be loaded.\n");
+    // Check if location is correct (then assuming rest is correct...)
+    if (strcmp(fields[0], parser->location) != 0) return;
+
+    BOM_WeatherDataset_TypeDef *dataset = parser->dataset;
+    if (dataset->count >= BOM_RESPONSE_BUFFER_SIZE) {
+        parser->dropped++;
+        return;
     }
 
-    fclose(file);
+    dataset->precipitation[dataset->count] = strtod(fields[3], NULL);
+    dataset->max_temperature[dataset->count] = strtod(fields[5], NULL);
+    dataset->min_temperature[dataset->count] = strtod(fields[6], NULL);
 
-    return 0;
+    // Timestamp
+    struct tm dt = {0};
+    strptime(fields[1], "%d/%m/%Y", &dt);
+    // As UNIX time minus one day as values are 9am to 9am on the
+    // day prior
+    time_t unix_time = mktime(&dt) - 86400;
+    dataset->timestamps[dataset->count] = unix_time;
+
+    // As timestamp with timezone of psql
+    strftime(dataset->timestr[dataset->count], BOM_TIME_STR_BUFFER_SIZE,
+             "%Y-%m-%d %H:%M:%S%z", &dt);
+
+    // Debug output
+    log_debug("Location: %s, "
+              "Date: %s, "
+              "Rainfall: %0.2f mm, "
+              "Max Temp: %0.2f C, "
+              "Min Temp: %0.2f C\n",
+              fields[0], fields[1], dataset->precipitation[dataset->count],
+              dataset->max_temperature[dataset->count],
+              dataset->min_temperature[dataset->count]);
+
+    dataset->count++;
+}
+
+static void *BOM_CSVArchiveWrite(void *arg) {
+    BOM_CSVArchiveJob_TypeDef *job = (BOM_CSVArchiveJob_TypeDef *) arg;
+
+    FILE *file = fopen(job->path, "wb");
+    if (file == NULL ||
+        fwrite(job->data.memory, 1, job->data.size, file) != job->data.size) {
+        log_error("Unable to write BOM weather data to file: %s\n",
+                  job->path);
+    }
+    if (file != NULL) fclose(file);
+
+    free(job->data.memory);
+    free(job);
+
+    pthread_mutex_lock(&BOM_CSVArchive.lock);
+    if (--BOM_CSVArchive.pending == 0) {
+        pthread_cond_broadcast(&BOM_CSVArchive.idle);
+    }
+    pthread_mutex_unlock(&BOM_CSVArchive.lock);
+
+    return NULL;
 }
 
 /**
@@ -191,82 +476,135 @@ int8_t BOM_LoadWeatherFromCSV(const char *filename,
  *
  * Rows that already exist are overwritten, new rows are added. Need to ensure
  * each dataset and weather station are from the same source. These data are
- * inserted into the weather_bom PostgreSQL table.
+ * inserted into the weather_bom PostgreSQL table with a bulk load.
  *
  * @param weather_station BOM weather station information.
  * @param dataset BOM weather station dataset.
  * @param psql_conn PostgreSQL connection handler.
  */
-void BOM_HistoricalWeatherToDB(BOM_WeatherStation_TypeDef* weather_station,
+void BOM_HistoricalWeatherToDB(const BOM_WeatherStation_TypeDef* weather_station,
                                BOM_WeatherDataset_TypeDef* dataset,
                                PGconn* psql_conn){
 
     log_info("Writing BOM weather data to PostgreSQL.\n");
 
-    // Prepare insert statement using defined types
-    const char* stmt_name = "InsertBOMWeather";
-    Utils_PrepareStatement(psql_conn, stmt_name,
-                           "INSERT INTO weather_bom (last_updated, "
-                           "location, location_id, ts, "
-                           "precipitation, max_temperature, "
-                           "min_temperature) "
-                           "VALUES (NOW(), $1::text, $2::text, $3::timestamptz, "
-                           "$4::float, $5::float, $6::float)"
-                           "ON CONFLICT (ts, location) DO UPDATE "
-                           "SET last_updated = NOW()", 6);
-
-    // Holds values to insert into statement
-    const char* paramValues[6];
-
-    // Buffers for inserting into statement
-    char ts[30];
-    char precip_buf[10];
-    char lat_buf[10];
-    char lng_buf[10];
+    Transaction_Begin(psql_conn, "BOM");
+    Bulk_Load_TypeDef load;
+    if(BOM_BeginWeatherLoad(&load, psql_conn) != 0){
+        Transaction_End(psql_conn);
+        return;
+    }
+    BOM_HistoricalWeatherToBulk(weather_station, dataset, &load);
+    int64_t merged = Bulk_End(&load);
+    Transaction_End(psql_conn);
+    if(merged < 0){
+        log_error("PSQL command failed when entering BOM weather data for "
+                  "%s.\n", weather_station->name);
+        return;
+    }
+
+    log_info("BOM weather data written to PostgreSQL.\n");
+}
+
+/**
+ * Start a bulk load into the weather_bom table.
+ *
+ * Rows are added with BOM_HistoricalWeatherToBulk() and written with
+ * Bulk_End(). Rows that already exist only have last_updated refreshed.
+ *
+ * @param load Bulk load to start.
+ * @param psql_conn PostgreSQL connection handler.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t BOM_BeginWeatherLoad(Bulk_Load_TypeDef* load, PGconn* psql_conn){
+    return Bulk_Begin(load, psql_conn, "bulk_weather_bom",
+                      "location text, location_id text, ts timestamptz, "
+                      "precipitation float8, max_temperature float8, "
+                      "min_temperature float8", 6,
+                      "INSERT INTO weather_bom (last_updated, location, "
+                      "location_id, ts, precipitation, max_temperature, "
+                      "min_temperature) "
+                      "SELECT DISTINCT ON (ts, location) NOW(), location, "
+                      "location_id, ts, precipitation, max_temperature, "
+                      "min_temperature FROM bulk_weather_bom "
+                      "ON CONFLICT (ts, location) DO UPDATE "
+                      "SET last_updated = NOW();");
+}
+
+/**
+ * Add a weather station dataset from the BOM to a bulk load.
+ *
+ * @param weather_station BOM weather station information.
+ * @param dataset BOM weather station dataset.
+ * @param load Bulk load from BOM_BeginWeatherLoad().
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t BOM_HistoricalWeatherToBulk(
+        const BOM_WeatherStation_TypeDef* weather_station,
+        BOM_WeatherDataset_TypeDef* dataset, Bulk_Load_TypeDef* load){
+
+    // Values of each row
+    PGBinary_Params_TypeDef row;
 
     uint16_t index = 0;
     while(index < dataset->count){
-        memset(ts, 0, sizeof(ts));
-        time_t unix_time = dataset->timestamps[index];
-        struct tm ctm = *localtime(&unix_time);
-        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S%z", &ctm);
-
-        paramValues[0] = weather_station->name;
-        paramValues[1] = weather_station->id;
-        paramValues[2] = ts;
-        snprintf(precip_buf, sizeof(precip_buf), "%f",
-                 dataset->precipitation[index]);
-        paramValues[3] = precip_buf;
-        snprintf(lat_buf, sizeof(lat_buf), "%f",
-                 dataset->max_temperature[index]);
-        paramValues[4] = lat_buf;
-        snprintf(lng_buf, sizeof(lng_buf), "%f",
-                 dataset->min_temperature[index]);
-        paramValues[5] = lng_buf;
-
-        PGresult* res = PQexecPrepared(psql_conn, stmt_name, 6,
-                                       paramValues, NULL, NULL, 1);
-        if(PQresultStatus(res) != PGRES_COMMAND_OK){
-            log_error("PSQL command failed when entering BOM weather data for "
-                      "%s. Error: %s\n", weather_station->name,
-                      PQerrorMessage(psql_conn));
+        PGBinary_Reset(&row);
+        PGBinary_AddText(&row, weather_station->name);
+        PGBinary_AddText(&row, weather_station->id);
+        PGBinary_AddTimestamp(&row, dataset->timestamps[index]);
+        PGBinary_AddFloat8(&row, dataset->precipitation[index]);
+        PGBinary_AddFloat8(&row, dataset->max_temperature[index]);
+        PGBinary_AddFloat8(&row, dataset->min_temperature[index]);
+
+        if(Bulk_AddRow(load, &row) != 0){
+            return -1;
         }
-        PQclear(res);
         index++;
     }
 
-    log_info("BOM weather data written to PostgreSQL.\n");
+    return 0;
 }
 
-void BOM_TimeseriesToDB(const char* start_time,
+/**
+ * Build the weather_bom table from a start date until now.
+ *
+ * Every month from the start date is requested for each BOM station in the
+ * harvest_lookup table. All requests are run concurrently (see Fetch_Batch()).
+ * Each dataset is parsed while it downloads and streamed into a single bulk
+ * load (see Bulk_Begin()) as soon as it has arrived. The rows are merged
+ * into weather_bom once every request has completed.
+ *
+ * With BOM_SYNC_INCREMENTAL each station starts from the month of its latest
+ * row in weather_bom (MAX(ts)) instead. Earlier months are final and are
+ * skipped, so a daily run costs one or two requests per station. Stations
+ * with no rows yet start from the start date.
+ *
+ * @code
+ * BOM_TimeseriesToDB("2022-08-01", BOM_SYNC_INCREMENTAL, psql_conn);
+ * @endcode
+ *
+ * @param start_time Start date (e.g. 2022-08-01).
+ * @param sync_mode BOM_SYNC_FULL or BOM_SYNC_INCREMENTAL.
+ * @param psql_conn PostgreSQL connection handler.
+ */
+void BOM_TimeseriesToDB(const char* start_time, uint8_t sync_mode,
                         PGconn* psql_conn){
 
-    BOM_WeatherStations_TypeDef stations;
-    BOM_LoadStationsFromTxt("tmp/bom_weather_stations.txt", &stations);
+    const BOM_WeatherStations_TypeDef* stations =
+            BOM_MapStations(BOM_STATIONS_FILE);
+    if(stations == NULL){
+        return;
+    }
 
-    const char* stmt = "SELECT DISTINCT bom_location_id from harvest_lookup;";
+    // Latest stored row of each station (NULL if none)
+    const char* stmt = (sync_mode == BOM_SYNC_INCREMENTAL) ?
+            "SELECT h.bom_location_id, MAX(w.ts) "
+            "FROM (SELECT DISTINCT bom_location_id FROM harvest_lookup) h "
+            "LEFT JOIN weather_bom w ON w.location_id = h.bom_location_id "
+            "GROUP BY h.bom_location_id;" :
+            "SELECT DISTINCT bom_location_id from harvest_lookup;";
 
-    PGresult* bom_locations = PQexec(psql_conn, stmt);
+    PGresult* bom_locations = PGBinary_Exec(psql_conn, stmt, NULL);
     if(PQresultStatus(bom_locations) != PGRES_TUPLES_OK){
         log_fatal("Error getting BOM location ids from harvest_lookup table: "
                   "%s\n", PQerrorMessage(psql_conn));
@@ -279,39 +617,155 @@ void BOM_TimeseriesToDB(const char* start_time,
     time_t start_unix = mktime(&dt);
     time_t end_unix = time(NULL); // Current time as UNIX timestamp
 
-    const int16_t Q_LEN = 600;
-    while(difftime(end_unix, start_unix) > 0.0){
-        char time_buf[30];
-        strftime(time_buf, sizeof(time_buf), "%Y%m", &dt);
-
-        for(int i = 0; i < PQntuples(bom_locations); i++){
-            const char* bom_location_id = PQgetvalue(bom_locations, i, 0);
-
-            int16_t index = 0;
-            bool location_found = false;
-            for(int16_t x = 0; x < Q_LEN; x++){
-                if(strcmp(bom_location_id, stations.stations[x].id) == 0){
-                    index = x;
-                    location_found = true;
-                    break;
-                }
-            }
+    // Number of months to request for each station (at most)
+    size_t n_months = 0;
+    struct tm month_dt = dt;
+    time_t month_unix = start_unix;
+    while(difftime(end_unix, month_unix) > 0.0){
+        n_months++;
+        month_dt.tm_mon++;
+        month_unix = mktime(&month_dt);
+    }
+
+    size_t max_items = n_months * (size_t)PQntuples(bom_locations);
+    BOM_BatchItem_TypeDef* items = calloc(max_items,
+                                          sizeof(BOM_BatchItem_TypeDef));
+    Fetch_Request_TypeDef* requests = calloc(max_items,
+                                             sizeof(Fetch_Request_TypeDef));
+    if(max_items == 0 || items == NULL || requests == NULL){
+        free(items);
+        free(requests);
+        PQclear(bom_locations);
+        return;
+    }
+
+    Bulk_Load_TypeDef load;
+    size_t n_items = 0;
+    for(int i = 0; i < PQntuples(bom_locations); i++){
+        const char* bom_location_id = PQgetvalue(bom_locations, i, 0);
+
+        int16_t index = BOM_FindStationByID(stations, bom_location_id);
+        if(index < 0){
+            log_error("BOM station (ID: %s) not found in station list.\n",
+                      bom_location_id);
+            continue;
+        }
 
-            if(!location_found){
-                log_error("BOM station (ID: %s) not found in station list.\n",
-                          bom_location_id);
-                continue;
+        // Months before the latest stored row are final
+        month_dt = dt;
+        if(sync_mode == BOM_SYNC_INCREMENTAL &&
+           !PQgetisnull(bom_locations, i, 1)){
+            time_t latest = PGBinary_GetTimestamp(bom_locations, i, 1);
+            struct tm latest_dt = *localtime(&latest);
+            latest_dt.tm_mday = 1;
+            latest_dt.tm_hour = 0;
+            latest_dt.tm_min = 0;
+            latest_dt.tm_sec = 0;
+            latest_dt.tm_isdst = -1;
+            if(difftime(mktime(&latest_dt), start_unix) > 0.0){
+                month_dt = latest_dt;
             }
+        }
 
-            BOM_WeatherDataset_TypeDef bom_dataset = {0};
-            BOM_GetWeather(&bom_dataset, &stations.stations[index], time_buf);
-            BOM_HistoricalWeatherToDB(&stations.stations[index], &bom_dataset,
-                                      psql_conn);
+        month_unix = mktime(&month_dt);
+        while(difftime(end_unix, month_unix) > 0.0 && n_items < max_items){
+            BOM_BatchItem_TypeDef* item = &items[n_items];
+            item->station = &stations->stations[index];
+            strftime(item->year_month, sizeof(item->year_month), "%Y%m",
+                     &month_dt);
+            item->load = &load;
+            BOM_BuildURL(item->station, item->year_month, item->url,
+                         sizeof(item->url));
+
+            requests[n_items].url = item->url;
+            requests[n_items].on_data = BOM_OnWeatherData;
+            requests[n_items].on_complete = BOM_OnWeather;
+            requests[n_items].userdata = item;
+            n_items++;
+
+            month_dt.tm_mon++;
+            month_unix = mktime(&month_dt);
         }
+    }
+
+    if(sync_mode == BOM_SYNC_INCREMENTAL){
+        log_info("Incremental BOM sync: %zu of %zu station months requested."
+                 "\n", n_items, max_items);
+    }
 
-        dt.tm_mon++;
-        start_unix = mktime(&dt);
+    // Every dataset is streamed into one bulk load as it arrives
+    Transaction_Begin(psql_conn, "BOM");
+    if(BOM_BeginWeatherLoad(&load, psql_conn) == 0){
+        Fetch_Batch(requests, n_items, NULL);
+        int64_t merged = Bulk_End(&load);
+        if(merged >= 0){
+            log_info("%lld BOM weather rows written to PostgreSQL.\n",
+                     (long long)merged);
+        }
     }
+    Transaction_End(psql_conn);
 
+    free(requests);
+    free(items);
     PQclear(bom_locations);
 }
+
+/**
+ * Parse a chunk of a monthly dataset while it downloads.
+ *
+ * @param request Request in flight (userdata holds the batch item).
+ * @param data Chunk of the .csv file.
+ * @param size Size of chunk.
+ * @return Number of bytes consumed (0 aborts the transfer).
+ */
+static size_t BOM_OnWeatherData(Fetch_Request_TypeDef *request,
+                                const char *data, size_t size) {
+    BOM_BatchItem_TypeDef *item = request->userdata;
+    if (item->dataset == NULL) {
+        item->dataset = calloc(1, sizeof(BOM_WeatherDataset_TypeDef));
+        if (item->dataset == NULL) {
+            log_error("Not enough memory to hold BOM dataset.\n");
+            return 0;
+        }
+        BOM_CSVParserInit(&item->parser, item->dataset, item->station,
+                          item->year_month);
+    }
+    return BOM_CSVParserFeed(&item->parser, data, size);
+}
+
+/**
+ * Finish parsing a monthly dataset from a batch and write it to PostgreSQL.
+ *
+ * @param request Completed request (userdata holds the batch item).
+ * @param result cURL result of request.
+ * @param response Raw .csv file contents.
+ */
+static void BOM_OnWeather(Fetch_Request_TypeDef *request, CURLcode result,
+                          Utils_ReqData_TypeDef *response) {
+    BOM_BatchItem_TypeDef *item = request->userdata;
+    if (result != CURLE_OK) {
+        log_error("Unable to get %s (%s) dataset from "
+                  "Bureau of Meterology FTP Server.\n",
+                  item->station->name, item->year_month);
+    } else {
+        // Nothing has been streamed if the file was empty or restored from
+        // the cache (parsed again, as the rows it held may have been lost)
+        if (item->dataset == NULL) {
+            BOM_OnWeatherData(request, response->memory, response->size);
+        }
+        if (item->dataset != NULL) {
+            BOM_CSVParserFinish(&item->parser);
+            if (BOM_HistoricalWeatherToBulk(item->station, item->dataset,
+                                            item->load) != 0) {
+                log_error("Unable to add %s (%s) dataset to bulk load.\n",
+                          item->station->name, item->year_month);
+            }
+        }
+    }
+
+    if (item->dataset != NULL) {
+        BOM_CSVParserDiscard(&item->parser);
+        free(item->dataset);
+        item->dataset = NULL;
+    }
+}
@@ -0,0 +1,320 @@
+#include "BOM/station_index.h"
+
+/// State of a nearest neighbour search
+typedef struct {
+    double query[3]; ///< Query point as a unit vector
+    double limit; ///< Squared chord length beyond which nodes are ignored
+    uint16_t max_matches; ///< Max number of matches kept
+    uint16_t n_matches; ///< Number of matches found
+    /// Matches (closest first, distance is the squared chord until the end)
+    BOM_StationMatch_TypeDef* matches;
+} BOM_StationSearch_TypeDef;
+
+/// Convert a latitude and longitude into a unit vector
+static void BOM_StationToPoint(double latitude, double longitude,
+                               double* point);
+
+/// Recursively build the tree over nodes lo to hi (exclusive)
+static void BOM_StationIndexSplit(BOM_StationIndex_TypeDef* index,
+                                  int16_t lo, int16_t hi);
+
+/// Swap two nodes (and their positions)
+static void BOM_StationIndexSwap(BOM_StationIndex_TypeDef* index,
+                                 int16_t a, int16_t b);
+
+/// Recursively search nodes lo to hi (exclusive)
+static void BOM_StationIndexSearch(const BOM_StationIndex_TypeDef* index,
+                                   int16_t lo, int16_t hi,
+                                   BOM_StationSearch_TypeDef* search);
+
+/// Run a search and convert the matches into distances in km
+static uint16_t BOM_StationIndexQuery(const BOM_StationIndex_TypeDef* index,
+                                      double latitude, double longitude,
+                                      double limit, uint16_t max_matches,
+                                      BOM_StationMatch_TypeDef* matches);
+
+/**
+ * Build a spatial index over a list of stations.
+ *
+ * Each station is stored as a point on the unit sphere in a k-d tree. The
+ * straight line (chord) distance between two points on the sphere grows with
+ * the great circle distance between them, so the closest point in the tree is
+ * also the closest station on the earth. Queries visit O(log n) stations
+ * instead of calling Utils_PointsDistance() for every station. The index only
+ * borrows the stations list, which must outlive it.
+ *
+ * @code
+ * BOM_WeatherStations_TypeDef stations;
+ * BOM_LoadStationsFromTxt("tmp/bom_weather_stations.txt", &stations);
+ *
+ * BOM_StationIndex_TypeDef index;
+ * BOM_StationIndexBuild(&index, &stations);
+ *
+ * double distance;
+ * int16_t closest = BOM_StationIndexNearest(&index, -35.9, 150.1, &distance);
+ * @endcode
+ *
+ * @param index Index to build.
+ * @param stations Stations to index.
+ * @return Error code. 0 = OK ... -1 = ERROR (no stations)
+ */
+int8_t BOM_StationIndexBuild(BOM_StationIndex_TypeDef* index,
+                             const BOM_WeatherStations_TypeDef* stations) {
+    index->stations = stations;
+    index->count = stations->count;
+    if (index->count < 0) index->count = 0;
+    if (index->count > BOM_STATION_MAX_RESPONSES) {
+        index->count = BOM_STATION_MAX_RESPONSES;
+    }
+
+    for (int16_t i = 0; i < index->count; i++) {
+        index->nodes[i] = i;
+        BOM_StationToPoint(stations->stations[i].latitude,
+                           stations->stations[i].longitude,
+                           index->points[i]);
+    }
+
+    BOM_StationIndexSplit(index, 0, index->count);
+
+    if (index->count == 0) {
+        log_error("BOM station index is empty.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Find the closest station to a latitude and longitude.
+ *
+ * @param index Index from BOM_StationIndexBuild().
+ * @param latitude Latitude of interest.
+ * @param longitude Longitude of interest.
+ * @param distance Distance to the closest station in km (may be NULL).
+ * @return Index of closest station in the stations list (-1 if none).
+ */
+int16_t BOM_StationIndexNearest(const BOM_StationIndex_TypeDef* index,
+                                double latitude, double longitude,
+                                double* distance) {
+    BOM_StationMatch_TypeDef match;
+    if (BOM_StationIndexQuery(index, latitude, longitude, INFINITY, 1,
+                              &match) == 0) {
+        return -1;
+    }
+
+    if (distance != NULL) {
+        *distance = match.distance;
+    }
+    return match.index;
+}
+
+/**
+ * Find the k closest stations to a latitude and longitude.
+ *
+ * @param index Index from BOM_StationIndexBuild().
+ * @param latitude Latitude of interest.
+ * @param longitude Longitude of interest.
+ * @param k Number of stations to find.
+ * @param matches Matches to populate (at least k, closest first).
+ * @return Number of matches found (less than k if there are fewer stations).
+ */
+uint16_t BOM_StationIndexKNearest(const BOM_StationIndex_TypeDef* index,
+                                  double latitude, double longitude,
+                                  uint16_t k,
+                                  BOM_StationMatch_TypeDef* matches) {
+    return BOM_StationIndexQuery(index, latitude, longitude, INFINITY, k,
+                                 matches);
+}
+
+/**
+ * Find the stations within a radius of a latitude and longitude.
+ *
+ * If more than `max_matches` stations are within the radius only the closest
+ * are returned.
+ *
+ * @param index Index from BOM_StationIndexBuild().
+ * @param latitude Latitude of interest.
+ * @param longitude Longitude of interest.
+ * @param radius Search radius (km).
+ * @param max_matches Max number of matches to return.
+ * @param matches Matches to populate (closest first).
+ * @return Number of matches found.
+ */
+uint16_t BOM_StationIndexWithin(const BOM_StationIndex_TypeDef* index,
+                                double latitude, double longitude,
+                                double radius, uint16_t max_matches,
+                                BOM_StationMatch_TypeDef* matches) {
+    if (radius < 0.0) {
+        return 0;
+    }
+
+    // Chord length of the great circle distance
+    double angle = radius / BOM_STATION_EARTH_RADIUS;
+    double chord = (angle >= M_PI) ? 2.0 : 2.0 * sin(angle / 2.0);
+
+    return BOM_StationIndexQuery(index, latitude, longitude, chord * chord,
+                                 max_matches, matches);
+}
+
+static void BOM_StationToPoint(double latitude, double longitude,
+                               double* point) {
+    double p = M_PI / 180;
+    double cos_lat = cos(latitude * p);
+    point[0] = cos_lat * cos(longitude * p);
+    point[1] = cos_lat * sin(longitude * p);
+    point[2] = sin(latitude * p);
+}
+
+/**
+ * Build the tree over a range of nodes.
+ *
+ * The range is split on the axis with the largest spread. The median node is
+ * moved to the middle of the range (quickselect) and becomes the root of the
+ * range, with the smaller half to its left and the larger half to its right.
+ *
+ * @param index Index being built.
+ * @param lo First node in range.
+ * @param hi One past the last node in range.
+ */
+static void BOM_StationIndexSplit(BOM_StationIndex_TypeDef* index,
+                                  int16_t lo, int16_t hi) {
+    if (hi - lo < 1) {
+        return;
+    }
+
+    double min[3] = {INFINITY, INFINITY, INFINITY};
+    double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (int16_t i = lo; i < hi; i++) {
+        for (uint8_t a = 0; a < 3; a++) {
+            if (index->points[i][a] < min[a]) min[a] = index->points[i][a];
+            if (index->points[i][a] > max[a]) max[a] = index->points[i][a];
+        }
+    }
+    uint8_t axis = 0;
+    for (uint8_t a = 1; a < 3; a++) {
+        if (max[a] - min[a] > max[axis] - min[axis]) axis = a;
+    }
+
+    int16_t mid = (int16_t)(lo + (hi - lo) / 2);
+    int16_t left = lo;
+    int16_t right = (int16_t)(hi - 1);
+    while (left < right) {
+        // Partition around the last node of the range (Lomuto)
+        double pivot = index->points[right][axis];
+        int16_t store = left;
+        for (int16_t i = left; i < right; i++) {
+            if (index->points[i][axis] < pivot) {
+                BOM_StationIndexSwap(index, i, store++);
+            }
+        }
+        BOM_StationIndexSwap(index, store, right);
+
+        if (store == mid) break;
+        if (store < mid) {
+            left = (int16_t)(store + 1);
+        } else {
+            right = (int16_t)(store - 1);
+        }
+    }
+
+    index->axes[mid] = axis;
+    BOM_StationIndexSplit(index, lo, mid);
+    BOM_StationIndexSplit(index, (int16_t)(mid + 1), hi);
+}
+
+static void BOM_StationIndexSwap(BOM_StationIndex_TypeDef* index,
+                                 int16_t a, int16_t b) {
+    if (a == b) {
+        return;
+    }
+
+    int16_t node = index->nodes[a];
+    index->nodes[a] = index->nodes[b];
+    index->nodes[b] = node;
+
+    for (uint8_t i = 0; i < 3; i++) {
+        double value = index->points[a][i];
+        index->points[a][i] = index->points[b][i];
+        index->points[b][i] = value;
+    }
+}
+
+static void BOM_StationIndexSearch(const BOM_StationIndex_TypeDef* index,
+                                   int16_t lo, int16_t hi,
+                                   BOM_StationSearch_TypeDef* search) {
+    if (hi - lo < 1) {
+        return;
+    }
+
+    int16_t mid = (int16_t)(lo + (hi - lo) / 2);
+    const double* point = index->points[mid];
+    double dx = point[0] - search->query[0];
+    double dy = point[1] - search->query[1];
+    double dz = point[2] - search->query[2];
+    double d2 = dx * dx + dy * dy + dz * dz;
+
+    // Keep the closest matches in order (max_matches is small)
+    if (d2 <= search->limit) {
+        uint16_t n = search->n_matches;
+        if (n < search->max_matches) {
+            search->n_matches++;
+        } else {
+            n--;
+        }
+        while (n > 0 && search->matches[n - 1].distance > d2) {
+            search->matches[n] = search->matches[n - 1];
+            n--;
+        }
+        search->matches[n].index = index->nodes[mid];
+        search->matches[n].distance = d2;
+
+        // Nothing further away than the last match is needed
+        if (search->n_matches == search->max_matches) {
+            search->limit = search->matches[search->n_matches - 1].distance;
+        }
+    }
+
+    // Closer half first, the other half only if it can hold a closer node
+    uint8_t axis = index->axes[mid];
+    double diff = search->query[axis] - point[axis];
+    if (diff < 0.0) {
+        BOM_StationIndexSearch(index, lo, mid, search);
+        if (diff * diff <= search->limit) {
+            BOM_StationIndexSearch(index, (int16_t)(mid + 1), hi, search);
+        }
+    } else {
+        BOM_StationIndexSearch(index, (int16_t)(mid + 1), hi, search);
+        if (diff * diff <= search->limit) {
+            BOM_StationIndexSearch(index, lo, mid, search);
+        }
+    }
+}
+
+static uint16_t BOM_StationIndexQuery(const BOM_StationIndex_TypeDef* index,
+                                      double latitude, double longitude,
+                                      double limit, uint16_t max_matches,
+                                      BOM_StationMatch_TypeDef* matches) {
+    if (max_matches == 0) {
+        return 0;
+    }
+
+    BOM_StationSearch_TypeDef search = {
+            .limit = limit,
+            .max_matches = max_matches,
+            .n_matches = 0,
+            .matches = matches
+    };
+    BOM_StationToPoint(latitude, longitude, search.query);
+
+    BOM_StationIndexSearch(index, 0, index->count, &search);
+
+    // Chord length to great circle distance
+    for (uint16_t i = 0; i < search.n_matches; i++) {
+        double half_chord = sqrt(matches[i].distance) / 2.0;
+        if (half_chord > 1.0) half_chord = 1.0;
+        matches[i].distance = 2.0 * BOM_STATION_EARTH_RADIUS *
+                              asin(half_chord);
+    }
+
+    return search.n_matches;
+}
@@ -1,9 +1,28 @@
 #include "BOM/stations.h"
 
+/// Station list mapped from its snapshot
+static struct {
+    pthread_mutex_t lock; ///< Protects the mapping
+    Snapshot_TypeDef snapshot; ///< Mapped snapshot (data is NULL if unmapped)
+    /// Parsed list, only used when the snapshot can't be written
+    BOM_WeatherStations_TypeDef* parsed;
+} BOM_Stations = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
 /// Parse .txt file into a BOM_Stations struct
 static int8_t BOM_ParseStations(Utils_ReqData_TypeDef *stream,
                                 BOM_WeatherStations_TypeDef *stations);
 
+/// Build the id and filename hash tables of a loaded list of stations
+static void BOM_HashStations(BOM_WeatherStations_TypeDef *stations);
+
+/// Hash a station key (32 bit FNV-1a) into a slot
+static uint32_t BOM_HashStationKey(const char *key);
+
+/// Find a station in a hash table (key is the id or filename of a station)
+static int16_t BOM_FindStation(const BOM_WeatherStations_TypeDef *stations,
+                               const int16_t *slots, const char *key,
+                               bool by_id);
+
 /**
  * Get a list of NSW BOM weather station.
  *
@@ -47,7 +66,7 @@ CURLcode BOM_GetWeatherStations(BOM_WeatherStations_TypeDef *stations) {
 static int8_t BOM_ParseStations(Utils_ReqData_TypeDef *stream,
                                 BOM_WeatherStations_TypeDef *stations) {
     MakeDirectory("tmp");
-    const char *filename = "tmp/bom_weather_stations.txt";
+    const char *filename = BOM_STATIONS_FILE;
     FILE *file = fopen(filename, "w");
     if (file != NULL) {
         fputs(stream->memory, file);
@@ -74,6 +93,9 @@ static int8_t BOM_ParseStations(Utils_ReqData_TypeDef *stream,
  * found. E.g. .../filename/filename-date.csv or
  * .../moyura_airport/moyura_airport-202206.csv
  *
+ * The loaded stations are also hashed by id and filename (see
+ * BOM_FindStationByID() and BOM_FindStationByFilename()).
+ *
  * @param filename Location of BOM weather stations .txt file.
  * @param stations Stations object to populate.
  * @return Error status code.
@@ -83,6 +105,10 @@ int8_t BOM_LoadStationsFromTxt(const char *filename,
 
     log_info("Loading BOM weather stations from file: %s\n", filename);
 
+    // Lookups on a list that failed to load find nothing
+    stations->count = 0;
+    BOM_HashStations(stations);
+
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
         log_error("Unable to open BOM weather stations file: %s\n", filename);
@@ -180,7 +206,8 @@ int8_t BOM_LoadStationsFromTxt(const char *filename,
     fclose(file);
 
     // Number of weather stations populated
-    stations->count = --index;
+    stations->count = index;
+    BOM_HashStations(stations);
 
     if (stations->count == 0) {
         log_error("BOM weather stations could not be loaded.\n");
@@ -192,10 +219,99 @@ int8_t BOM_LoadStationsFromTxt(const char *filename,
     return 0;
 }
 
+/**
+ * Map the parsed BOM station list.
+ *
+ * Parsing the .txt station list (BOM_LoadStationsFromTxt()) is done once and
+ * the result, including its id and filename hash tables, is written to a
+ * binary snapshot (BOM_STATIONS_SNAPSHOT). Later calls, in this or any other
+ * process, map the snapshot read-only instead of parsing the .txt file. The
+ * snapshot is rebuilt when the checksum of the .txt file no longer matches
+ * the one it was built from (or the snapshot format changes). If the .txt
+ * file is missing the existing snapshot is used as is.
+ *
+ * The list is shared and stays valid until BOM_UnmapStations().
+ *
+ * @code
+ * const BOM_WeatherStations_TypeDef* stations =
+ *         BOM_MapStations(BOM_STATIONS_FILE);
+ * if (stations != NULL) {
+ *     int16_t index = BOM_FindStationByID(stations, "068228");
+ * }
+ * @endcode
+ *
+ * @param filename Location of BOM weather stations .txt file.
+ * @return Station list (NULL if it could not be loaded).
+ */
+const BOM_WeatherStations_TypeDef* BOM_MapStations(const char *filename) {
+    pthread_mutex_lock(&BOM_Stations.lock);
+
+    const BOM_WeatherStations_TypeDef *stations = BOM_Stations.snapshot.data;
+    if (stations == NULL) {
+        stations = BOM_Stations.parsed;
+    }
+    if (stations != NULL) {
+        pthread_mutex_unlock(&BOM_Stations.lock);
+        return stations;
+    }
+
+    uint64_t source;
+    bool have_source = Snapshot_FileChecksum(filename, &source) == 0;
+    if (Snapshot_Map(&BOM_Stations.snapshot, BOM_STATIONS_SNAPSHOT,
+                     SNAPSHOT_TYPE_STATIONS, have_source ? &source : NULL,
+                     sizeof(BOM_WeatherStations_TypeDef)) == 0) {
+        stations = BOM_Stations.snapshot.data;
+        log_info("%d BOM weather stations mapped from %s\n", stations->count,
+                 BOM_STATIONS_SNAPSHOT);
+        pthread_mutex_unlock(&BOM_Stations.lock);
+        return stations;
+    }
+
+    // Missing or out of date, parse the .txt file and rebuild
+    BOM_WeatherStations_TypeDef *parsed =
+            calloc(1, sizeof(BOM_WeatherStations_TypeDef));
+    if (parsed == NULL || !have_source ||
+        BOM_LoadStationsFromTxt(filename, parsed) != 0) {
+        free(parsed);
+        pthread_mutex_unlock(&BOM_Stations.lock);
+        return NULL;
+    }
+
+    if (Snapshot_Write(BOM_STATIONS_SNAPSHOT, SNAPSHOT_TYPE_STATIONS, source,
+                       parsed, sizeof(BOM_WeatherStations_TypeDef)) == 0 &&
+        Snapshot_Map(&BOM_Stations.snapshot, BOM_STATIONS_SNAPSHOT,
+                     SNAPSHOT_TYPE_STATIONS, &source,
+                     sizeof(BOM_WeatherStations_TypeDef)) == 0) {
+        free(parsed);
+        stations = BOM_Stations.snapshot.data;
+    } else {
+        BOM_Stations.parsed = parsed;
+        stations = parsed;
+    }
+
+    pthread_mutex_unlock(&BOM_Stations.lock);
+    return stations;
+}
+
+/**
+ * Unmap the station list from BOM_MapStations().
+ */
+void BOM_UnmapStations(void) {
+    pthread_mutex_lock(&BOM_Stations.lock);
+    Snapshot_Unmap(&BOM_Stations.snapshot);
+    free(BOM_Stations.parsed);
+    BOM_Stations.parsed = NULL;
+    pthread_mutex_unlock(&BOM_Stations.lock);
+}
+
 /**
  * Gets an index to the closest BOM weather station in reference to a provided
  * latitude and longitude.
  *
+ * Every station is checked (O(n)). Use a station index (see
+ * BOM_StationIndexBuild()) when many locations are matched against the same
+ * list of stations.
+ *
  * @param latitude Latitude of interest.
  * @param longitude Longitude of interest.
  * @param stations List of stations to search through.
@@ -216,7 +332,7 @@ int16_t BOM_ClosestStationIndex(double latitude,
             min_distance = distance;
         }
     }
-    if(min_distance < 40.0){
+    if(min_distance < BOM_STATION_WARN_DISTANCE){
         log_debug("Closest BOM weather station: %s (%0.2lf km)\n",
                   stations->stations[closest_satation_index].name,
                   min_distance);
@@ -228,3 +344,103 @@ int16_t BOM_ClosestStationIndex(double latitude,
 
     return closest_satation_index;
 }
+
+/**
+ * Find a BOM weather station by its id.
+ *
+ * Stations are hashed by id when they are loaded, so this is O(1) rather
+ * than a strcmp() over every station. Only populated stations are searched.
+ *
+ * @code
+ * int16_t index = BOM_FindStationByID(&stations, "068228");
+ * if (index >= 0) {
+ *     log_info("%s\n", stations.stations[index].name);
+ * }
+ * @endcode
+ *
+ * @param stations Stations from BOM_LoadStationsFromTxt().
+ * @param id Station id (e.g. 068228).
+ * @return Index of station in the list (-1 if not found).
+ */
+int16_t BOM_FindStationByID(const BOM_WeatherStations_TypeDef *stations,
+                            const char *id) {
+    return BOM_FindStation(stations, stations->id_slots, id, true);
+}
+
+/**
+ * Find a BOM weather station by its filename.
+ *
+ * @param stations Stations from BOM_LoadStationsFromTxt().
+ * @param filename Station filename (e.g. moruya_airport).
+ * @return Index of station in the list (-1 if not found).
+ */
+int16_t BOM_FindStationByFilename(const BOM_WeatherStations_TypeDef *stations,
+                                  const char *filename) {
+    return BOM_FindStation(stations, stations->filename_slots, filename,
+                           false);
+}
+
+/**
+ * Build the id and filename hash tables (open addressing, linear probing).
+ *
+ * The tables are at least twice the max number of stations, so probe
+ * sequences stay short. When two stations share a key the first is kept.
+ *
+ * @param stations Loaded stations.
+ */
+static void BOM_HashStations(BOM_WeatherStations_TypeDef *stations) {
+    for (uint16_t i = 0; i < BOM_STATION_HASH_SIZE; i++) {
+        stations->id_slots[i] = -1;
+        stations->filename_slots[i] = -1;
+    }
+
+    for (int16_t i = 0; i < stations->count; i++) {
+        const BOM_WeatherStation_TypeDef *station = &stations->stations[i];
+
+        if (BOM_FindStation(stations, stations->id_slots, station->id,
+                            true) < 0) {
+            uint32_t slot = BOM_HashStationKey(station->id);
+            while (stations->id_slots[slot] >= 0) {
+                slot = (slot + 1) & (BOM_STATION_HASH_SIZE - 1);
+            }
+            stations->id_slots[slot] = i;
+        }
+
+        if (BOM_FindStation(stations, stations->filename_slots,
+                            station->filename, false) < 0) {
+            uint32_t slot = BOM_HashStationKey(station->filename);
+            while (stations->filename_slots[slot] >= 0) {
+                slot = (slot + 1) & (BOM_STATION_HASH_SIZE - 1);
+            }
+            stations->filename_slots[slot] = i;
+        }
+    }
+}
+
+static uint32_t BOM_HashStationKey(const char *key) {
+    uint32_t hash = 2166136261U;
+    for (const char *c = key; *c != '\0'; c++) {
+        hash ^= (uint8_t) *c;
+        hash *= 16777619U;
+    }
+    return hash & (BOM_STATION_HASH_SIZE - 1);
+}
+
+static int16_t BOM_FindStation(const BOM_WeatherStations_TypeDef *stations,
+                               const int16_t *slots, const char *key,
+                               bool by_id) {
+    uint32_t slot = BOM_HashStationKey(key);
+    for (uint16_t probe = 0; probe < BOM_STATION_HASH_SIZE; probe++) {
+        int16_t index = slots[slot];
+        if (index < 0 || index >= stations->count) {
+            return -1;
+        }
+
+        const BOM_WeatherStation_TypeDef *station = &stations->stations[index];
+        if (strcmp(by_id ? station->id : station->filename, key) == 0) {
+            return index;
+        }
+        slot = (slot + 1) & (BOM_STATION_HASH_SIZE - 1);
+    }
+    return -1;
+}
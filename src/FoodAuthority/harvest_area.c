@@ -209,7 +209,7 @@ static void FA_FindHTMLValue(char *data, const char *search_term,
 
     int start_substr = 0;
     int value_index = 0;
-    for (unsigned long i = strlen(search_term); i < strlen(clsf) &&
+    for (unsigned long i = strlen(search_term); clsf[i] != '\0' &&
                                                 i < FA_MAX_BUFFER; i++) {
         if (clsf[i] == '>') {
             start_substr = 1;
@@ -1,8 +1,24 @@
 #include "FoodAuthority/harvest_areas.h"
 
-static int8_t FA_ParseListResponse(char *data,
+static int8_t FA_ParseListResponse(char *data, size_t length,
                                    FA_HarvestAreas_TypeDef *harvest_areas);
 
+/// Willy Weather location search for a harvest area program
+typedef struct {
+    const char* program_name; ///< NSW Food Authority program name
+    char url[WW_LOCATION_URL_BUF]; ///< Willy Weather search URL
+    WW_Location_TypeDef location_info; ///< Search result
+    bool found; ///< Search completed successfully
+} FA_LocationSearch_TypeDef;
+
+/// Name to search Willy Weather with for a program
+static const char* FA_WillyWeatherSearchName(const char* program_name);
+
+/// Completion callback for a Willy Weather location search
+static void FA_OnLocationSearch(Fetch_Request_TypeDef* request,
+                                CURLcode result,
+                                Utils_ReqData_TypeDef* response);
+
 /**
  * Request list of harvest areas (and status) from NSW Food Authority.
  *
@@ -34,8 +50,10 @@ CURLcode FA_GetHarvestAreas(FA_HarvestAreas_TypeDef *harvest_areas) {
             cJSON *data = NULL;
             data = cJSON_GetObjectItemCaseSensitive(res, "data");
             if (cJSON_IsString(data) && data->valuestring != NULL) {
-                cJSON_Minify_Mod(data->valuestring); // Remove unessessary chars
-                FA_ParseListResponse(data->valuestring, harvest_areas);
+                // Remove unessessary chars
+                size_t length = cJSON_Minify_Mod(data->valuestring);
+                FA_ParseListResponse(data->valuestring, length,
+                                     harvest_areas);
             } else {
                 log_error("NSW Food Authority request was successful. But"
                           " no data was found.\n");
@@ -60,62 +78,50 @@ CURLcode FA_GetHarvestAreas(FA_HarvestAreas_TypeDef *harvest_areas) {
  * area objects.
  *
  * NSW Food Authority provides data regarding harvest area status as a raw
- * XML endpoint. First the string "-row" is identified as this divides the raw
- * text into each individual harvest areas. Then the '-' in "-row" is replaced
- * with a newline character. This results in each harvest area being put on
- * seperate lines. These data are saved to a file and then read from the same
- * file using fgets() to get results line by line. These lines are then passed
- * individually to FA_ParseResponse() to construct FA_HarvestArea_TypeDef's.
+ * XML endpoint. The string "-row" divides the raw text into each individual
+ * harvest area. Each row is terminated in place (the '-' in "-row" is
+ * replaced with a null character) and passed individually to
+ * FA_ParseResponse() to construct FA_HarvestArea_TypeDef's. The response is
+ * borrowed rather than copied, so the input is modified.
  *
  * @param data Raw XML text from NSW FA JSON request.
+ * @param length Length of data (e.g. returned by cJSON_Minify_Mod()).
  * @param harvest_areas List of harvest areas.
  * @return Integer representing error or ok.
  */
-static int8_t FA_ParseListResponse(char *data,
+static int8_t FA_ParseListResponse(char *data, size_t length,
                                    FA_HarvestAreas_TypeDef *harvest_areas) {
 
     log_info("Parsing JSON response from NSW Food Authority.\n");
 
-    // Match "-row" to divide harvest areas into lines (with '\n')
-    for (size_t i = 0; i < strlen(data) - 5; i++) {
-        if (i > 0) {
-            if (data[i] == '-' && data[i + 1] == 'r' && data[i + 2] == 'o' &&
-                data[i + 3] == 'w') {
-                data[i] = '\n';
+    const char *end = data + length;
+    char *row = data;
+    uint16_t index = 0;
+    while (row < end && index < FA_MAX_NUMBER_HARVEST_AREAS) {
+
+        // Find the start of the next row ("-row")
+        char *next = NULL;
+        for (char *c = row + 1; c + 4 <= end; c++) {
+            c = memchr(c, '-', (size_t)(end - c));
+            if (c == NULL) break;
+            if (c + 4 <= end && c[1] == 'r' && c[2] == 'o' && c[3] == 'w') {
+                next = c;
+                break;
             }
         }
-    }
-
-    // Save raw response to a file
-    MakeDirectory("tmp");
-    FILE *file = fopen("tmp/harvest_areas.txt", "w");
-    if (file == NULL) {
-        log_error("Write error, unable to open file.");
-        return -1;
-    }
-    fputs(data, file);
-    fclose(file);
-
-    // Read raw response from file
-    FILE *read_file = fopen("tmp/harvest_areas.txt", "r");
-    if (read_file == NULL) {
-        log_error("Read error, unable to open file.");
-        return -1;
-    }
-
-    // Construct list of harvest areas
-    char buffer[2000];
-    uint16_t index = 0;
-    while (fgets(buffer, sizeof(buffer), read_file) != NULL &&
-           index < FA_MAX_NUMBER_HARVEST_AREAS) {
+        if (next != NULL) {
+            *next = '\0';
+        }
 
         FA_HarvestArea_TypeDef harvest_area = {0};
-        FA_ParseResponse(buffer, &harvest_area);
+        FA_ParseResponse(row, &harvest_area);
         if (strcmp(harvest_area.name, "N/A") != 0) {
             harvest_areas->harvest_area[index] = harvest_area;
             index++;
-        };
+        }
 
+        if (next == NULL) break;
+        row = next + 1;
     }
 
     // Set count
@@ -127,7 +133,6 @@ static int8_t FA_ParseListResponse(char *data,
         log_error("No harvest areas found. Check request.\n");
     }
 
-    fclose(read_file);
     return 0;
 }
 
@@ -174,45 +179,59 @@ void FA_HarvestAreasToDB(FA_HarvestAreas_TypeDef* harvest_areas,
 
     log_info("Inserting harvest areas status into PostgreSQL database.\n");
 
-    const char* stmt_name = "InsertHarvestArea";
-    Utils_PrepareStatement(psql_conn, stmt_name,
-                           "INSERT INTO harvest_area (last_updated, program_name, "
-                           "location, name, id, classification, status, "
-                           "time_processed, status_reason, status_prev_reason) "
-                           "VALUES (NOW(), $1::text, $2::text, $3::text, "
-                           "$4::int, $5::text, $6::text, $7::timestamptz, "
-                           "$8::text, $9::text)"
-                           "ON CONFLICT (time_processed, id, name, "
-                           "status) DO UPDATE SET last_updated = NOW();", 9);
-    const char* paramValues[9];
-    char id_buf[10];
+    Transaction_Begin(psql_conn, "FA statuses");
+    Bulk_Load_TypeDef load;
+    if(Bulk_Begin(&load, psql_conn, "bulk_harvest_area",
+                  "program_name text, location text, name text, id int, "
+                  "classification text, status text, "
+                  "time_processed text, status_reason text, "
+                  "status_prev_reason text", 9,
+                  "INSERT INTO harvest_area (last_updated, program_name, "
+                  "location, name, id, classification, status, "
+                  "time_processed, status_reason, status_prev_reason) "
+                  "SELECT DISTINCT ON (time_processed::timestamptz, id, name, "
+                  "status) NOW(), program_name, location, name, id, "
+                  "classification, status, time_processed::timestamptz, "
+                  "status_reason, "
+                  "status_prev_reason FROM bulk_harvest_area "
+                  "ON CONFLICT (time_processed, id, name, "
+                  "status) DO UPDATE SET last_updated = NOW();") != 0){
+        Transaction_End(psql_conn);
+        return;
+    }
+    PGBinary_Params_TypeDef row;
 
     int16_t index = 0;
     while(index < harvest_areas->count){
-        FA_HarvestArea_TypeDef ha = harvest_areas->harvest_area[index];
-        paramValues[0] = ha.program_name;
-        paramValues[1] = ha.location;
-        paramValues[2] = ha.name;
-        snprintf(id_buf, sizeof(id_buf), "%d", ha.id);
-        paramValues[3] = id_buf;
-        paramValues[4] = ha.classification;
-        paramValues[5] = ha.status;
-        paramValues[6] = ha.time;
-        paramValues[7] = ha.reason;
-        paramValues[8] = ha.previous_reason;
-
-        PGresult* res = PQexecPrepared(psql_conn, stmt_name, 9, paramValues,
-                                       NULL, NULL, 1);
-
-        if(PQresultStatus(res) != PGRES_COMMAND_OK){
-            log_error("PSQL command failed when entering %s harvest area "
-                      "information. Error: %s\n", ha.name,
-                      PQerrorMessage(psql_conn));
+        const FA_HarvestArea_TypeDef* ha = &harvest_areas->harvest_area[index];
+        PGBinary_Reset(&row);
+        PGBinary_AddText(&row, ha->program_name);
+        PGBinary_AddText(&row, ha->location);
+        PGBinary_AddText(&row, ha->name);
+        PGBinary_AddInt4(&row, ha->id);
+        PGBinary_AddText(&row, ha->classification);
+        PGBinary_AddText(&row, ha->status);
+        // Formatted with its UTC offset, cast by the merge
+        PGBinary_AddText(&row, ha->time);
+        PGBinary_AddText(&row, ha->reason);
+        PGBinary_AddText(&row, ha->previous_reason);
+
+        if(Bulk_AddRow(&load, &row) != 0){
+            log_error("Unable to add %s harvest area information.\n",
+                      ha->name);
+            break;
         }
-        PQclear(res);
         index++;
     }
 
+    int64_t merged = Bulk_End(&load);
+    Transaction_End(psql_conn);
+    if(merged < 0){
+        log_error("PSQL command failed when entering harvest area "
+                  "information.\n");
+        return;
+    }
+
     log_info("Done inserting harvest area statuses into PostgreSQL "
              "database.\n");
 }
@@ -222,7 +241,11 @@ void FA_HarvestAreasToDB(FA_HarvestAreas_TypeDef* harvest_areas,
  *
  * To make it easier to query datasources a lookup table is created using
  * this function that matches a program name to the closest BOM weather
- * station, Willy Weather location and other relevant information.
+ * station, Willy Weather location and other relevant information. The Willy
+ * Weather location searches for each program are run concurrently (see
+ * Fetch_Batch()) and rows are then upserted in program order in one
+ * pipeline (see Utils_PipelineBegin()). A program whose row fails is logged
+ * by name and the others are still written.
  *
  * @note This function requires that the harvest_area table is populated
  * and there is an available bom weather station .txt file available.
@@ -235,128 +258,187 @@ void FA_CreateLocationsLookupDB(PGconn* psql_conn){
 
     log_info("Writing locations lookup to PostgreSQL database\n");
 
-    BOM_WeatherStations_TypeDef stations;
-    BOM_LoadStationsFromTxt("tmp/bom_weather_stations.txt", &stations);
+    const BOM_WeatherStations_TypeDef* stations =
+            BOM_MapStations(BOM_STATIONS_FILE);
+    if(stations == NULL){
+        return;
+    }
+
+    // Built once, each program is then matched without a linear scan
+    BOM_StationIndex_TypeDef station_index;
+    if(BOM_StationIndexBuild(&station_index, stations) != 0){
+        return;
+    }
 
     const char* query = "SELECT DISTINCT program_name FROM harvest_area;";
 
-    const char* stmt_name = "InsertHarvestLookup";
-    Utils_PrepareStatement(psql_conn, stmt_name,
-                           "INSERT INTO harvest_lookup (last_updated, "
-                           "fa_program_name, ww_location, ww_location_id, "
-                           "ww_latitude, ww_longitude, bom_location, "
-                           "bom_location_id, bom_latitude, bom_longitude, "
-                           "bom_distance) VALUES (NOW(), $1::text, $2::text, "
-                           "$3::int, $4::float, $5::float, $6::text, $7::text, "
-                           "$8::float, $9::float, $10::float) "
-                           "ON CONFLICT (fa_program_name) DO UPDATE SET "
-                           "last_updated = NOW();", 10);
-    const char* param_values[10];
-
-    char id_buf[10];
-    char lat_buf[10];
-    char lng_buf[10];
-    char slat_buf[10];
-    char slng_buf[10];
-    char distance_buf[10];
+    PGBinary_Params_TypeDef row;
 
     PGresult* res = PQexec(psql_conn, query);
-    uint16_t index = 0;
-    if(PQresultStatus(res) == PGRES_TUPLES_OK){
-        int num_fields = PQnfields(res);
-        for(int i = 0; i < PQntuples(res); i++){
-            for(int j = 0; j < num_fields; j++){
-                char* location_name = PQgetvalue(res, i , j);
-                WW_Location_TypeDef location_info = {0};
-                if(strcmp(location_name, "Wapengo Lake") == 0){
-                    char new_name[8] = "Wapengo";
-                    WillyWeather_GetLocationByName(new_name, &location_info);
-                }
-                else if(strcmp(location_name, "Bellinger and Kalang "
-                                              "Rivers") == 0){
-                    char new_name[10] = "Bellinger";
-                    WillyWeather_GetLocationByName(new_name, &location_info);
-                }
-                else if(strcmp(location_name, "Shoalhaven - "
-                                              "Crookhaven Rivers") == 0){
-                    char new_name[20] = "Crookhaven River";
-                    WillyWeather_GetLocationByName(new_name, &location_info);
-                }
-                else{
-                    WillyWeather_GetLocationByName(location_name,
-                                                   &location_info);
-                }
-
-                int16_t cws = BOM_ClosestStationIndex(location_info.latitude,
-                                                      location_info.longitude,
-                                                      &stations);
-
-                double distance =
-                        Utils_PointsDistance(location_info.latitude,
-                                             location_info.longitude,
-                                             stations.stations[cws].latitude,
-                                             stations.stations[cws].longitude);
-
-                log_debug("%s\t Willy Weather: %s\t BOM: %s\t "
-                          "Distance: %0.2lf\n", location_name,
-                          location_info.location, stations.stations[cws].name,
-                          distance);
-
-                param_values[0] = location_name;
-                param_values[1] = location_info.location;
-
-                snprintf(id_buf, sizeof(id_buf), "%d", location_info.id);
-                param_values[2] = id_buf;
-
-                snprintf(lat_buf, sizeof(lat_buf), "%f",
-                         location_info.latitude);
-                param_values[3] = lat_buf;
-
-                snprintf(lng_buf, sizeof(lng_buf), "%f",
-                         location_info.longitude);
-                param_values[4] = lng_buf;
-
-                param_values[5] = stations.stations[cws].name;
-                param_values[6] = stations.stations[cws].id;
-
-                snprintf(slat_buf, sizeof(slat_buf), "%f",
-                         stations.stations[cws].latitude);
-                param_values[7] = slat_buf;
-
-                snprintf(slng_buf, sizeof(slng_buf), "%f",
-                         stations.stations[cws].longitude);
-                param_values[8] = slng_buf;
-
-                snprintf(distance_buf, sizeof(distance_buf), "%f", distance);
-                param_values[9] = distance_buf;
-
-                // Execute prepared statment
-                PGresult* i_res = PQexecPrepared(psql_conn, stmt_name,
-                                                 10, param_values, NULL,
-                                                 NULL, 1);
-
-                if(PQresultStatus(i_res) != PGRES_COMMAND_OK){
-                    log_error("PSQL command failed when entering station "
-                              "information for %s. Error: %s\n", location_name,
-                              PQerrorMessage(psql_conn));
-                }
-
-                PQclear(i_res);
-
-                index++;
-
-                if(index > WW_MAX_NUM_LOCATONS){
-                    break;
-                }
-            }
+    if(PQresultStatus(res) != PGRES_TUPLES_OK){
+        log_error("Unable to get program names from harvest_area table. "
+                  "Error: %s\n", PQerrorMessage(psql_conn));
+        PQclear(res);
+        return;
+    }
+
+    if(WillyWeather_CheckAccess() == 1){
+        PQclear(res);
+        return;
+    }
+
+    int n_programs = PQntuples(res);
+    if(n_programs > WW_MAX_NUM_LOCATONS){
+        n_programs = WW_MAX_NUM_LOCATONS;
+    }
+
+    // One Willy Weather location search per program (run concurrently)
+    FA_LocationSearch_TypeDef* searches =
+            calloc((size_t)n_programs, sizeof(FA_LocationSearch_TypeDef));
+    Fetch_Request_TypeDef* requests =
+            calloc((size_t)n_programs, sizeof(Fetch_Request_TypeDef));
+    if(searches == NULL || requests == NULL){
+        log_error("Not enough memory to hold location searches.\n");
+        free(searches);
+        free(requests);
+        PQclear(res);
+        return;
+    }
+
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+
+    for(int i = 0; i < n_programs; i++){
+        searches[i].program_name = PQgetvalue(res, i, 0);
+        WillyWeather_BuildLocationURL(
+                FA_WillyWeatherSearchName(searches[i].program_name),
+                searches[i].url, sizeof(searches[i].url));
+
+        requests[i].url = searches[i].url;
+        requests[i].headers = headers;
+        requests[i].on_complete = FA_OnLocationSearch;
+        requests[i].userdata = &searches[i];
+    }
+
+    Fetch_Batch(requests, (size_t)n_programs, NULL);
+
+    Utils_Pipeline_TypeDef pipeline;
+    if(Statements_Prepare(psql_conn) != 0 ||
+       Utils_PipelineBegin(&pipeline, psql_conn) != 0){
+        curl_slist_free_all(headers);
+        free(requests);
+        free(searches);
+        PQclear(res);
+        return;
+    }
+
+    for(int i = 0; i < n_programs; i++){
+        const char* location_name = searches[i].program_name;
+        WW_Location_TypeDef location_info = searches[i].location_info;
+        if(!searches[i].found){
+            log_error("Willy Weather location not found for %s. "
+                      "Skipping.\n", location_name);
+            continue;
         }
+
+        double distance = 0;
+        int16_t cws = BOM_StationIndexNearest(&station_index,
+                                              location_info.latitude,
+                                              location_info.longitude,
+                                              &distance);
+        if(distance >= BOM_STATION_WARN_DISTANCE){
+            log_warn("Closest BOM weather station is %0.2lf km away from "
+                     "%s. Weather may not be accurate.\n", distance,
+                     location_name);
+        }
+
+        log_debug("%s\t Willy Weather: %s\t BOM: %s\t "
+                  "Distance: %0.2lf\n", location_name,
+                  location_info.location, stations->stations[cws].name,
+                  distance);
+
+        PGBinary_Reset(&row);
+        PGBinary_AddText(&row, location_name);
+        PGBinary_AddText(&row, location_info.location);
+        PGBinary_AddInt4(&row, location_info.id);
+        PGBinary_AddFloat8(&row, location_info.latitude);
+        PGBinary_AddFloat8(&row, location_info.longitude);
+        PGBinary_AddText(&row, stations->stations[cws].name);
+        PGBinary_AddText(&row, stations->stations[cws].id);
+        PGBinary_AddFloat8(&row, stations->stations[cws].latitude);
+        PGBinary_AddFloat8(&row, stations->stations[cws].longitude);
+        PGBinary_AddFloat8(&row, distance);
+
+        // A failed row is logged with the program name
+        if(Utils_PipelineExecPrepared(&pipeline, "UpsertHarvestLookup", &row,
+                                      location_name) != 0){
+            break;
+        }
+    }
+
+    if(Utils_PipelineEnd(&pipeline) > 0){
+        log_error("PSQL command failed when entering station "
+                  "information.\n");
     }
 
+    curl_slist_free_all(headers);
+    free(requests);
+    free(searches);
+
     log_info("Harvest area location lookups written to PostgreSQL database\n");
 
+    // The lookup table has changed, FA_UniqueLocations() reloads it
+    Snapshot_Remove(FA_LOCATIONS_SNAPSHOT);
+
     PQclear(res);
 }
 
+/**
+ * Get the name to search Willy Weather with for a harvest area program.
+ *
+ * Some program names do not return a (correct) result from Willy Weather so
+ * these are replaced with a simpler name.
+ *
+ * @param program_name NSW Food Authority program name.
+ * @return Name to search Willy Weather with.
+ */
+static const char* FA_WillyWeatherSearchName(const char* program_name){
+    if(strcmp(program_name, "Wapengo Lake") == 0){
+        return "Wapengo";
+    }
+    if(strcmp(program_name, "Bellinger and Kalang Rivers") == 0){
+        return "Bellinger";
+    }
+    if(strcmp(program_name, "Shoalhaven - Crookhaven Rivers") == 0){
+        return "Crookhaven River";
+    }
+    return program_name;
+}
+
+/**
+ * Parse a Willy Weather location search once it has completed.
+ *
+ * @param request Completed request (userdata holds the location search).
+ * @param result cURL result of request.
+ * @param response Raw JSON response.
+ */
+static void FA_OnLocationSearch(Fetch_Request_TypeDef* request,
+                                CURLcode result,
+                                Utils_ReqData_TypeDef* response){
+    FA_LocationSearch_TypeDef* search = request->userdata;
+    if(result != CURLE_OK){
+        log_error("Willy Weather location search failed for %s.\n",
+                  search->program_name);
+        return;
+    }
+
+    cJSON* json = cJSON_ParseWithLength(response->memory,
+                                        response->size);
+    WillyWeather_ParseLocation(json, &search->location_info);
+    search->found = (json != NULL);
+    cJSON_Delete(json);
+}
+
 /**
  * Load unique locations from lookup table in PostgreSQL database.
  *
@@ -371,83 +453,69 @@ void FA_CreateLocationsLookupDB(PGconn* psql_conn){
 void FA_UniqueLocationsFromDB(T_LocationsLookup_TypeDef* locations,
                               PGconn* psql_conn){
 
-    log_info("Getting unique oyster farming regions from PostgreSQL DB.\n",
-             locations->count);
+    log_info("Getting unique oyster farming regions from PostgreSQL DB.\n");
+    locations->count = 0;
+
+    // Identifiers are kept as text, coordinates are read in binary
+    const char* query = "SELECT last_updated::text, fa_program_name, "
+                        "fa_program_id::text, ww_location, "
+                        "ww_location_id::text, ww_latitude::float8, "
+                        "ww_longitude::float8, bom_location, bom_location_id, "
+                        "bom_latitude::float8, bom_longitude::float8, "
+                        "bom_distance::float8 FROM harvest_lookup;";
+    PGresult* res = PGBinary_Exec(psql_conn, query, NULL);
+
+    // Every column decoded in one pass, then copied into each location
+    Arena_TypeDef arena;
+    Arena_Init(&arena);
+    PGBinary_Column_TypeDef columns[12] = {
+            {.type = PG_BINARY_COLUMN_STRING}, // last_updated
+            {.type = PG_BINARY_COLUMN_STRING}, // fa_program_name
+            {.type = PG_BINARY_COLUMN_STRING}, // fa_program_id
+            {.type = PG_BINARY_COLUMN_STRING}, // ww_location
+            {.type = PG_BINARY_COLUMN_STRING}, // ww_location_id
+            {.type = PG_BINARY_COLUMN_FLOAT}, // ww_latitude
+            {.type = PG_BINARY_COLUMN_FLOAT}, // ww_longitude
+            {.type = PG_BINARY_COLUMN_STRING}, // bom_location
+            {.type = PG_BINARY_COLUMN_STRING}, // bom_location_id
+            {.type = PG_BINARY_COLUMN_FLOAT}, // bom_latitude
+            {.type = PG_BINARY_COLUMN_FLOAT}, // bom_longitude
+            {.type = PG_BINARY_COLUMN_FLOAT} // bom_distance
+    };
+    int n_rows = PGBinary_DecodeColumns(res, columns, 12, &arena);
+    PQclear(res);
 
-    const char* query = "SELECT last_updated, fa_program_name, fa_program_id, "
-                        "ww_location, ww_location_id, ww_latitude, "
-                        "ww_longitude, bom_location, bom_location_id, "
-                        "bom_latitude, bom_longitude, bom_distance "
-                        "FROM harvest_lookup;";
-    PGresult* res = PQexec(psql_conn, query);
+    if(n_rows > T_MAX_N_LOCATIONS){
+        log_error("Max locations allocation exceeded. Exiting.\n");
+        n_rows = T_MAX_N_LOCATIONS;
+    }
 
-    if(PQresultStatus(res) == PGRES_TUPLES_OK){
-        int num_fields = PQnfields(res);
-        int i = 0;
-        for(; i < PQntuples(res); i++){
-            if(i > T_MAX_N_LOCATIONS){
-                log_error("Max locations allocation exceeded. Exiting.\n");
-                break;
-            }
-            for(int j = 0; j < num_fields; j++){
-                char* ptr;
-                switch(j){
-                    case 0:
-                        strncpy(locations->locations[i].last_updated,
-                                PQgetvalue(res, i, j), T_TIMESTAMP_SIZE);
-                        break;
-                    case 1:
-                        strncpy(locations->locations[i].fa_program_name,
-                                PQgetvalue(res, i, j), FA_MAX_BUFFER);
-                        break;
-                    case 2:
-                        strncpy(locations->locations[i].fa_program_id,
-                                PQgetvalue(res, i, j), FA_MAX_BUFFER);
-                        break;
-                    case 3:
-                        strncpy(locations->locations[i].ww_location,
-                                PQgetvalue(res, i, j), WW_LOCATION_BUF);
-                        break;
-                    case 4:
-                        strncpy(locations->locations[i].ww_location_id,
-                                PQgetvalue(res, i, j), WW_LOCATION_BUF);
-                        break;
-                    case 5:
-                        locations->locations[i].ww_latitude =
-                                strtof(PQgetvalue(res, i, j), &ptr);
-                        break;
-                    case 6:
-                        locations->locations[i].ww_longitude =
-                                strtof(PQgetvalue(res, i, j), &ptr);
-                        break;
-                    case 7:
-                        strncpy(locations->locations[i].bom_location,
-                                PQgetvalue(res, i, j), BOM_STATION_NAME_SIZE);
-                        break;
-                    case 8:
-                        strncpy(locations->locations[i].bom_location_id,
-                                PQgetvalue(res, i, j), BOM_STATION_ID_SIZE);
-                        break;
-                    case 9:
-                        locations->locations[i].bom_latitude =
-                                strtof(PQgetvalue(res, i, j), &ptr);
-                        break;
-                    case 10:
-                        locations->locations[i].bom_longitude =
-                                strtof(PQgetvalue(res, i, j), &ptr);
-                        break;
-                    case 11:
-                        locations->locations[i].bom_distance =
-                                strtof(PQgetvalue(res, i, j), &ptr);
-                        break;
-                    default:
-                        log_error("Unknown data field received.\n");
-                        break;
-                }
-            }
-        }
-        locations->count = (uint16_t)i;
+    for(int i = 0; i < n_rows; i++){
+        T_LocationLookup_TypeDef* loc = &locations->locations[i];
+        snprintf(loc->last_updated, sizeof(loc->last_updated), "%s",
+                 columns[0].strings[i]);
+        snprintf(loc->fa_program_name, sizeof(loc->fa_program_name), "%s",
+                 columns[1].strings[i]);
+        snprintf(loc->fa_program_id, sizeof(loc->fa_program_id), "%s",
+                 columns[2].strings[i]);
+        snprintf(loc->ww_location, sizeof(loc->ww_location), "%s",
+                 columns[3].strings[i]);
+        snprintf(loc->ww_location_id, sizeof(loc->ww_location_id), "%s",
+                 columns[4].strings[i]);
+        loc->ww_latitude = columns[5].floats[i];
+        loc->ww_longitude = columns[6].floats[i];
+        snprintf(loc->bom_location, sizeof(loc->bom_location), "%s",
+                 columns[7].strings[i]);
+        snprintf(loc->bom_location_id, sizeof(loc->bom_location_id), "%s",
+                 columns[8].strings[i]);
+        loc->bom_latitude = columns[9].floats[i];
+        loc->bom_longitude = columns[10].floats[i];
+        loc->bom_distance = columns[11].floats[i];
+    }
+    if(n_rows > 0){
+        locations->count = (uint16_t)n_rows;
     }
+    Arena_Free(&arena);
 
     if(locations->count == 0){
         log_error("No locations found in harvest_lookup table.\n");
@@ -455,6 +523,47 @@ void FA_UniqueLocationsFromDB(T_LocationsLookup_TypeDef* locations,
         log_info("Got %d unique oyster farming regions from PostgreSQL DB.\n",
                  locations->count);
     }
+}
 
-    PQclear(res);
+/**
+ * Load unique locations from a snapshot of the lookup table.
+ *
+ * The lookup table is read from PostgreSQL (FA_UniqueLocationsFromDB()) once
+ * and kept as a binary snapshot (FA_LOCATIONS_SNAPSHOT). Later runs, and
+ * other processes, copy the locations from the mapped snapshot instead. The
+ * snapshot is rebuilt after FA_CreateLocationsLookupDB() rewrites the lookup
+ * table or when the BOM station list it was matched against changes.
+ *
+ * @code
+ * T_LocationsLookup_TypeDef locations;
+ * FA_UniqueLocations(&locations, psql_conn);
+ * @endcode
+ *
+ * @param locations Lookup table locations to populate.
+ * @param psql_conn PostgreSQL database connection.
+ */
+void FA_UniqueLocations(T_LocationsLookup_TypeDef* locations,
+                        PGconn* psql_conn){
+
+    uint64_t source;
+    bool have_source = Snapshot_FileChecksum(BOM_STATIONS_FILE, &source) == 0;
+
+    Snapshot_TypeDef snapshot;
+    if(Snapshot_Map(&snapshot, FA_LOCATIONS_SNAPSHOT, SNAPSHOT_TYPE_LOCATIONS,
+                    have_source ? &source : NULL,
+                    sizeof(T_LocationsLookup_TypeDef)) == 0){
+        memcpy(locations, snapshot.data, sizeof(T_LocationsLookup_TypeDef));
+        Snapshot_Unmap(&snapshot);
+        log_info("Got %d unique oyster farming regions from %s\n",
+                 locations->count, FA_LOCATIONS_SNAPSHOT);
+        return;
+    }
+
+    memset(locations, 0, sizeof(T_LocationsLookup_TypeDef));
+    FA_UniqueLocationsFromDB(locations, psql_conn);
+    if(locations->count > 0){
+        Snapshot_Write(FA_LOCATIONS_SNAPSHOT, SNAPSHOT_TYPE_LOCATIONS,
+                       have_source ? source : 0, locations,
+                       sizeof(T_LocationsLookup_TypeDef));
+    }
 }
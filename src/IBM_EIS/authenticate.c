@@ -36,7 +36,12 @@ int8_t IBM_HandleAuth(IBM_AuthHandle_TypeDef *auth_handle) {
     }
 
     const char *api_key = getenv(IBM_DEFAULT_TOKEN_NAME);
+    // Recorded responses don't need a real key (see transport.h)
+    if (api_key == NULL && Transport_Mode() == TRANSPORT_REPLAY) {
+        api_key = TRANSPORT_REPLAY_SECRET;
+    }
     if (api_key != NULL) {
+        Transport_AddSecret(api_key); // Sent in the request body
         if (IBM_Authenticate(api_key, auth_handle) == CURLE_OK) {
             return 0;
         }
@@ -100,6 +105,8 @@ CURLcode IBM_Authenticate(const char *token,
             j_refresh_token->valuestring != NULL) {
             strncpy(auth_handle->refresh_token, j_refresh_token->valuestring,
                     IBM_REFRESH_TOKEN_SIZE);
+            // Sent in the body of IBM_Refresh() (recorded as a placeholder)
+            Transport_AddSecret(auth_handle->refresh_token);
         }
     } else {
         result = CURLE_RECV_ERROR;
@@ -14,6 +14,33 @@ static void IBM_BuildURL(IBM_TimeseriesReq_TypeDef *req, char *url);
 /// Build IBM EIS request URL for alternative endpoint
 static void IBM_BuildURLAlt(IBM_TimeseriesReq_TypeDef *req, char *url);
 
+/// Build IBM EIS request headers (including authorisation)
+static struct curl_slist* IBM_BuildHeaders(IBM_AuthHandle_TypeDef *auth_handle);
+
+/// Timeseries request for a location in a batch of requests
+typedef struct {
+    IBM_TimeseriesReq_TypeDef request; ///< Request information
+    T_LocationLookup_TypeDef* location; ///< Location being requested
+    char url[IBM_URL_SIZE]; ///< Request URL
+    char alt_url[IBM_URL_SIZE]; ///< Hedged request URL (other endpoint)
+    uint8_t alt_flag; ///< Endpoint which answered (alternative = 1)
+    IBM_TimeseriesDataset_TypeDef* dataset; ///< Dataset to populate (or NULL)
+    PGconn* psql_conn; ///< PostgreSQL connection to write results with
+} IBM_BatchItem_TypeDef;
+
+/// Layer ID on the primary endpoint of a layer on the alternative endpoint
+static uint16_t IBM_PrimaryLayerID(uint16_t layer_id);
+
+/// Build the URLs of a hedged request (alternative and primary endpoint)
+static void IBM_SetupHedge(IBM_BatchItem_TypeDef* item,
+                           Fetch_Request_TypeDef* fetch_request,
+                           struct curl_slist* headers);
+
+/// Completion callback for a timeseries request in a batch
+static void IBM_OnTimeseries(Fetch_Request_TypeDef *fetch_request,
+                             CURLcode result,
+                             Utils_ReqData_TypeDef *response);
+
 /**
  * IBM EIS get timeseries data as a JSON response.
  *
@@ -39,12 +66,19 @@ static void IBM_BuildURLAlt(IBM_TimeseriesReq_TypeDef *req, char *url);
  *  IBM_GetTimeseries(auth_handle, &ts, &dataset, 0); // or 1 (for alt URL)
  * @endcode
  *
+ * With alt_flag = IBM_ENDPOINT_HEDGED the layer ID must be the alternative
+ * endpoint ID (e.g. 49097). The request is sent to whichever endpoint has
+ * answered fastest recently and hedged to the other one if it is slow (see
+ * Fetch_Batch()). Layers without an equivalent on the primary endpoint only
+ * use the alternative endpoint.
+ *
  * @note Start and end times are represented as UNIX timestamps (in seconds).
  *
  * @param auth_handle IBM authentication handler
  * @param request Request struct with corresponding data.
  * @param dataset The dataset to populate.
- * @param alt_flag A flag representing if the alt enpoint should be used.
+ * @param alt_flag A flag representing if the alt enpoint should be used
+ * (IBM_ENDPOINT_PRIMARY, IBM_ENDPOINT_ALT or IBM_ENDPOINT_HEDGED).
  * @return Curl success code.
  */
 CURLcode IBM_GetTimeseries(IBM_AuthHandle_TypeDef *auth_handle,
@@ -56,6 +90,27 @@ CURLcode IBM_GetTimeseries(IBM_AuthHandle_TypeDef *auth_handle,
         return CURLE_AUTH_ERROR;
     }
 
+    if (alt_flag == IBM_ENDPOINT_HEDGED) {
+        IBM_BatchItem_TypeDef item = {
+                .request = *request,
+                .dataset = dataset
+        };
+        Fetch_Request_TypeDef fetch_request = {
+                .on_complete = IBM_OnTimeseries,
+                .userdata = &item
+        };
+        struct curl_slist *headers = IBM_BuildHeaders(auth_handle);
+        IBM_SetupHedge(&item, &fetch_request, headers);
+
+        dataset->count = 0;
+        CURLcode result = CURLE_FAILED_INIT;
+        if (Fetch_Batch(&fetch_request, 1, NULL) == 0) {
+            result = (dataset->count > 0) ? CURLE_OK : CURLE_GOT_NOTHING;
+        }
+        curl_slist_free_all(headers);
+        return result;
+    }
+
     char url[IBM_URL_SIZE];
     if (alt_flag == 1) {
         IBM_BuildURLAlt(request, url);
@@ -66,17 +121,7 @@ CURLcode IBM_GetTimeseries(IBM_AuthHandle_TypeDef *auth_handle,
     log_info("Getting IBM EIS layer (ID: %d) : %s\n",
              request->layer_id, url);
 
-    // Authorization builder
-    const char *BASE_HEADER = "Authorization: Bearer ";
-    char *auth_header = (char*)malloc(strlen(BASE_HEADER) +
-                               strlen(auth_handle->access_token) + 1);
-    strcpy(auth_header, BASE_HEADER);
-    strcat(auth_header, auth_handle->access_token);
-
-    // Add headers
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, auth_header);
-    headers = curl_slist_append(headers, "accept: application/json");
+    struct curl_slist *headers = IBM_BuildHeaders(auth_handle);
 
     cJSON *response = NULL;
     CURLcode result = HttpRequest(&response, url, headers, 0, NULL);
@@ -92,7 +137,6 @@ CURLcode IBM_GetTimeseries(IBM_AuthHandle_TypeDef *auth_handle,
                   "IBM EIS timeseries dataset.\n");
     }
 
-    free(auth_header);
     curl_slist_free_all(headers);
     cJSON_Delete(response);
 
@@ -103,6 +147,30 @@ CURLcode IBM_GetTimeseries(IBM_AuthHandle_TypeDef *auth_handle,
     return result;
 }
 
+/**
+ * Build the headers required for an IBM EIS timeseries request.
+ *
+ * @param auth_handle IBM authentication handler (must be authenticated).
+ * @return Header list. Free with curl_slist_free_all().
+ */
+static struct curl_slist* IBM_BuildHeaders(IBM_AuthHandle_TypeDef *auth_handle) {
+
+    // Authorization builder
+    const char *BASE_HEADER = "Authorization: Bearer ";
+    char *auth_header = (char*)malloc(strlen(BASE_HEADER) +
+                               strlen(auth_handle->access_token) + 1);
+    strcpy(auth_header, BASE_HEADER);
+    strcat(auth_header, auth_handle->access_token);
+
+    // Add headers (curl_slist_append() copies the header)
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, auth_header);
+    headers = curl_slist_append(headers, "accept: application/json");
+
+    free(auth_header);
+    return headers;
+}
+
 /**
  * Parse timeseries data from IBM URL response.
  *
@@ -425,104 +493,85 @@ void IBM_TimeseriesToDB(IBM_TimeseriesReq_TypeDef* req_info,
 
     log_info("Inserting IBM query results into PostgreSQL database.\n");
 
-    const char* stmt = "INSERT INTO weather_ibm_eis (last_updated, "
-                       "location, ww_location_id, bom_location_id, "
-                       "latitude, longitude, ts, %s) "
-                       "VALUES (NOW(), $1::text, $2::text, $3::text, "
-                       "$4::float, $5::float, $6::timestamptz, $7::float) "
-                       "ON CONFLICT (ts, ww_location_id, bom_location_id) "
-                       "DO UPDATE SET last_updated = NOW()%s;";
-
-    const char* clm_names[3] = {"precipitation", "min_temperature",
-                                "max_temperature"};
-
-    const char* update_stmts[3] = {", precipitation = $8::float",
-                                   ", min_temperature = $8::float",
-                                   ", max_temperature = $8::float"};
-
-    const char* stmt_names[3] = {"InsertIBMPrecipitation", "InsertIBMTempMin",
-                                 "InsertIBMTempMax"};
-
-    char stmt_buf[500];
-    for(int8_t i = 0; i < 3; i++){
-        memset(stmt_buf, 0, sizeof(stmt_buf));
-        snprintf(stmt_buf, sizeof(stmt_buf), stmt, clm_names[i],
-                 update_stmts[i]);
-
-        PGresult* p_info = PQdescribePrepared(psql_conn, stmt_names[i]);
-        if(PQresultStatus(p_info) != PGRES_COMMAND_OK){
-            PGresult* p_res;
-            if(i != 0){
-                p_res = PQprepare(psql_conn, stmt_names[i], stmt_buf, 7, NULL);
-            } else {
-                p_res = PQprepare(psql_conn, stmt_names[i], stmt_buf, 8, NULL);
-            }
-            if(PQresultStatus(p_res) != PGRES_COMMAND_OK){
-                log_warn("PostgreSQL prepare error: %s\n",
-                         PQerrorMessage(psql_conn));
-            }
-            PQclear(p_res);
-        }
-        PQclear(p_info);
+    const char* column;
+    switch(req_info->layer_id){
+        case IBM_PRECIPITATION_ID:
+            column = "precipitation";
+            break;
+        case IBM_MIN_TEMPERATURE_ID:
+            column = "min_temperature";
+            break;
+        case IBM_MAX_TEMPERATURE_ID:
+            column = "max_temperature";
+            break;
+        default:
+            log_error("Unknown IBM dataset query results. Unable to insert"
+                      "into PostgreSQL database.\n");
+            return;
+    }
+
+    // Only the column of this layer is set (or updated)
+    char merge[BULK_STMT_SIZE];
+    snprintf(merge, sizeof(merge),
+             "INSERT INTO weather_ibm_eis (last_updated, location, "
+             "ww_location_id, bom_location_id, latitude, longitude, ts, %s) "
+             "SELECT DISTINCT ON (ts, ww_location_id, bom_location_id) "
+             "NOW(), location, ww_location_id, bom_location_id, latitude, "
+             "longitude, ts, value FROM bulk_weather_ibm_eis "
+             "ON CONFLICT (ts, ww_location_id, bom_location_id) "
+             "DO UPDATE SET last_updated = NOW(), %s = EXCLUDED.%s;",
+             column, column, column);
+
+    Bulk_Load_TypeDef load;
+    if(Bulk_Begin(&load, psql_conn, "bulk_weather_ibm_eis",
+                  "location text, ww_location_id text, bom_location_id text, "
+                  "latitude float8, longitude float8, ts timestamptz, "
+                  "value float8", 7, merge) != 0){
+        return;
     }
 
+    PGBinary_Params_TypeDef row;
+
     int32_t index = 0;
     while(index < dataset->count){
-        char ts[30];
-        time_t unix_time = dataset->timestamps[index];
-        struct tm ctm = *localtime(&unix_time);
-        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S%z", &ctm);
-
-        const char* paramValues[8];
-
-        char value_buf[10];
-        char lat_buf[10];
-        char lng_buf[10];
-
-        paramValues[0] = location->ww_location;
-        paramValues[1] = location->ww_location_id;
-        paramValues[2] = location->bom_location_id;
-        snprintf(lat_buf, sizeof(lat_buf), "%f", req_info->latitude);
-        paramValues[3] = lat_buf;
-        snprintf(lng_buf, sizeof(lng_buf), "%f", req_info->longitude);
-        paramValues[4] = lng_buf;
-        paramValues[5] = ts;
-        snprintf(value_buf, sizeof(value_buf), "%f", dataset->values[index]);
-        paramValues[6] = value_buf;
-        paramValues[7] = value_buf;
-
-        PGresult *res = NULL;
-        switch(req_info->layer_id){
-            case IBM_PRECIPITATION_ID:
-                res = PQexecPrepared(psql_conn, stmt_names[0], 8, paramValues,
-                               NULL, NULL, 1);
-                break;
-            case IBM_MIN_TEMPERATURE_ID:
-                res =PQexecPrepared(psql_conn, stmt_names[1], 8, paramValues,
-                               NULL, NULL, 1);
-                break;
-            case IBM_MAX_TEMPERATURE_ID:
-                res = PQexecPrepared(psql_conn, stmt_names[2], 8, paramValues,
-                               NULL, NULL, 1);
-                break;
-            default:
-                log_error("Unknown IBM dataset query results. Unable to insert"
-                          "into PostgreSQL database.\n");
-                break;
-        }
-
-        if(PQresultStatus(res) != PGRES_COMMAND_OK){
-            log_error("PSQL command failed when parsing IBM query. "
-                      "Error: %s\n", PQerrorMessage(psql_conn));
+        PGBinary_Reset(&row);
+        PGBinary_AddText(&row, location->ww_location);
+        PGBinary_AddText(&row, location->ww_location_id);
+        PGBinary_AddText(&row, location->bom_location_id);
+        PGBinary_AddFloat8(&row, (double)req_info->latitude);
+        PGBinary_AddFloat8(&row, (double)req_info->longitude);
+        PGBinary_AddTimestamp(&row, dataset->timestamps[index]);
+        PGBinary_AddFloat8(&row, dataset->values[index]);
+
+        if(Bulk_AddRow(&load, &row) != 0){
+            break;
         }
-        PQclear(res);
         index++;
     }
+
+    if(Bulk_End(&load) < 0){
+        log_error("PSQL command failed when parsing IBM query.\n");
+        return;
+    }
     log_info("Done inserting timeseries data from IBM EIS into "
              "PostgreSQL database.\n");
 }
 
 
+/**
+ * Build the IBM EIS timeseries tables for all locations.
+ *
+ * One precipitation request is made per location. These requests are run
+ * concurrently (see Fetch_Batch()) and each response is parsed and written
+ * to the weather_ibm_eis table as soon as it arrives. Requests go to the
+ * endpoint with the lowest recent latency and are hedged to the other
+ * endpoint when slow.
+ *
+ * @param locations Locations from the harvest_lookup table.
+ * @param start_time Start date (e.g. 2022-08-01).
+ * @param end_time End date (e.g. 2022-11-01).
+ * @param psql_conn PostgreSQL database connection handler.
+ */
 void IBM_BuildTSDatabase(T_LocationsLookup_TypeDef* locations,
                          const char* start_time,
                          const char* end_time,
@@ -542,20 +591,147 @@ void IBM_BuildTSDatabase(T_LocationsLookup_TypeDef* locations,
         return;
     }
 
+    if(locations->count == 0){
+        return;
+    }
+
+    IBM_BatchItem_TypeDef* items = calloc(locations->count,
+                                          sizeof(IBM_BatchItem_TypeDef));
+    Fetch_Request_TypeDef* requests = calloc(locations->count,
+                                             sizeof(Fetch_Request_TypeDef));
+    if(items == NULL || requests == NULL){
+        log_error("Not enough memory to hold IBM EIS requests.\n");
+        free(items);
+        free(requests);
+        return;
+    }
+
+    struct curl_slist *headers = IBM_BuildHeaders(&ibm_auth_handle);
+
     uint16_t index = 0;
     while(index < locations->count){
-        IBM_TimeseriesReq_TypeDef ibm_req = {
+        IBM_BatchItem_TypeDef* item = &items[index];
+        item->request = (IBM_TimeseriesReq_TypeDef){
                 .layer_id = IBM_PRECIPITATION_ID,
                 .latitude = locations->locations[index].ww_latitude,
                 .longitude = locations->locations[index].ww_longitude,
                 .start = unix_st,
                 .end = unix_et
         };
+        item->location = &locations->locations[index];
+        item->psql_conn = psql_conn;
 
-        IBM_TimeseriesDataset_TypeDef ibm_dataset;
-        IBM_GetTimeseries(&ibm_auth_handle, &ibm_req, &ibm_dataset, 1);
-        IBM_TimeseriesToDB(&ibm_req, &ibm_dataset,
-                           &locations->locations[index], psql_conn);
+        requests[index].on_complete = IBM_OnTimeseries;
+        requests[index].userdata = item;
+        IBM_SetupHedge(item, &requests[index], headers);
         index++;
     }
+
+    // Each location is written as it arrives, inside one transaction
+    Transaction_Begin(psql_conn, "IBM");
+    Fetch_Batch(requests, locations->count, NULL);
+    Transaction_End(psql_conn);
+
+    curl_slist_free_all(headers);
+    free(requests);
+    free(items);
+}
+
+/**
+ * Parse a timeseries response from a batch and write it to PostgreSQL.
+ *
+ * @param fetch_request Completed request (userdata holds the batch item).
+ * @param result cURL result of request.
+ * @param response Raw JSON response.
+ */
+static void IBM_OnTimeseries(Fetch_Request_TypeDef *fetch_request,
+                             CURLcode result,
+                             Utils_ReqData_TypeDef *response) {
+    IBM_BatchItem_TypeDef* item = fetch_request->userdata;
+    if (result != CURLE_OK) {
+        log_error("IBM EIS timeseries request failed for %s.\n",
+                  (item->location != NULL) ?
+                  item->location->fa_program_name : item->url);
+        return;
+    }
+
+    // Response format depends on which endpoint answered (url is always
+    // the alternative endpoint, see IBM_SetupHedge())
+    item->alt_flag = fetch_request->used_alt ? 0 : 1;
+
+    cJSON *json = cJSON_ParseWithLength(response->memory,
+                                        response->size);
+    if (json == NULL) {
+        log_error("Unable to getting JSON response from "
+                  "IBM EIS timeseries dataset.\n");
+        return;
+    }
+
+    IBM_TimeseriesDataset_TypeDef* dataset = item->dataset;
+    if (dataset == NULL) {
+        dataset = calloc(1, sizeof(IBM_TimeseriesDataset_TypeDef));
+    }
+    if (dataset == NULL) {
+        log_error("Not enough memory to hold IBM EIS dataset.\n");
+        cJSON_Delete(json);
+        return;
+    }
+
+    if (item->alt_flag == 1) {
+        IBM_ParseTimeseriesAlt(json, dataset);
+    } else {
+        IBM_ParseTimeseries(json, dataset);
+    }
+    cJSON_Delete(json);
+
+    if (item->dataset != NULL) {
+        return;
+    }
+
+    IBM_TimeseriesToDB(&item->request, dataset, item->location,
+                       item->psql_conn);
+    free(dataset);
+}
+
+static uint16_t IBM_PrimaryLayerID(uint16_t layer_id) {
+    switch (layer_id) {
+        case IBM_PRECIPITATION_ID:
+            return IBM_PRECIPITATION_PRIMARY_ID;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Build the URLs of a hedged timeseries request.
+ *
+ * The item request holds the alternative endpoint layer ID. If the layer
+ * also exists on the primary endpoint both URLs are built and the request
+ * is sent to whichever endpoint has the lower median latency when it is
+ * started, the other is used to hedge (see `prefer_faster` in fetch.h).
+ * Until both endpoints have latency samples the alternative endpoint is
+ * sent first. Otherwise only the alternative endpoint is used.
+ *
+ * @param item Batch item (request information must be set).
+ * @param fetch_request Request to populate.
+ * @param headers Headers used for both endpoints.
+ */
+static void IBM_SetupHedge(IBM_BatchItem_TypeDef* item,
+                           Fetch_Request_TypeDef* fetch_request,
+                           struct curl_slist* headers) {
+    IBM_TimeseriesReq_TypeDef primary = item->request;
+    primary.layer_id = IBM_PrimaryLayerID(item->request.layer_id);
+
+    IBM_BuildURLAlt(&item->request, item->url);
+    fetch_request->url = item->url;
+    fetch_request->headers = headers;
+
+    if (primary.layer_id == 0) {
+        return;
+    }
+
+    IBM_BuildURL(&primary, item->alt_url);
+    fetch_request->alt_url = item->alt_url;
+    fetch_request->alt_headers = headers;
+    fetch_request->prefer_faster = true;
 }
@@ -1,8 +1,12 @@
 #include "Ubidots/authenticate.h"
 
 int8_t Ubidots_GetToken(const char *env_var_name) {
-    char *token = getenv(env_var_name);
+    const char *token = getenv(env_var_name);
+    if (token == NULL && Transport_Mode() == TRANSPORT_REPLAY) {
+        token = TRANSPORT_REPLAY_SECRET;
+    }
     if (token == NULL) return 1; // Not found error
+    Transport_AddSecret(token);
 
     strncpy(UBIDOTS_TOKEN, token, UBIDOTS_TOKEN_SIZE);
     log_info("Ubidots access token found and initialised.\n");
@@ -7,9 +7,14 @@
  * @return Integer representing
  */
 uint8_t WillyWeather_GetToken(const char *env_var_name) {
-    char *token = getenv(env_var_name);
+    const char *token = getenv(env_var_name);
+    // Recorded responses don't need a real token (see transport.h)
+    if (token == NULL && Transport_Mode() == TRANSPORT_REPLAY) {
+        token = TRANSPORT_REPLAY_SECRET;
+    }
     if (token == NULL) return 1; // Not found error
     strncpy(WW_TOKEN, token, WW_TOKEN_SIZE);
+    Transport_AddSecret(token); // Sent in request URLs
     log_info("Willy Weather access token found and "
              "initialised.\n");
     return 0;
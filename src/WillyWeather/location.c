@@ -28,9 +28,60 @@ CURLcode WillyWeather_GetLocationByName(char *name,
 
     if (WillyWeather_CheckAccess() == 1) return CURLE_AUTH_ERROR;
 
+    char url[WW_LOCATION_URL_BUF];
+    WillyWeather_BuildLocationURL(name, url, sizeof(url));
+
+    log_info("Getting Willy Weather location information for %s, from: %s\n",
+             name, url);
+
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+
+    cJSON *response = NULL;
+    CURLcode result = HttpRequest(&response, url, headers, 0, NULL);
+
+    WillyWeather_ParseLocation(response, location_info);
+
+    if (result == CURLE_OK) {
+        log_info("Location request to Willy Weather was successful.\n");
+        log_debug("Location ID: %hu, Name: %s, State: %s, Latitude: %lf, "
+                  "Longitude: %lf\n",
+                  location_info->id, location_info->location,
+                  location_info->state,
+                  location_info->latitude,
+                  location_info->longitude);
+    } else {
+        log_error("Unable to process Willy Weather location"
+                  "request. Error status: %d\n", result);
+    }
+
+    curl_slist_free_all(headers);
+    cJSON_Delete(response);
+
+    return result;
+}
+
+/**
+ * Build a Willy Weather location search URL.
+ *
+ * Spaces in the location name are encoded as "%20". The response is limited
+ * to one location so the result can be parsed automatically.
+ *
+ * @code
+ * char url[WW_LOCATION_URL_BUF];
+ * WillyWeather_BuildLocationURL("Batemans Bay", url, sizeof(url));
+ * @endcode
+ *
+ * @param name Name to query against.
+ * @param url URL to populate.
+ * @param url_size Size of URL buffer.
+ */
+void WillyWeather_BuildLocationURL(const char *name, char *url,
+                                   size_t url_size) {
+
     // Method to handle spaces in location name (e.g. conver ' ' to '%20')
     int16_t new_name_size = 1;
-    for (char *c = name; *c != '\0'; c++) {
+    for (const char *c = name; *c != '\0'; c++) {
         if (*c == ' ') {
             new_name_size += 2;
         }
@@ -50,19 +101,25 @@ CURLcode WillyWeather_GetLocationByName(char *name,
         n++;
     }
 
-    char url[WW_LOCATION_URL_BUF];
-    snprintf(url, WW_LOCATION_URL_BUF,
+    snprintf(url, url_size,
              "https://api.willyweather.com.au/v2/%s/"
              "search.json?query=%s&limit=%d", WW_TOKEN, encoded_name, 1);
 
-    log_info("Getting Willy Weather location information for %s, from: %s\n",
-             name, url);
-
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+    free(encoded_name);
+}
 
-    cJSON *response = NULL;
-    CURLcode result = HttpRequest(&response, url, headers, 0, NULL);
+/**
+ * Parse a Willy Weather location search response.
+ *
+ * The response is limited to one location (see
+ * WillyWeather_BuildLocationURL()) which makes it easier to parse
+ * automatically.
+ *
+ * @param response JSON response from Willy Weather (may be NULL).
+ * @param location_info Location structure to populate.
+ */
+void WillyWeather_ParseLocation(cJSON *response,
+                                WW_Location_TypeDef *location_info) {
 
     // Response is limited to 1 (makes it easier to parse automatically)
     if (response != NULL && cJSON_IsArray(response)) {
@@ -132,23 +189,4 @@ CURLcode WillyWeather_GetLocationByName(char *name,
             }
         }
     }
-
-    if (result == CURLE_OK) {
-        log_info("Location request to Willy Weather was successful.\n");
-        log_debug("Location ID: %hu, Name: %s, State: %s, Latitude: %lf, "
-                  "Longitude: %lf\n",
-                  location_info->id, location_info->location,
-                  location_info->state,
-                  location_info->latitude,
-                  location_info->longitude);
-    } else {
-        log_error("Unable to process Willy Weather location"
-                  "request. Error status: %d\n", result);
-    }
-
-    free(encoded_name);
-    curl_slist_free_all(headers);
-    cJSON_Delete(response);
-
-    return result;
 }
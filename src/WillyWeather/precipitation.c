@@ -179,65 +179,63 @@ void WillyWeather_RainfallToDB(WW_Location_TypeDef* location,
                                WW_RainfallForecast_TypeDef* forecast,
                                PGconn* psql_conn){
 
-    const char* stmt_name = "InsertWillyWeather";
-    Utils_PrepareStatement(psql_conn, stmt_name,
-                           "INSERT INTO weather_ww (last_updated, location, "
-                           "location_id, ts, rainfall_start_range, "
-                           "rainfall_end_range, rainfall_range_divider, "
-                           "rainfall_range_code, rainfall_probability_of_any) "
-                           "VALUES (NOW(), $1::text, $2::int, $3::timestamptz, "
-                           "$4::int, $5::int, $6::char, $7::text, $8::int) "
-                           "ON CONFLICT (location_id, ts) DO "
-                           "UPDATE SET last_updated = NOW(), "
-                           "rainfall_start_range = $9::int, "
-                           "rainfall_end_range = $10::int, "
-                           "rainfall_range_divider = $11::char, "
-                           "rainfall_range_code = $12::text, "
-                           "rainfall_probability_of_any = $13::int;", 13);
-    const char* paramValues[13];
-
-    char locid_buf[10]; // Location ID buffer
-    char srf_buf[10]; // Start rainfall buffer
-    char erf_buf[10]; // End rainfall buffer
-    char probrf_buf[10]; // Probability rainfall buffer
+    Transaction_Begin(psql_conn, "WillyWeather");
+    Bulk_Load_TypeDef load;
+    if(Bulk_Begin(&load, psql_conn, "bulk_weather_ww",
+                  "location text, location_id int, ts text, "
+                  "rainfall_start_range int, rainfall_end_range int, "
+                  "rainfall_range_divider char, rainfall_range_code text, "
+                  "rainfall_probability_of_any int", 8,
+                  "INSERT INTO weather_ww (last_updated, location, "
+                  "location_id, ts, rainfall_start_range, "
+                  "rainfall_end_range, rainfall_range_divider, "
+                  "rainfall_range_code, rainfall_probability_of_any) "
+                  "SELECT DISTINCT ON (location_id, ts::timestamptz) NOW(), "
+                  "location, location_id, ts::timestamptz, "
+                  "rainfall_start_range, "
+                  "rainfall_end_range, rainfall_range_divider, "
+                  "rainfall_range_code, rainfall_probability_of_any "
+                  "FROM bulk_weather_ww "
+                  "ON CONFLICT (location_id, ts) DO "
+                  "UPDATE SET last_updated = NOW(), "
+                  "rainfall_start_range = EXCLUDED.rainfall_start_range, "
+                  "rainfall_end_range = EXCLUDED.rainfall_end_range, "
+                  "rainfall_range_divider = "
+                  "EXCLUDED.rainfall_range_divider, "
+                  "rainfall_range_code = EXCLUDED.rainfall_range_code, "
+                  "rainfall_probability_of_any = "
+                  "EXCLUDED.rainfall_probability_of_any;") != 0){
+        Transaction_End(psql_conn);
+        return;
+    }
+    PGBinary_Params_TypeDef row;
+    char div_buf[2] = {0}; // Rainfall range divider buffer
 
     int16_t index = 0;
     while(index < forecast->n_days){
-        WW_Rainfall_TypeDef daily_rf = forecast->forecast[index];
-
-        paramValues[0] = location->location;
-        snprintf(locid_buf, sizeof(locid_buf), "%d", location->id);
-        paramValues[1] = locid_buf;
-        paramValues[2] = daily_rf.ts;
-        snprintf(srf_buf, sizeof(srf_buf), "%d", daily_rf.start_range);
-        paramValues[3] = srf_buf;
-
-        snprintf(erf_buf, sizeof(erf_buf), "%d", daily_rf.end_range);
-        paramValues[4] = erf_buf;
-
-        paramValues[5] = &daily_rf.range_divider;
-        paramValues[6] = daily_rf.range_code;
-
-        snprintf(probrf_buf, sizeof(probrf_buf), "%d", daily_rf.probability);
-        paramValues[7] = probrf_buf;
-
-        paramValues[8] = srf_buf;
-        paramValues[9] = erf_buf;
-        paramValues[10] = &daily_rf.range_divider;
-
-        paramValues[11] = daily_rf.range_code;
-        paramValues[12] = probrf_buf;
-
-        PGresult* res = PQexecPrepared(psql_conn, stmt_name, 13, paramValues,
-                                       NULL, NULL, 1);
-
-        if(PQresultStatus(res) != PGRES_COMMAND_OK){
-            log_error("PSQL command failed when entering %s "
-                      "information. Error: %s\n", location->location,
-                      PQerrorMessage(psql_conn));
+        const WW_Rainfall_TypeDef* daily_rf = &forecast->forecast[index];
+
+        PGBinary_Reset(&row);
+        PGBinary_AddText(&row, location->location);
+        PGBinary_AddInt4(&row, location->id);
+        // Formatted with its UTC offset, cast by the merge
+        PGBinary_AddText(&row, daily_rf->ts);
+        PGBinary_AddInt4(&row, daily_rf->start_range);
+        PGBinary_AddInt4(&row, daily_rf->end_range);
+        div_buf[0] = daily_rf->range_divider;
+        PGBinary_AddText(&row, div_buf);
+        PGBinary_AddText(&row, daily_rf->range_code);
+        PGBinary_AddInt4(&row, daily_rf->probability);
+
+        if(Bulk_AddRow(&load, &row) != 0){
+            break;
         }
-        PQclear(res);
         index++;
     }
 
+    if(Bulk_End(&load) < 0){
+        log_error("PSQL command failed when entering %s "
+                  "information.\n", location->location);
+    }
+    Transaction_End(psql_conn);
 }
@@ -0,0 +1,171 @@
+#include "arena.h"
+
+/// Bytes before the data of a block (padded to keep the data aligned)
+#define ARENA_HEADER_SIZE   ((sizeof(Arena_Block_TypeDef) + ARENA_ALIGN - 1) \
+                             & ~(size_t)(ARENA_ALIGN - 1))
+
+/// Hash of a string (32 bit FNV-1a)
+static uint32_t Arena_Hash(const char* string, size_t length);
+
+/// Double the size of the intern table
+static int8_t Arena_GrowInternTable(Arena_TypeDef* arena);
+
+/**
+ * Start an empty arena.
+ *
+ * An arena hands out memory from large blocks and frees them all at once,
+ * so data with the same lifetime (e.g. every value decoded from a query
+ * result) costs a few allocations instead of one per value and doesn't
+ * need to be freed piece by piece.
+ *
+ * @code
+ * Arena_TypeDef arena;
+ * Arena_Init(&arena);
+ * double* values = Arena_Alloc(&arena, n_rows * sizeof(double));
+ * const char* name = Arena_Intern(&arena, "Clyde River", 11);
+ * Arena_Free(&arena);
+ * @endcode
+ *
+ * @param arena Arena to start.
+ */
+void Arena_Init(Arena_TypeDef* arena) {
+    memset(arena, 0, sizeof(Arena_TypeDef));
+}
+
+/**
+ * Allocate memory from an arena.
+ *
+ * The memory is not initialised and is only freed by Arena_Free().
+ *
+ * @param arena Arena from Arena_Init().
+ * @param size Bytes to allocate.
+ * @return Memory aligned to ARENA_ALIGN (NULL if out of memory).
+ */
+void* Arena_Alloc(Arena_TypeDef* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    Arena_Block_TypeDef* block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        void* memory = NULL;
+        if (posix_memalign(&memory, ARENA_ALIGN,
+                           ARENA_HEADER_SIZE + block_size) != 0) {
+            log_error("Arena out of memory (%zu bytes requested).\n", size);
+            return NULL;
+        }
+        block = memory;
+        block->size = block_size;
+        block->used = 0;
+
+        // A large request gets its own block behind the current one, so
+        // the space left in the current block isn't wasted
+        if (arena->blocks != NULL && block_size > ARENA_BLOCK_SIZE) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+        arena->allocated += ARENA_HEADER_SIZE + block_size;
+    }
+
+    void* memory = (char*)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    return memory;
+}
+
+/**
+ * Copy a string into an arena.
+ *
+ * Identical strings are stored once, so a column that repeats the same few
+ * values (e.g. a program name on every row) only costs one copy of each and
+ * the copies can be compared by pointer.
+ *
+ * @param arena Arena from Arena_Init().
+ * @param string String to copy (doesn't need to be null terminated).
+ * @param length Characters in the string.
+ * @return Null terminated copy (NULL if out of memory).
+ */
+const char* Arena_Intern(Arena_TypeDef* arena, const char* string,
+                         size_t length) {
+    if (arena->intern_count * 2 >= arena->intern_slots &&
+        Arena_GrowInternTable(arena) != 0) {
+        return NULL;
+    }
+
+    size_t mask = arena->intern_slots - 1;
+    size_t slot = Arena_Hash(string, length) & mask;
+    while (arena->interned[slot] != NULL) {
+        const char* existing = arena->interned[slot];
+        if (strncmp(existing, string, length) == 0 &&
+            existing[length] == '\0') {
+            return existing;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    char* copy = Arena_Alloc(arena, length + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+
+    arena->interned[slot] = copy;
+    arena->intern_count++;
+    return copy;
+}
+
+/**
+ * Free everything allocated from an arena.
+ *
+ * The arena is left empty and can be used again.
+ *
+ * @param arena Arena from Arena_Init().
+ */
+void Arena_Free(Arena_TypeDef* arena) {
+    Arena_Block_TypeDef* block = arena->blocks;
+    while (block != NULL) {
+        Arena_Block_TypeDef* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena->interned);
+    memset(arena, 0, sizeof(Arena_TypeDef));
+}
+
+static uint32_t Arena_Hash(const char* string, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)string[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static int8_t Arena_GrowInternTable(Arena_TypeDef* arena) {
+    size_t slots = arena->intern_slots == 0 ? ARENA_INTERN_MIN_SLOTS :
+                   arena->intern_slots * 2;
+    const char** table = calloc(slots, sizeof(const char*));
+    if (table == NULL) {
+        log_error("Arena out of memory (intern table).\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i < arena->intern_slots; i++) {
+        const char* string = arena->interned[i];
+        if (string == NULL) {
+            continue;
+        }
+        size_t slot = Arena_Hash(string, strlen(string)) & (slots - 1);
+        while (table[slot] != NULL) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        table[slot] = string;
+    }
+
+    free(arena->interned);
+    arena->interned = table;
+    arena->intern_slots = slots;
+    return 0;
+}
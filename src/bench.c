@@ -0,0 +1,534 @@
+#include "bench.h"
+
+/// Recorded response body held in memory
+typedef struct {
+    char* data; ///< Body
+    size_t size; ///< Size of body
+} Bench_Body_TypeDef;
+
+/// Recorded BOM month replayed by Bench_CachedMonths()
+typedef struct {
+    char url[BOM_URL_SIZE]; ///< Recorded URL
+    BOM_WeatherStation_TypeDef station; ///< Station (only filename is set)
+    char year_month[BENCH_MONTH_SIZE]; ///< Month e.g. 202206
+    BOM_WeatherDataset_TypeDef* dataset; ///< Rows of the current pass
+    BOM_CSVParser_TypeDef parser; ///< Parser of the current pass
+    bool parsing; ///< Parser has been started this pass
+    size_t streamed[2]; ///< Bytes streamed while downloading, per pass
+    uint16_t rows[2]; ///< Rows parsed per pass
+    bool restored; ///< Second pass was served from the cache
+} Bench_Month_TypeDef;
+
+/// Seconds elapsed since start
+static double Bench_Elapsed(const struct timespec* start);
+
+/// Read the recorded BOM months (ftp:// URLs) of a corpus
+static size_t Bench_LoadMonths(const char* corpus, Bench_Month_TypeDef* months);
+
+/// Stream a chunk of a month into its parser (as BOM_OnWeatherData())
+static size_t Bench_OnMonthData(Fetch_Request_TypeDef* request,
+                                const char* data, size_t size);
+
+/// Finish parsing a month and count its rows (as BOM_OnWeather())
+static void Bench_OnMonth(Fetch_Request_TypeDef* request, CURLcode result,
+                          Utils_ReqData_TypeDef* response);
+
+/// Pass of Bench_CachedMonths() being run (0 = filling the cache)
+static uint8_t Bench_Pass;
+
+/// Read every file in a directory into memory
+static size_t Bench_LoadBodies(const char* directory,
+                               Bench_Body_TypeDef* bodies);
+
+/// Deliver a body to a write callback in BENCH_CHUNK_SIZE chunks
+static void Bench_Replay(const Bench_Body_TypeDef* body,
+                         size_t (*callback)(void*, size_t, size_t, void*),
+                         Utils_ReqData_TypeDef* data);
+
+/// Write callback as it was before buffers were pooled (exact size growth)
+static size_t Bench_ExactWriteCallback(void* contents, size_t size,
+                                       size_t nmemb, void* userp);
+
+/**
+ * Replay recorded response bodies through the response write callback.
+ *
+ * Every file in `directory` (e.g. datasets/bom/historical) is loaded into
+ * memory and delivered in BENCH_CHUNK_SIZE chunks, the way cURL hands a
+ * response to CURLOPT_WRITEFUNCTION. Three receive paths are timed:
+ *
+ * - exact: a new buffer per response, grown by the size of each chunk.
+ * - geometric: a reused buffer grown by doubling (WriteMemoryCallback()).
+ * - presized: as geometric but the expected size is known up front (as it
+ *   is when the server sends a Content-Length).
+ *
+ * @code
+ * Bench_WriteCallback("datasets/bom/historical", 20);
+ * @endcode
+ *
+ * @param directory Directory of recorded response bodies.
+ * @param iterations Number of times each body is replayed per path.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Bench_WriteCallback(const char* directory, uint16_t iterations) {
+    Bench_Body_TypeDef bodies[BENCH_MAX_FILES];
+    size_t n_bodies = Bench_LoadBodies(directory, bodies);
+    if (n_bodies == 0) {
+        log_error("No recorded bodies found in %s\n", directory);
+        return -1;
+    }
+    if (iterations == 0) iterations = 1;
+
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < n_bodies; i++) {
+        total_bytes += bodies[i].size;
+    }
+
+    struct timespec start;
+    double t_exact, t_geometric, t_presized;
+
+    // Exact growth (a new buffer per response)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < n_bodies; i++) {
+            Utils_ReqData_TypeDef chunk = {.memory = malloc(1), .size = 0};
+            Bench_Replay(&bodies[i], Bench_ExactWriteCallback, &chunk);
+            free(chunk.memory);
+        }
+    }
+    t_exact = Bench_Elapsed(&start);
+
+    // Geometric growth into a reused buffer (no Content-Length)
+    Utils_ReqData_TypeDef buffer;
+    if (Utils_ReqDataInit(&buffer, NULL) != 0) {
+        for (size_t i = 0; i < n_bodies; i++) free(bodies[i].data);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < n_bodies; i++) {
+            Utils_ReqDataReset(&buffer, NULL);
+            Bench_Replay(&bodies[i], WriteMemoryCallback, &buffer);
+        }
+    }
+    t_geometric = Bench_Elapsed(&start);
+    free(buffer.memory);
+
+    // Pre-sized from the expected size (fresh buffer, as with a cold pool)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < n_bodies; i++) {
+            if (Utils_ReqDataInit(&buffer, NULL) != 0) break;
+            buffer.expected = bodies[i].size;
+            Bench_Replay(&bodies[i], WriteMemoryCallback, &buffer);
+            free(buffer.memory);
+        }
+    }
+    t_presized = Bench_Elapsed(&start);
+
+    double mbytes = (double)total_bytes * iterations / (1024.0 * 1024.0);
+    log_info("Replayed %zu bodies (%.1f MB) x %u from %s\n", n_bodies,
+             (double)total_bytes / (1024.0 * 1024.0), iterations, directory);
+    log_info("  exact:     %8.3f s (%8.1f MB/s)\n", t_exact,
+             mbytes / t_exact);
+    log_info("  geometric: %8.3f s (%8.1f MB/s)\n", t_geometric,
+             mbytes / t_geometric);
+    log_info("  presized:  %8.3f s (%8.1f MB/s)\n", t_presized,
+             mbytes / t_presized);
+
+    for (size_t i = 0; i < n_bodies; i++) {
+        free(bodies[i].data);
+    }
+
+    return 0;
+}
+
+/**
+ * Compare the scalar and batched station distance functions.
+ *
+ * Stations are loaded from a cached BOM station list and measured against a
+ * BENCH_GRID_SIZE x BENCH_GRID_SIZE grid of points over NSW. Three paths are
+ * timed:
+ *
+ * - scalar: Utils_PointsDistance() for every station (the reference).
+ * - batch: Utils_PointsDistanceBatch() over the packed stations.
+ * - nearest: Utils_PointsNearest() over the packed stations.
+ *
+ * The largest difference between the scalar and batch distances and any
+ * query where the closest station differs are also reported.
+ *
+ * @code
+ * Bench_PointsDistance(BOM_STATIONS_FILE, 100);
+ * @endcode
+ *
+ * @param stations_file Cached BOM station list.
+ * @param iterations Number of times the grid is queried per path.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Bench_PointsDistance(const char* stations_file, uint16_t iterations) {
+    const BOM_WeatherStations_TypeDef* stations =
+            BOM_MapStations(stations_file);
+    if (stations == NULL || stations->count <= 0) {
+        log_error("No stations found in %s\n", stations_file);
+        return -1;
+    }
+    if (iterations == 0) iterations = 1;
+
+    size_t count = (size_t)stations->count;
+    Utils_Points_TypeDef points;
+    double* distances = malloc(count * sizeof(double));
+    if (distances == NULL || Utils_PointsInit(&points, count) != 0) {
+        free(distances);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        Utils_PointsAdd(&points, stations->stations[i].latitude,
+                        stations->stations[i].longitude);
+    }
+
+    // Query grid (roughly the extent of NSW)
+    double latitudes[BENCH_GRID_SIZE];
+    double longitudes[BENCH_GRID_SIZE];
+    for (uint16_t i = 0; i < BENCH_GRID_SIZE; i++) {
+        latitudes[i] = -37.5 + 9.0 * i / (BENCH_GRID_SIZE - 1);
+        longitudes[i] = 141.0 + 12.7 * i / (BENCH_GRID_SIZE - 1);
+    }
+
+    struct timespec start;
+    double t_scalar, t_batch, t_nearest;
+    double checksum = 0.0;
+
+    // Scalar reference
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t it = 0; it < iterations; it++) {
+        for (uint16_t y = 0; y < BENCH_GRID_SIZE; y++) {
+            for (uint16_t x = 0; x < BENCH_GRID_SIZE; x++) {
+                for (size_t i = 0; i < count; i++) {
+                    checksum += Utils_PointsDistance(
+                            latitudes[y], longitudes[x],
+                            stations->stations[i].latitude,
+                            stations->stations[i].longitude);
+                }
+            }
+        }
+    }
+    t_scalar = Bench_Elapsed(&start);
+
+    // Batched over packed points
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t it = 0; it < iterations; it++) {
+        for (uint16_t y = 0; y < BENCH_GRID_SIZE; y++) {
+            for (uint16_t x = 0; x < BENCH_GRID_SIZE; x++) {
+                Utils_PointsDistanceBatch(latitudes[y], longitudes[x],
+                                          &points, distances);
+                checksum += distances[count - 1];
+            }
+        }
+    }
+    t_batch = Bench_Elapsed(&start);
+
+    // Closest point only
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint16_t it = 0; it < iterations; it++) {
+        for (uint16_t y = 0; y < BENCH_GRID_SIZE; y++) {
+            for (uint16_t x = 0; x < BENCH_GRID_SIZE; x++) {
+                checksum += (double)Utils_PointsNearest(
+                        latitudes[y], longitudes[x], &points, NULL);
+            }
+        }
+    }
+    t_nearest = Bench_Elapsed(&start);
+
+    // Accuracy against the scalar reference
+    double max_error = 0.0;
+    uint32_t mismatches = 0;
+    for (uint16_t y = 0; y < BENCH_GRID_SIZE; y++) {
+        for (uint16_t x = 0; x < BENCH_GRID_SIZE; x++) {
+            Utils_PointsDistanceBatch(latitudes[y], longitudes[x], &points,
+                                      distances);
+            int64_t closest = -1;
+            double min_distance = INFINITY;
+            for (size_t i = 0; i < count; i++) {
+                double reference = Utils_PointsDistance(
+                        latitudes[y], longitudes[x],
+                        stations->stations[i].latitude,
+                        stations->stations[i].longitude);
+                if (fabs(reference - distances[i]) > max_error) {
+                    max_error = fabs(reference - distances[i]);
+                }
+                if (reference < min_distance) {
+                    min_distance = reference;
+                    closest = (int64_t)i;
+                }
+            }
+            if (Utils_PointsNearest(latitudes[y], longitudes[x], &points,
+                                    NULL) != closest) {
+                mismatches++;
+            }
+        }
+    }
+
+    double n_distances = (double)count * BENCH_GRID_SIZE * BENCH_GRID_SIZE *
+                         iterations;
+    log_info("Measured %zu stations x %u points x %u from %s "
+             "(checksum %.1f)\n", count, BENCH_GRID_SIZE * BENCH_GRID_SIZE,
+             iterations, stations_file, checksum);
+    log_info("  scalar:  %8.3f s (%8.1f M distances/s)\n", t_scalar,
+             n_distances / t_scalar / 1e6);
+    log_info("  batch:   %8.3f s (%8.1f M distances/s)\n", t_batch,
+             n_distances / t_batch / 1e6);
+    log_info("  nearest: %8.3f s (%8.1f M distances/s)\n", t_nearest,
+             n_distances / t_nearest / 1e6);
+    log_info("  max error %.3g km, %u nearest mismatches\n", max_error,
+             mismatches);
+
+    Utils_PointsFree(&points);
+    free(distances);
+
+    return 0;
+}
+
+/**
+ * Check recorded BOM months still yield rows once served from the cache.
+ *
+ * Every BOM month in the corpus is fetched twice with Fetch_Batch() in
+ * replay mode. The first pass streams each file and stores it in the cache.
+ * The second pass probes the cache the way a live FTP transfer does (the
+ * probe lines cURL passes as data included) and restores the unchanged
+ * files. A month fails if anything was streamed while it was restored, or if
+ * it has no rows or a different number of rows than the first pass.
+ *
+ * @code
+ * // TRANSPORT_MODE=replay
+ * Bench_CachedMonths(TRANSPORT_DEFAULT_CORPUS, "tmp/bench-cache");
+ * @endcode
+ *
+ * @param corpus Corpus recorded in record mode (see transport.h).
+ * @param cache_directory Empty directory to cache the months in.
+ * @return Error code. 0 = OK ... -1 = ERROR (a month lost its rows)
+ */
+int8_t Bench_CachedMonths(const char* corpus, const char* cache_directory) {
+    if (Transport_Mode() != TRANSPORT_REPLAY) {
+        log_error("Cached months are only checked in replay mode.\n");
+        return -1;
+    }
+    if (Cache_Init(cache_directory) != 0) {
+        return -1;
+    }
+
+    Bench_Month_TypeDef* months = calloc(BENCH_MAX_FILES,
+                                         sizeof(Bench_Month_TypeDef));
+    Fetch_Request_TypeDef* requests = calloc(BENCH_MAX_FILES,
+                                             sizeof(Fetch_Request_TypeDef));
+    if (months == NULL || requests == NULL) {
+        free(months);
+        free(requests);
+        return -1;
+    }
+
+    size_t n_months = Bench_LoadMonths(corpus, months);
+    if (n_months == 0) {
+        log_error("No recorded BOM months found in %s\n", corpus);
+        free(months);
+        free(requests);
+        return -1;
+    }
+
+    for (Bench_Pass = 0; Bench_Pass < 2; Bench_Pass++) {
+        memset(requests, 0, n_months * sizeof(Fetch_Request_TypeDef));
+        for (size_t i = 0; i < n_months; i++) {
+            requests[i].url = months[i].url;
+            requests[i].on_data = Bench_OnMonthData;
+            requests[i].on_complete = Bench_OnMonth;
+            requests[i].userdata = &months[i];
+        }
+        Fetch_Batch(requests, n_months, NULL);
+    }
+
+    uint32_t n_restored = 0;
+    uint32_t n_failed = 0;
+    for (size_t i = 0; i < n_months; i++) {
+        Bench_Month_TypeDef* month = &months[i];
+        if (month->restored) n_restored++;
+        if ((month->restored && month->streamed[1] > 0) ||
+            month->rows[0] == 0 || month->rows[1] != month->rows[0]) {
+            log_error("  %s (%s): %u rows, then %u rows (%zu bytes "
+                      "streamed)\n", month->station.filename,
+                      month->year_month, month->rows[0], month->rows[1],
+                      month->streamed[1]);
+            n_failed++;
+        }
+    }
+
+    log_info("Replayed %zu BOM months twice from %s\n", n_months, corpus);
+    log_info("  restored from the cache: %u\n", n_restored);
+    log_info("  months with missing rows: %u\n", n_failed);
+
+    free(months);
+    free(requests);
+
+    return (n_failed == 0 && n_restored == n_months) ? 0 : -1;
+}
+
+static double Bench_Elapsed(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double)(end.tv_sec - start->tv_sec) +
+           (double)(end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void Bench_Replay(const Bench_Body_TypeDef* body,
+                         size_t (*callback)(void*, size_t, size_t, void*),
+                         Utils_ReqData_TypeDef* data) {
+    for (size_t offset = 0; offset < body->size; offset += BENCH_CHUNK_SIZE) {
+        size_t n = body->size - offset;
+        if (n > BENCH_CHUNK_SIZE) n = BENCH_CHUNK_SIZE;
+        callback(body->data + offset, 1, n, data);
+    }
+}
+
+static size_t Bench_LoadBodies(const char* directory,
+                               Bench_Body_TypeDef* bodies) {
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        log_error("Unable to open directory %s\n", directory);
+        return 0;
+    }
+
+    size_t n_bodies = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && n_bodies < BENCH_MAX_FILES) {
+        if (entry->d_name[0] == '.') continue;
+
+        char path[BENCH_PATH_SIZE];
+        snprintf(path, BENCH_PATH_SIZE, "%s/%s", directory, entry->d_name);
+
+        FILE* fp = fopen(path, "rb");
+        if (fp == NULL) continue;
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if (size <= 0) {
+            fclose(fp);
+            continue;
+        }
+
+        char* data = malloc((size_t)size);
+        if (data == NULL || fread(data, 1, (size_t)size, fp) != (size_t)size) {
+            free(data);
+            fclose(fp);
+            continue;
+        }
+        fclose(fp);
+
+        bodies[n_bodies].data = data;
+        bodies[n_bodies].size = (size_t)size;
+        n_bodies++;
+    }
+    closedir(dir);
+
+    return n_bodies;
+}
+
+static size_t Bench_ExactWriteCallback(void* contents, size_t size,
+                                       size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    Utils_ReqData_TypeDef* mem = (Utils_ReqData_TypeDef*) userp;
+
+    char* ptr = realloc(mem->memory, mem->size + realsize + 1);
+    if (ptr == NULL) {
+        return 0;
+    }
+
+    mem->memory = ptr;
+    memcpy(&(mem->memory[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->memory[mem->size] = 0;
+
+    return realsize;
+}
+
+static size_t Bench_LoadMonths(const char* corpus, Bench_Month_TypeDef* months) {
+    DIR* dir = opendir(corpus);
+    if (dir == NULL) {
+        log_error("Unable to open directory %s\n", corpus);
+        return 0;
+    }
+
+    size_t n_months = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && n_months < BENCH_MAX_FILES) {
+        const char* extension = strrchr(entry->d_name, '.');
+        if (extension == NULL || strcmp(extension, ".meta") != 0) continue;
+
+        char path[BENCH_PATH_SIZE];
+        snprintf(path, BENCH_PATH_SIZE, "%s/%s", corpus, entry->d_name);
+
+        // First line of a recording is "url <url>"
+        Bench_Month_TypeDef* month = &months[n_months];
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL) continue;
+        char line[BOM_URL_SIZE + 8];
+        bool read = fgets(line, sizeof(line), fp) != NULL;
+        fclose(fp);
+        if (!read || strncmp(line, "url ftp://", 10) != 0) continue;
+        line[strcspn(line, "\r\n")] = '\0';
+        snprintf(month->url, sizeof(month->url), "%s", line + 4);
+
+        // File name is <station>-<year_month>.csv
+        const char* name = strrchr(month->url, '/');
+        const char* dash = strrchr(month->url, '-');
+        if (name == NULL || dash == NULL || dash < name ||
+            strlen(dash + 1) != BENCH_MONTH_SIZE - 1 + 4) continue;
+        snprintf(month->station.filename, sizeof(month->station.filename),
+                 "%.*s", (int)(dash - name - 1), name + 1);
+        snprintf(month->year_month, sizeof(month->year_month), "%.*s",
+                 BENCH_MONTH_SIZE - 1, dash + 1);
+
+        n_months++;
+    }
+    closedir(dir);
+
+    return n_months;
+}
+
+static size_t Bench_OnMonthData(Fetch_Request_TypeDef* request,
+                                const char* data, size_t size) {
+    Bench_Month_TypeDef* month = request->userdata;
+    if (!month->parsing) {
+        month->dataset = calloc(1, sizeof(BOM_WeatherDataset_TypeDef));
+        if (month->dataset == NULL) {
+            return 0;
+        }
+        BOM_CSVParserInit(&month->parser, month->dataset, &month->station,
+                          NULL);
+        month->parsing = true;
+    }
+    month->streamed[Bench_Pass] += size;
+    return BOM_CSVParserFeed(&month->parser, data, size);
+}
+
+static void Bench_OnMonth(Fetch_Request_TypeDef* request, CURLcode result,
+                          Utils_ReqData_TypeDef* response) {
+    Bench_Month_TypeDef* month = request->userdata;
+    if (Bench_Pass == 1) {
+        month->restored = response->not_modified;
+    }
+
+    if (result == CURLE_OK) {
+        if (!month->parsing) {
+            Bench_OnMonthData(request, response->memory, response->size);
+            month->streamed[Bench_Pass] = 0;
+        }
+        if (month->parsing) {
+            BOM_CSVParserFinish(&month->parser);
+            month->rows[Bench_Pass] = month->dataset->count;
+        }
+    }
+
+    if (month->parsing) {
+        BOM_CSVParserDiscard(&month->parser);
+        free(month->dataset);
+        month->dataset = NULL;
+        month->parsing = false;
+    }
+}
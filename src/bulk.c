@@ -0,0 +1,268 @@
+#include "bulk.h"
+
+/// Send buffered rows to the server
+static int8_t Bulk_Flush(Bulk_Load_TypeDef* load);
+
+/// Append characters to the buffer
+static int8_t Bulk_Append(Utils_ReqData_TypeDef* buffer, const char* data,
+                          size_t length);
+
+/// Append an integer to the buffer in network byte order
+static int8_t Bulk_AppendInt(Utils_ReqData_TypeDef* buffer, int32_t value,
+                             size_t size);
+
+/**
+ * Start a bulk load.
+ *
+ * Writing one row per PQexecPrepared() costs a round trip per row. A bulk
+ * load streams rows with COPY into a temporary staging table instead and
+ * then merges the whole table into its target with a single
+ * INSERT ... SELECT ... ON CONFLICT statement (see Bulk_End()), so large
+ * loads are limited by bandwidth rather than latency.
+ *
+ * The staging table is created once per connection (it is a TEMP table) and
+ * emptied at the start of each load. Rows are sent in COPY binary format, so
+ * each value must match the type of its staging column exactly (float8,
+ * int4, timestamptz or text). Values that arrive as strings (e.g. timestamps
+ * from an API) can be staged as text and cast in the merge. While the load
+ * is in progress the connection can't be used for anything else.
+ *
+ * The merge should use SELECT DISTINCT ON (conflict columns) as a row can
+ * only be updated once per statement.
+ *
+ * Inside a stage transaction (see Transaction_Begin()) each load is a unit
+ * of work: if it fails it is rolled back to its savepoint and the rest of
+ * the stage is kept.
+ *
+ * @code
+ * Bulk_Load_TypeDef load;
+ * Bulk_Begin(&load, psql_conn, "bulk_example",
+ *            "name text, ts timestamptz, value float8", 3,
+ *            "INSERT INTO example (last_updated, name, ts, value) "
+ *            "SELECT DISTINCT ON (ts, name) NOW(), name, ts, value "
+ *            "FROM bulk_example "
+ *            "ON CONFLICT (ts, name) DO UPDATE SET last_updated = NOW();");
+ * PGBinary_Params_TypeDef row;
+ * PGBinary_Reset(&row);
+ * PGBinary_AddText(&row, "Moruya");
+ * PGBinary_AddTimestamp(&row, time(NULL));
+ * PGBinary_AddFloat8(&row, 1.2);
+ * Bulk_AddRow(&load, &row);
+ * Bulk_End(&load);
+ * @endcode
+ *
+ * @param load Bulk load to start.
+ * @param psql_conn PostgreSQL connection handler.
+ * @param staging Staging table name (e.g. bulk_weather_bom).
+ * @param columns Staging table columns (e.g. "ts timestamptz, value float8").
+ * @param n_columns Number of staging table columns.
+ * @param merge Statement that moves staged rows into the target table.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Bulk_Begin(Bulk_Load_TypeDef* load, PGconn* psql_conn,
+                  const char* staging, const char* columns,
+                  uint16_t n_columns, const char* merge) {
+    memset(load, 0, sizeof(Bulk_Load_TypeDef));
+    load->psql_conn = psql_conn;
+    load->staging = staging;
+    load->merge = merge;
+    load->n_columns = n_columns;
+    load->failed = true;
+
+    if (Utils_ReqDataInit(&load->buffer, NULL) != 0) {
+        return -1;
+    }
+    if (Transaction_UnitBegin(psql_conn) != 0) {
+        Transaction_UnitEnd(psql_conn, -1);
+        free(load->buffer.memory);
+        load->buffer.memory = NULL;
+        return -1;
+    }
+
+    char stmt[BULK_STMT_SIZE];
+    snprintf(stmt, sizeof(stmt), "CREATE TEMP TABLE IF NOT EXISTS %s (%s); "
+                                 "TRUNCATE %s;", staging, columns, staging);
+    PGresult* res = PQexec(psql_conn, stmt);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        log_error("Unable to create staging table %s. Error: %s\n", staging,
+                  PQerrorMessage(psql_conn));
+        PQclear(res);
+        free(load->buffer.memory);
+        load->buffer.memory = NULL;
+        Transaction_UnitEnd(psql_conn, -1);
+        return -1;
+    }
+    PQclear(res);
+
+    snprintf(stmt, sizeof(stmt), "COPY %s FROM STDIN (FORMAT binary);",
+             staging);
+    res = PQexec(psql_conn, stmt);
+    if (PQresultStatus(res) != PGRES_COPY_IN) {
+        log_error("Unable to start COPY into %s. Error: %s\n", staging,
+                  PQerrorMessage(psql_conn));
+        PQclear(res);
+        free(load->buffer.memory);
+        load->buffer.memory = NULL;
+        Transaction_UnitEnd(psql_conn, -1);
+        return -1;
+    }
+    PQclear(res);
+
+    // Signature, flags and header extension length
+    load->copying = true;
+    if (Bulk_Append(&load->buffer, BULK_COPY_SIGNATURE,
+                    BULK_COPY_SIGNATURE_SIZE) != 0 ||
+        Bulk_AppendInt(&load->buffer, 0, 4) != 0 ||
+        Bulk_AppendInt(&load->buffer, 0, 4) != 0) {
+        Bulk_End(load);
+        return -1;
+    }
+
+    load->failed = false;
+    return 0;
+}
+
+/**
+ * Add a row to a bulk load.
+ *
+ * Rows are buffered and sent in BULK_FLUSH_SIZE blocks.
+ *
+ * @param load Bulk load from Bulk_Begin().
+ * @param row One value per staging table column (see PGBinary_Reset()).
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Bulk_AddRow(Bulk_Load_TypeDef* load,
+                   const PGBinary_Params_TypeDef* row) {
+    if (load->failed) {
+        return -1;
+    }
+
+    if (row->count != load->n_columns) {
+        log_error("Row of %d values added to %s (%u columns).\n", row->count,
+                  load->staging, load->n_columns);
+        load->failed = true;
+        return -1;
+    }
+
+    if (Bulk_AppendInt(&load->buffer, load->n_columns, 2) != 0) {
+        load->failed = true;
+        return -1;
+    }
+    for (int i = 0; i < row->count; i++) {
+        // Each value is its length (-1 for NULL) then its bytes
+        const char* value = row->values[i];
+        int length = value == NULL ? -1 : row->lengths[i];
+        if (Bulk_AppendInt(&load->buffer, length, 4) != 0 ||
+            (length > 0 &&
+             Bulk_Append(&load->buffer, value, (size_t)length) != 0)) {
+            load->failed = true;
+            return -1;
+        }
+    }
+    load->rows++;
+
+    if (load->buffer.size >= BULK_FLUSH_SIZE) {
+        return Bulk_Flush(load);
+    }
+    return 0;
+}
+
+/**
+ * Finish a bulk load.
+ *
+ * The remaining rows are sent, the COPY is completed and the staging table
+ * is merged into its target. If any row failed the COPY is cancelled and
+ * nothing is merged.
+ *
+ * @param load Bulk load from Bulk_Begin().
+ * @return Number of rows merged (-1 on error).
+ */
+int64_t Bulk_End(Bulk_Load_TypeDef* load) {
+    if (!load->copying) {
+        return -1;
+    }
+
+    if (!load->failed) {
+        // File trailer
+        if (Bulk_AppendInt(&load->buffer, -1, 2) != 0) {
+            load->failed = true;
+        } else {
+            Bulk_Flush(load);
+        }
+    }
+    load->copying = false;
+    free(load->buffer.memory);
+    load->buffer.memory = NULL;
+
+    const char* error = load->failed ? "bulk load abandoned" : NULL;
+    if (PQputCopyEnd(load->psql_conn, error) != 1) {
+        log_error("Unable to end COPY into %s. Error: %s\n", load->staging,
+                  PQerrorMessage(load->psql_conn));
+        load->failed = true;
+    }
+
+    PGresult* res;
+    while ((res = PQgetResult(load->psql_conn)) != NULL) {
+        if (PQresultStatus(res) != PGRES_COMMAND_OK && error == NULL) {
+            log_error("COPY into %s failed. Error: %s\n", load->staging,
+                      PQerrorMessage(load->psql_conn));
+            load->failed = true;
+        }
+        PQclear(res);
+    }
+
+    if (load->failed) {
+        Transaction_UnitEnd(load->psql_conn, -1);
+        return -1;
+    }
+
+    res = PQexec(load->psql_conn, load->merge);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        log_error("Unable to merge %s. Error: %s\n", load->staging,
+                  PQerrorMessage(load->psql_conn));
+        PQclear(res);
+        Transaction_UnitEnd(load->psql_conn, -1);
+        return -1;
+    }
+
+    int64_t merged = strtoll(PQcmdTuples(res), NULL, 10);
+    PQclear(res);
+    Transaction_UnitEnd(load->psql_conn, merged);
+
+    log_debug("Bulk loaded %u rows (%lld merged) through %s\n", load->rows,
+              (long long)merged, load->staging);
+    return merged;
+}
+
+static int8_t Bulk_Flush(Bulk_Load_TypeDef* load) {
+    if (load->buffer.size == 0) {
+        return 0;
+    }
+
+    if (PQputCopyData(load->psql_conn, load->buffer.memory,
+                      (int)load->buffer.size) != 1) {
+        log_error("Unable to send rows to %s. Error: %s\n", load->staging,
+                  PQerrorMessage(load->psql_conn));
+        load->failed = true;
+        return -1;
+    }
+    Utils_ReqDataReset(&load->buffer, NULL);
+    return 0;
+}
+
+static int8_t Bulk_AppendInt(Utils_ReqData_TypeDef* buffer, int32_t value,
+                             size_t size) {
+    char data[4];
+    uint32_t bits = (uint32_t)value;
+    for (size_t i = size; i > 0; i--) {
+        data[i - 1] = (char)(bits & 0xFF);
+        bits >>= 8;
+    }
+    return Bulk_Append(buffer, data, size);
+}
+
+static int8_t Bulk_Append(Utils_ReqData_TypeDef* buffer, const char* data,
+                          size_t length) {
+    return WriteMemoryCallback((void*)(uintptr_t)data, 1, length,
+                               buffer) == length ? 0 : -1;
+}
@@ -0,0 +1,498 @@
+#include "cache.h"
+
+/// Response cache settings and statistics
+static struct {
+    bool enabled; ///< Set once Cache_Init() has succeeded
+    char directory[CACHE_PATH_SIZE]; ///< Directory holding cached responses
+    pthread_mutex_t lock; ///< Protects the statistics
+    Cache_Stats_TypeDef stats; ///< Cache statistics
+} Cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/// Hash a request (URL and body) into a cache key
+static void Cache_Key(const char* url, const char* body, char* key);
+
+/// Path of a cache file (`ext` is "body" or "meta")
+static void Cache_Path(const Cache_Entry_TypeDef* entry, const char* ext,
+                       char* path, size_t path_size);
+
+/// Read the validators of a cached response
+static bool Cache_ReadMeta(Cache_Entry_TypeDef* entry);
+
+/// Write a response and its validators to the cache
+static int8_t Cache_Store(const Cache_Entry_TypeDef* entry,
+                          const Utils_ReqData_TypeDef* data);
+
+/// Replace the contents of a response buffer with the cached body
+static int8_t Cache_LoadBody(const Cache_Entry_TypeDef* entry,
+                             Utils_ReqData_TypeDef* data);
+
+/// Capture ETag and Last-Modified response headers
+static size_t Cache_HeaderCallback(char* buffer, size_t size, size_t nitems,
+                                   void* userdata);
+
+/// Copy a header value (without the trailing CRLF) into a validator
+static void Cache_CopyValidator(char* dest, const char* value, size_t length);
+
+/**
+ * Enable the on-disk response cache.
+ *
+ * Once enabled, HttpRequest(), HttpRequestRaw(), FTPRequest() and
+ * Fetch_Batch() keep a copy of each response together with its validators.
+ * The next time the same request (URL and body) is made:
+ *
+ * - HTTP requests send If-None-Match / If-Modified-Since. A 304 response
+ *   restores the cached body instead of downloading it again.
+ * - FTP requests first ask for the remote file time (MDTM) and size (SIZE).
+ *   If both match the cached copy, the RETR is skipped.
+ *
+ * Responses restored from the cache are flagged with `not_modified` (see
+ * Utils_ReqData_TypeDef). The cache only saves the download: a response is
+ * stored before the caller has written it to the database, so callers must
+ * still parse a restored response.
+ *
+ * @code
+ * Cache_Init(CACHE_DEFAULT_DIRECTORY);
+ * @endcode
+ *
+ * @param directory Directory to hold cached responses.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Cache_Init(const char* directory) {
+    if (directory == NULL) {
+        directory = CACHE_DEFAULT_DIRECTORY;
+    }
+
+    // Create each parent directory (e.g. tmp then tmp/cache)
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s", directory);
+    for (char* c = path + 1; *c != '\0'; c++) {
+        if (*c == '/') {
+            *c = '\0';
+            MakeDirectory(path);
+            *c = '/';
+        }
+    }
+    if (MakeDirectory(path) != 0) {
+        log_error("Response cache disabled.\n");
+        return -1;
+    }
+
+    snprintf(Cache.directory, sizeof(Cache.directory), "%s", directory);
+    Cache.enabled = true;
+
+    log_info("Response cache enabled in %s\n", Cache.directory);
+
+    return 0;
+}
+
+/**
+ * Check if the response cache has been enabled.
+ *
+ * @return True if Cache_Init() has succeeded.
+ */
+bool Cache_Enabled(void) {
+    return Cache.enabled;
+}
+
+/**
+ * Find the cached validators of a request.
+ *
+ * The entry is always initialised (even if nothing is cached) so it can be
+ * passed to Cache_Setup() and Cache_Finish().
+ *
+ * @param entry Entry to populate.
+ * @param url Request URL.
+ * @param body POST body (NULL for GET or FTP requests).
+ * @return True if a cached response exists.
+ */
+bool Cache_Lookup(Cache_Entry_TypeDef* entry, const char* url,
+                  const char* body) {
+    memset(entry, 0, sizeof(Cache_Entry_TypeDef));
+    entry->filetime = -1;
+    entry->size = -1;
+    entry->ftp = strncasecmp(url, "ftp://", 6) == 0;
+    Cache_Key(url, body, entry->key);
+
+    if (!Cache.enabled) {
+        return false;
+    }
+
+    entry->found = Cache_ReadMeta(entry);
+    if (!entry->found) {
+        pthread_mutex_lock(&Cache.lock);
+        Cache.stats.misses++;
+        pthread_mutex_unlock(&Cache.lock);
+    }
+
+    return entry->found;
+}
+
+/**
+ * Prepare a transfer so its response can be validated and cached.
+ *
+ * HTTP: If-None-Match / If-Modified-Since headers are added to a copy of the
+ * request headers (the original list is not modified) and ETag /
+ * Last-Modified response headers are captured. Must be called after
+ * CURLOPT_HTTPHEADER has been set.
+ *
+ * FTP: the remote modification time is requested (MDTM) so it can be stored
+ * with the response.
+ *
+ * @param entry Entry from Cache_Lookup().
+ * @param curl Handle used for the transfer.
+ * @param headers Request headers (may be NULL).
+ * @return Header list to free with curl_slist_free_all() once the transfer
+ * has completed (NULL if the original headers are used).
+ */
+struct curl_slist* Cache_Setup(Cache_Entry_TypeDef* entry, CURL* curl,
+                               struct curl_slist* headers) {
+    if (!Cache.enabled) {
+        return NULL;
+    }
+
+    if (entry->ftp) {
+        curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+        return NULL;
+    }
+
+    struct curl_slist* conditional = NULL;
+    if (entry->found && (entry->etag[0] != '\0' ||
+                         entry->last_modified[0] != '\0')) {
+        for (struct curl_slist* h = headers; h != NULL; h = h->next) {
+            conditional = curl_slist_append(conditional, h->data);
+        }
+
+        char header[CACHE_VALIDATOR_SIZE + 32];
+        if (entry->etag[0] != '\0') {
+            snprintf(header, sizeof(header), "If-None-Match: %s",
+                     entry->etag);
+            conditional = curl_slist_append(conditional, header);
+        }
+        if (entry->last_modified[0] != '\0') {
+            snprintf(header, sizeof(header), "If-Modified-Since: %s",
+                     entry->last_modified);
+            conditional = curl_slist_append(conditional, header);
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, conditional);
+    }
+
+    // Validators are refilled from the response
+    entry->etag[0] = '\0';
+    entry->last_modified[0] = '\0';
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, Cache_HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *) entry);
+
+    return conditional;
+}
+
+/**
+ * Check a NOBODY probe of an FTP file against the cached copy.
+ *
+ * The handle must have just performed a transfer with CURLOPT_NOBODY and
+ * CURLOPT_FILETIME set. If the remote modification time and size match the
+ * cached copy, the cached body is restored into `data`.
+ *
+ * In replay mode (see transport.h) there is no handle: `curl` is NULL and
+ * `data` holds the replayed file, which is compared by size with a file
+ * time of CACHE_REPLAY_FILETIME.
+ *
+ * @code
+ * curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+ * curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+ * curl_easy_perform(curl);
+ * if (!Cache_ProbeUnchanged(&entry, curl, &data)) {
+ *     curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+ *     curl_easy_perform(curl); // RETR
+ * }
+ * @endcode
+ *
+ * @param entry Entry from Cache_Lookup().
+ * @param curl Handle used for the probe (NULL for a replayed file).
+ * @param data Response buffer to restore the cached body into.
+ * @return True if the file is unchanged (and `data` holds the cached body).
+ */
+bool Cache_ProbeUnchanged(Cache_Entry_TypeDef* entry, CURL* curl,
+                          Utils_ReqData_TypeDef* data) {
+    if (!entry->found || entry->filetime < 0) {
+        return false;
+    }
+
+    curl_off_t filetime = CACHE_REPLAY_FILETIME;
+    curl_off_t size = (curl_off_t)data->size;
+    if (curl != NULL) {
+        curl_easy_getinfo(curl, CURLINFO_FILETIME_T, &filetime);
+        curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+    }
+
+    if (filetime != entry->filetime || size != entry->size ||
+        Cache_LoadBody(entry, data) != 0) {
+        pthread_mutex_lock(&Cache.lock);
+        Cache.stats.misses++;
+        pthread_mutex_unlock(&Cache.lock);
+        return false;
+    }
+
+    pthread_mutex_lock(&Cache.lock);
+    Cache.stats.hits++;
+    pthread_mutex_unlock(&Cache.lock);
+
+    return true;
+}
+
+/**
+ * Store a new response or restore the cached body after a 304.
+ *
+ * @param entry Entry from Cache_Lookup() (validators filled by the transfer).
+ * @param curl Handle used for the transfer (NULL for a replayed FTP file).
+ * @param result Result of the transfer.
+ * @param data Response buffer.
+ */
+void Cache_Finish(Cache_Entry_TypeDef* entry, CURL* curl, CURLcode result,
+                  Utils_ReqData_TypeDef* data) {
+    if (!Cache.enabled || result != CURLE_OK) {
+        return;
+    }
+
+    if (entry->ftp) {
+        entry->filetime = CACHE_REPLAY_FILETIME;
+        if (curl != NULL) {
+            curl_easy_getinfo(curl, CURLINFO_FILETIME_T, &entry->filetime);
+        }
+        entry->size = (curl_off_t)data->size;
+        if (entry->filetime >= 0) {
+            Cache_Store(entry, data);
+        }
+        return;
+    }
+
+    long response_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+
+    if (response_code == 304) {
+        // Server may omit validators on a 304 so keep the stored ones
+        if (entry->found && Cache_LoadBody(entry, data) == 0) {
+            pthread_mutex_lock(&Cache.lock);
+            Cache.stats.hits++;
+            pthread_mutex_unlock(&Cache.lock);
+        } else {
+            log_error("Cached response for %s is missing.\n", entry->key);
+        }
+        return;
+    }
+
+    if (entry->found) {
+        pthread_mutex_lock(&Cache.lock);
+        Cache.stats.misses++;
+        pthread_mutex_unlock(&Cache.lock);
+    }
+
+    // Responses without validators can never be revalidated
+    if (entry->etag[0] != '\0' || entry->last_modified[0] != '\0') {
+        Cache_Store(entry, data);
+    }
+}
+
+/**
+ * Log how many responses were served from the cache.
+ */
+void Cache_LogStats(void) {
+    if (!Cache.enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&Cache.lock);
+    Cache_Stats_TypeDef stats = Cache.stats;
+    pthread_mutex_unlock(&Cache.lock);
+
+    log_info("Response cache: %u hits, %u misses, %u responses stored.\n",
+             stats.hits, stats.misses, stats.stored);
+}
+
+/**
+ * Hash a request into a cache key using 64 bit FNV-1a.
+ *
+ * @param url Request URL.
+ * @param body POST body (may be NULL).
+ * @param key Key to populate (CACHE_KEY_SIZE characters).
+ */
+static void Cache_Key(const char* url, const char* body, char* key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = url; *c != '\0'; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+
+    // Separator so "ab" + "c" and "a" + "bc" differ
+    hash ^= 0xFF;
+    hash *= 1099511628211ULL;
+
+    if (body != NULL) {
+        for (const char* c = body; *c != '\0'; c++) {
+            hash ^= (uint8_t)*c;
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    snprintf(key, CACHE_KEY_SIZE, "%016llx", (unsigned long long)hash);
+}
+
+static void Cache_Path(const Cache_Entry_TypeDef* entry, const char* ext,
+                       char* path, size_t path_size) {
+    snprintf(path, path_size, "%s/%s.%s", Cache.directory, entry->key, ext);
+}
+
+/**
+ * Read the validators of a cached response.
+ *
+ * The .meta file holds one `name value` pair per line.
+ *
+ * @param entry Entry (with key) to populate.
+ * @return True if the validators were read.
+ */
+static bool Cache_ReadMeta(Cache_Entry_TypeDef* entry) {
+    char path[CACHE_PATH_SIZE];
+    Cache_Path(entry, "meta", path, sizeof(path));
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[CACHE_VALIDATOR_SIZE + 32];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t length = strlen(line);
+        if (strncmp(line, "etag ", 5) == 0) {
+            Cache_CopyValidator(entry->etag, line + 5, length - 5);
+        } else if (strncmp(line, "last_modified ", 14) == 0) {
+            Cache_CopyValidator(entry->last_modified, line + 14,
+                                length - 14);
+        } else if (strncmp(line, "filetime ", 9) == 0) {
+            entry->filetime = strtoll(line + 9, NULL, 10);
+        } else if (strncmp(line, "size ", 5) == 0) {
+            entry->size = strtoll(line + 5, NULL, 10);
+        }
+    }
+    fclose(file);
+
+    // Body must also exist for the entry to be usable
+    Cache_Path(entry, "body", path, sizeof(path));
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * Write a response and its validators to the cache.
+ *
+ * The body is written before the .meta file so an interrupted write never
+ * leaves validators pointing at a partial body.
+ *
+ * @param entry Entry holding the validators.
+ * @param data Response to store.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+static int8_t Cache_Store(const Cache_Entry_TypeDef* entry,
+                          const Utils_ReqData_TypeDef* data) {
+    char path[CACHE_PATH_SIZE];
+    Cache_Path(entry, "meta", path, sizeof(path));
+    remove(path);
+
+    Cache_Path(entry, "body", path, sizeof(path));
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        log_error("Unable to write cached response: %s\n", path);
+        return -1;
+    }
+    size_t written = fwrite(data->memory, 1, data->size, file);
+    fclose(file);
+    if (written != data->size) {
+        log_error("Unable to write cached response: %s\n", path);
+        return -1;
+    }
+
+    Cache_Path(entry, "meta", path, sizeof(path));
+    file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("Unable to write cached response: %s\n", path);
+        return -1;
+    }
+    fprintf(file, "etag %s\n", entry->etag);
+    fprintf(file, "last_modified %s\n", entry->last_modified);
+    fprintf(file, "filetime %lld\n", (long long)entry->filetime);
+    fprintf(file, "size %lld\n", (long long)entry->size);
+    fclose(file);
+
+    pthread_mutex_lock(&Cache.lock);
+    Cache.stats.stored++;
+    pthread_mutex_unlock(&Cache.lock);
+
+    return 0;
+}
+
+static int8_t Cache_LoadBody(const Cache_Entry_TypeDef* entry,
+                             Utils_ReqData_TypeDef* data) {
+    char path[CACHE_PATH_SIZE];
+    Cache_Path(entry, "body", path, sizeof(path));
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    Utils_ReqDataReset(data, NULL);
+    data->expected = (file_size > 0) ? (size_t)file_size : 0;
+
+    char chunk[CACHE_READ_CHUNK_SIZE];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        if (WriteMemoryCallback(chunk, 1, n, data) != n) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+
+    data->not_modified = true;
+
+    return 0;
+}
+
+static size_t Cache_HeaderCallback(char* buffer, size_t size, size_t nitems,
+                                   void* userdata) {
+    size_t length = size * nitems;
+    Cache_Entry_TypeDef* entry = (Cache_Entry_TypeDef*) userdata;
+
+    if (length > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        Cache_CopyValidator(entry->etag, buffer + 5, length - 5);
+    } else if (length > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+        Cache_CopyValidator(entry->last_modified, buffer + 14, length - 14);
+    }
+
+    return length;
+}
+
+static void Cache_CopyValidator(char* dest, const char* value, size_t length) {
+    while (length > 0 && (*value == ' ' || *value == '\t')) {
+        value++;
+        length--;
+    }
+    while (length > 0 && (value[length - 1] == '\r' ||
+                          value[length - 1] == '\n' ||
+                          value[length - 1] == ' ')) {
+        length--;
+    }
+    if (length >= CACHE_VALIDATOR_SIZE) {
+        // Too long to send back, treat as having no validator
+        length = 0;
+    }
+    memcpy(dest, value, length);
+    dest[length] = '\0';
+}
@@ -0,0 +1,754 @@
+#include "fetch.h"
+
+/// Max number of unique hosts in a single batch
+#define FETCH_MAX_HOSTS                     32
+
+/// Request has not been started
+#define FETCH_STATE_PENDING                 0
+/// Request is in flight
+#define FETCH_STATE_RUNNING                 1
+/// Request has completed (callback has been called)
+#define FETCH_STATE_DONE                    2
+
+/// Max characters in the replayed lines of an FTP probe
+#define FETCH_PROBE_LINES_SIZE              128
+
+/// Number of requests in flight to a host
+typedef struct {
+    char host[FETCH_HOST_SIZE]; ///< Host name
+    uint16_t in_flight; ///< Requests currently running against this host
+} Fetch_Host_TypeDef;
+
+/// State of a batch while it is running
+typedef struct {
+    CURLM* multi; ///< Multi handle running the transfers
+    Fetch_Request_TypeDef* requests; ///< Requests in batch
+    size_t n_requests; ///< Number of requests in batch
+    uint8_t* states; ///< State of each request (FETCH_STATE_*)
+    Fetch_Options_TypeDef opts; ///< Limits applied to batch
+    Fetch_Host_TypeDef hosts[FETCH_MAX_HOSTS]; ///< Requests in flight per host
+    uint16_t n_hosts; ///< Number of hosts in table
+    size_t completed; ///< Requests completed
+    size_t first_pending; ///< No request before this index is pending
+    uint16_t running; ///< Transfers in flight (including hedges)
+    bool hedging; ///< At least one request has an alternative URL
+    double callback_time; ///< Time spent in completion callbacks (s)
+} Fetch_Batch_TypeDef;
+
+/// Limits used when Fetch_Batch() is called without options
+static Fetch_Options_TypeDef Fetch_Defaults = {
+        .max_per_host = FETCH_DEFAULT_MAX_PER_HOST,
+        .max_total = FETCH_DEFAULT_MAX_TOTAL
+};
+
+/// Monotonic time in seconds
+static double Fetch_Now(void);
+
+/// Find (or add) a host in the hosts table
+static Fetch_Host_TypeDef* Fetch_GetHost(Fetch_Host_TypeDef* hosts,
+                                         uint16_t* n_hosts,
+                                         const char* host);
+
+/// Start pending requests which are within the limits
+static void Fetch_StartPending(Fetch_Batch_TypeDef* batch, double* next_wait);
+
+/// Send alternative requests for requests which have run past their delay
+static void Fetch_StartHedges(Fetch_Batch_TypeDef* batch, double* next_wait);
+
+/// Handle a completed transfer
+static void Fetch_OnDone(Fetch_Batch_TypeDef* batch, CURL* curl,
+                         CURLcode result);
+
+/// Send the endpoint with the lower median latency first
+static void Fetch_OrderEndpoints(Fetch_Request_TypeDef* request);
+
+/// Swap the primary and alternative request
+static void Fetch_SwapEndpoints(Fetch_Request_TypeDef* request);
+
+/// Attach a request to the multi handle
+static int8_t Fetch_Start(CURLM* multi, Fetch_Request_TypeDef* request);
+
+/// Attach the alternative (hedged) request to the multi handle
+static int8_t Fetch_StartAlt(CURLM* multi, Fetch_Request_TypeDef* request);
+
+/// Stop the primary or alternative transfer of a request
+static void Fetch_Cancel(Fetch_Batch_TypeDef* batch,
+                         Fetch_Request_TypeDef* request, bool alt);
+
+/// Handle a completed FTP probe (returns true if the request was re-added)
+static bool Fetch_ProbeComplete(CURLM* multi, Fetch_Request_TypeDef* request,
+                                CURLcode* result);
+
+/// Call the completion callback and release request resources
+static void Fetch_Complete(Fetch_Batch_TypeDef* batch,
+                           Fetch_Request_TypeDef* request, CURLcode result);
+
+/// Hand a chunk to the streaming callback (and buffer it if needed)
+static size_t Fetch_WriteCallback(void* contents, size_t size, size_t nmemb,
+                                  void* userp);
+
+/// Serve a batch from the recorded corpus (see transport.h)
+static int8_t Fetch_Replay(Fetch_Batch_TypeDef* batch);
+
+/// Check a replayed FTP file against the cache the way Fetch_Start() does
+static bool Fetch_ReplayProbe(Fetch_Request_TypeDef* request,
+                              Utils_ReqData_TypeDef* data);
+
+/**
+ * Change the default limits used by Fetch_Batch().
+ *
+ * @param options New default limits.
+ */
+void Fetch_SetDefaultOptions(const Fetch_Options_TypeDef* options) {
+    if (options == NULL) {
+        return;
+    }
+    Fetch_Defaults = *options;
+}
+
+/**
+ * Run a batch of HTTP or FTP requests concurrently.
+ *
+ * Requests are started in the order provided using the cURL multi interface.
+ * At most `max_per_host` requests run against the same host and at most
+ * `max_total` requests run at once. Each host is also held to its provider
+ * quota and adaptive concurrency limit (see rate_limit.h). Requests rejected
+ * with 429/503 are retried once the host has backed off.
+ *
+ * Requests with an `alt_url` are hedged. If the primary request has not
+ * answered within `hedge_after_ms` (by default the FETCH_HEDGE_PERCENTILE
+ * latency of the primary host) the alternative request is also sent. The
+ * first successful answer is used (`used_alt` says which) and the other
+ * transfer is cancelled. A failed primary request fails over to the
+ * alternative straight away. Requests with `prefer_faster` set choose the
+ * endpoint to send first as they are started: the alternative is sent first
+ * while its host has the lower median latency (see
+ * RateLimit_LatencyPercentile()), so later requests of a batch follow what
+ * the earlier ones measured. Callbacks always see the request as given.
+ *
+ * When a request completes its `on_complete` callback is called with the
+ * response data. Requests with an `on_data` callback also receive the body
+ * chunk by chunk as it arrives, so it can be parsed while the transfer is
+ * still running. The body is then only kept in the response buffer if the
+ * cache or record mode needs it. A response restored from the cache
+ * (`not_modified`) is not streamed. If a request fails after some data has
+ * been streamed `on_complete` is called with the error. Callbacks are
+ * called from the calling thread, one at a time, so they are free to write
+ * to the database or other non thread-safe resources.
+ *
+ * Handles are taken from the handle pool (see http_pool.h) so requests to
+ * the same host share DNS, TLS and connection state. If the response cache
+ * is enabled (see cache.h) unchanged responses are restored from disk and
+ * flagged with `not_modified`.
+ *
+ * In record mode (see transport.h) each response is saved to the corpus
+ * under the URL that answered. In replay mode the batch is served from the
+ * corpus with no network access. Requests are answered in groups of
+ * `max_total` and each group waits once for the injected latency, as if the
+ * group had been sent concurrently. If the cache is enabled, replayed FTP
+ * files are probed and restored like live ones, so a second replay serves
+ * every month from the cache.
+ *
+ * @code
+ * static void OnComplete(Fetch_Request_TypeDef* request, CURLcode result,
+ *                        Utils_ReqData_TypeDef* response) {
+ *     if (result == CURLE_OK) {
+ *         cJSON* json = cJSON_Parse(response->memory);
+ *         ...
+ *     }
+ * }
+ *
+ * Fetch_Request_TypeDef requests[2] = {
+ *     {.url = "https://www.example.com/a", .on_complete = OnComplete},
+ *     {.url = "https://www.example.com/b", .on_complete = OnComplete}
+ * };
+ * Fetch_Batch(requests, 2, NULL);
+ * @endcode
+ *
+ * @param requests List of request descriptors.
+ * @param n_requests Number of requests in list.
+ * @param options Limits to apply (NULL to use the defaults).
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Fetch_Batch(Fetch_Request_TypeDef* requests, size_t n_requests,
+                   const Fetch_Options_TypeDef* options) {
+
+    if (n_requests == 0) {
+        return 0;
+    }
+
+    Fetch_Batch_TypeDef batch = {
+            .requests = requests,
+            .n_requests = n_requests,
+            .opts = (options != NULL) ? *options : Fetch_Defaults
+    };
+    if (batch.opts.max_per_host == 0) batch.opts.max_per_host = 1;
+    if (batch.opts.max_total == 0) batch.opts.max_total = 1;
+
+    if (Transport_Mode() == TRANSPORT_REPLAY) {
+        return Fetch_Replay(&batch);
+    }
+
+    batch.multi = curl_multi_init();
+    if (batch.multi == NULL) {
+        log_error("Unable to create cURL multi handle.\n");
+        return -1;
+    }
+
+    // Sets the host of each request and marks it as pending
+    batch.states = calloc(n_requests, sizeof(uint8_t));
+    if (batch.states == NULL) {
+        log_error("Not enough memory to hold fetch batch.\n");
+        curl_multi_cleanup(batch.multi);
+        return -1;
+    }
+    for (size_t i = 0; i < n_requests; i++) {
+        Fetch_Request_TypeDef* request = &requests[i];
+        RateLimit_ParseHost(request->url, request->host,
+                            sizeof(request->host));
+        RateLimit_ParseHost(request->alt_url, request->alt_host,
+                            sizeof(request->alt_host));
+        request->handle = NULL;
+        request->alt_handle = NULL;
+        request->cache_headers = NULL;
+        request->probing = false;
+        request->hedged = false;
+        request->ordered = false;
+        request->swapped = false;
+        request->used_alt = false;
+        request->attempts = 0;
+        request->keep_body = false;
+        if (request->alt_url != NULL) batch.hedging = true;
+    }
+
+    log_info("Fetching %zu requests (max %d per host, %d in total).\n",
+             n_requests, batch.opts.max_per_host, batch.opts.max_total);
+
+    double started = Transport_Now();
+    while (batch.completed < n_requests) {
+        double next_wait = 1.0; // Time until a host or hedge is due
+        size_t completed_before = batch.completed;
+
+        Fetch_StartPending(&batch, &next_wait);
+        if (batch.hedging) {
+            Fetch_StartHedges(&batch, &next_wait);
+        }
+
+        int still_running = 0;
+        curl_multi_perform(batch.multi, &still_running);
+
+        // Handle completed transfers
+        CURLMsg* msg;
+        int msgs_left = 0;
+        while ((msg = curl_multi_info_read(batch.multi, &msgs_left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Fetch_OnDone(&batch, msg->easy_handle, msg->data.result);
+        }
+
+        // Wait for activity (or for a rate limited host) unless requests
+        // have just completed and freed up slots
+        if (batch.completed < n_requests &&
+            batch.completed == completed_before) {
+            curl_multi_poll(batch.multi, NULL, 0,
+                            (int)(next_wait * 1000.0) + 1, NULL);
+        }
+    }
+
+    free(batch.states);
+    curl_multi_cleanup(batch.multi);
+
+    // Callbacks (parsing, database writes) aren't time spent on the network
+    Transport_AddNetworkTime(Transport_Now() - started -
+                             batch.callback_time);
+
+    log_info("Fetch batch of %zu requests completed.\n", n_requests);
+
+    return 0;
+}
+
+static double Fetch_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static Fetch_Host_TypeDef* Fetch_GetHost(Fetch_Host_TypeDef* hosts,
+                                         uint16_t* n_hosts,
+                                         const char* host) {
+    for (uint16_t i = 0; i < *n_hosts; i++) {
+        if (strcmp(hosts[i].host, host) == 0) {
+            return &hosts[i];
+        }
+    }
+
+    if (*n_hosts >= FETCH_MAX_HOSTS) {
+        log_warn("Max number of hosts exceeded. No per host limit "
+                 "applied to %s\n", host);
+        return NULL;
+    }
+
+    Fetch_Host_TypeDef* new_host = &hosts[(*n_hosts)++];
+    strncpy(new_host->host, host, FETCH_HOST_SIZE - 1);
+    new_host->host[FETCH_HOST_SIZE - 1] = '\0';
+    new_host->in_flight = 0;
+    return new_host;
+}
+
+static void Fetch_StartPending(Fetch_Batch_TypeDef* batch, double* next_wait) {
+    for (size_t i = batch->first_pending; i < batch->n_requests &&
+                     batch->running < batch->opts.max_total; i++) {
+        if (batch->states[i] != FETCH_STATE_PENDING) {
+            if (i == batch->first_pending) batch->first_pending++;
+            continue;
+        }
+
+        Fetch_Request_TypeDef* request = &batch->requests[i];
+        Fetch_OrderEndpoints(request);
+        Fetch_Host_TypeDef* host = Fetch_GetHost(batch->hosts,
+                                                 &batch->n_hosts,
+                                                 request->host);
+        if (host != NULL && host->in_flight >= batch->opts.max_per_host) {
+            continue;
+        }
+
+        // Provider quota and adaptive concurrency limit
+        double wait = RateLimit_TryAcquire(request->host);
+        if (wait > 0.0) {
+            if (wait < *next_wait) *next_wait = wait;
+            continue;
+        }
+
+        if (Fetch_Start(batch->multi, request) != 0) {
+            RateLimit_Release(request->host, NULL, CURLE_FAILED_INIT);
+            batch->states[i] = FETCH_STATE_DONE;
+            Fetch_Complete(batch, request, CURLE_FAILED_INIT);
+            batch->completed++;
+            continue;
+        }
+
+        batch->states[i] = FETCH_STATE_RUNNING;
+        if (host != NULL) host->in_flight++;
+        batch->running++;
+    }
+}
+
+static void Fetch_StartHedges(Fetch_Batch_TypeDef* batch, double* next_wait) {
+    double now = Fetch_Now();
+    for (size_t i = 0; i < batch->n_requests; i++) {
+        Fetch_Request_TypeDef* request = &batch->requests[i];
+        if (batch->states[i] != FETCH_STATE_RUNNING ||
+            request->alt_url == NULL || request->hedged ||
+            request->probing) {
+            continue;
+        }
+
+        if (now < request->hedge_at) {
+            if (request->hedge_at - now < *next_wait) {
+                *next_wait = request->hedge_at - now;
+            }
+            continue;
+        }
+
+        // A completing transfer wakes the loop up again
+        if (batch->running >= batch->opts.max_total) {
+            continue;
+        }
+
+        double wait = RateLimit_TryAcquire(request->alt_host);
+        if (wait > 0.0) {
+            if (wait < *next_wait) *next_wait = wait;
+            continue;
+        }
+
+        request->hedged = true;
+        if (Fetch_StartAlt(batch->multi, request) != 0) {
+            RateLimit_Release(request->alt_host, NULL, CURLE_FAILED_INIT);
+            HttpPool_Release(request->alt_handle);
+            request->alt_handle = NULL;
+
+            // Primary has already failed, nothing left to wait for
+            if (request->handle == NULL) {
+                batch->states[i] = FETCH_STATE_DONE;
+                Fetch_Complete(batch, request, CURLE_FAILED_INIT);
+                batch->completed++;
+            }
+            continue;
+        }
+
+        batch->running++;
+        log_info("Hedging %s after %.0f ms with %s\n", request->host,
+                 (now - request->started) * 1000.0, request->alt_host);
+    }
+}
+
+static void Fetch_OnDone(Fetch_Batch_TypeDef* batch, CURL* curl,
+                         CURLcode result) {
+    void* private = NULL;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &private);
+    Fetch_Request_TypeDef* request = private;
+    size_t index = (size_t)(request - batch->requests);
+    bool is_alt = request->alt_handle != NULL &&
+                  curl == request->alt_handle->curl;
+
+    curl_multi_remove_handle(batch->multi, curl);
+    HttpPool_RecordTransfer(curl);
+
+    // File changed since it was cached, request stays in flight
+    if (!is_alt && request->probing &&
+        Fetch_ProbeComplete(batch->multi, request, &result)) {
+        return;
+    }
+
+    batch->running--;
+    if (!is_alt) {
+        Fetch_Host_TypeDef* host = Fetch_GetHost(batch->hosts,
+                                                 &batch->n_hosts,
+                                                 request->host);
+        if (host != NULL && host->in_flight > 0) host->in_flight--;
+    }
+    bool throttled = RateLimit_Release(is_alt ? request->alt_host :
+                                       request->host, curl, result);
+
+    HttpPool_Handle_TypeDef** leg = is_alt ? &request->alt_handle :
+                                    &request->handle;
+    HttpPool_Handle_TypeDef** other = is_alt ? &request->handle :
+                                      &request->alt_handle;
+
+    if (result != CURLE_OK) {
+        // Wait for (or fail over to) the other endpoint
+        bool failover = !is_alt && request->alt_url != NULL &&
+                        !request->hedged;
+        if (*other != NULL || failover) {
+            log_warn("%s request failed (%s). Waiting for %s.\n",
+                     is_alt ? request->alt_host : request->host,
+                     curl_easy_strerror(result),
+                     is_alt ? request->host : request->alt_host);
+            HttpPool_Release(*leg);
+            *leg = NULL;
+            if (failover) request->hedge_at = 0.0;
+            return;
+        }
+
+        // Throttled (429/503), send again once the host has backed off
+        if (throttled && request->attempts < RATE_LIMIT_MAX_RETRIES) {
+            request->attempts++;
+            curl_slist_free_all(request->cache_headers);
+            request->cache_headers = NULL;
+            HttpPool_Release(*leg);
+            *leg = NULL;
+            request->hedged = false;
+            batch->states[index] = FETCH_STATE_PENDING;
+            if (index < batch->first_pending) batch->first_pending = index;
+            return;
+        }
+    } else if (*other != NULL) {
+        // First answer wins
+        Fetch_Cancel(batch, request, !is_alt);
+    }
+
+    if (is_alt) {
+        HttpPool_Release(request->handle);
+        request->handle = request->alt_handle;
+        request->alt_handle = NULL;
+        request->used_alt = true;
+    }
+
+    batch->states[index] = FETCH_STATE_DONE;
+    Fetch_Complete(batch, request, result);
+    batch->completed++;
+}
+
+static void Fetch_Cancel(Fetch_Batch_TypeDef* batch,
+                         Fetch_Request_TypeDef* request, bool alt) {
+    HttpPool_Handle_TypeDef** handle = alt ? &request->alt_handle :
+                                       &request->handle;
+    const char* host = alt ? request->alt_host : request->host;
+    double started = alt ? request->alt_started : request->started;
+
+    curl_multi_remove_handle(batch->multi, (*handle)->curl);
+    RateLimit_Release(host, NULL, CURLE_OK);
+    RateLimit_RecordLatency(host, Fetch_Now() - started);
+
+    if (!alt) {
+        Fetch_Host_TypeDef* state = Fetch_GetHost(batch->hosts,
+                                                  &batch->n_hosts, host);
+        if (state != NULL && state->in_flight > 0) state->in_flight--;
+    }
+
+    HttpPool_Release(*handle);
+    *handle = NULL;
+    batch->running--;
+}
+
+static void Fetch_OrderEndpoints(Fetch_Request_TypeDef* request) {
+    if (request->ordered || !request->prefer_faster ||
+        request->alt_url == NULL) {
+        return;
+    }
+    request->ordered = true;
+
+    // Kept as given until both hosts have enough latency samples
+    double p50 = RateLimit_LatencyPercentile(request->host, 50.0);
+    double alt_p50 = RateLimit_LatencyPercentile(request->alt_host, 50.0);
+    if (p50 >= 0.0 && alt_p50 >= 0.0 && alt_p50 < p50) {
+        Fetch_SwapEndpoints(request);
+    }
+}
+
+static void Fetch_SwapEndpoints(Fetch_Request_TypeDef* request) {
+    const char* url = request->url;
+    request->url = request->alt_url;
+    request->alt_url = url;
+
+    struct curl_slist* headers = request->headers;
+    request->headers = request->alt_headers;
+    request->alt_headers = headers;
+
+    char host[FETCH_HOST_SIZE];
+    memcpy(host, request->host, sizeof(host));
+    memcpy(request->host, request->alt_host, sizeof(host));
+    memcpy(request->alt_host, host, sizeof(host));
+
+    request->swapped = !request->swapped;
+}
+
+static int8_t Fetch_Start(CURLM* multi, Fetch_Request_TypeDef* request) {
+    request->handle = HttpPool_Acquire();
+    if (request->handle == NULL) {
+        return -1;
+    }
+
+    CURL* curl = request->handle->curl;
+    curl_easy_setopt(curl, CURLOPT_URL, request->url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    if (request->body != NULL) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->body);
+    }
+    if (request->on_data != NULL && request->alt_url == NULL) {
+        request->keep_body = Cache_Enabled() ||
+                             Transport_Mode() == TRANSPORT_RECORD;
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Fetch_WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) request);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA,
+                         (void *) &request->handle->buffer);
+    }
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *) request);
+
+    // Revalidate cached copies (FTP files are checked with MDTM/SIZE first)
+    Cache_Lookup(&request->cache, request->url, request->body);
+    request->cache_headers = Cache_Setup(&request->cache, curl,
+                                         request->headers);
+    request->probing = request->cache.ftp && request->cache.found;
+    if (request->probing) {
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    }
+
+    // Time to hedge if there is no answer
+    request->started = Fetch_Now();
+    if (request->alt_url != NULL) {
+        double delay = request->hedge_after_ms / 1000.0;
+        if (request->hedge_after_ms == 0) {
+            delay = RateLimit_LatencyPercentile(request->host,
+                                                FETCH_HEDGE_PERCENTILE);
+            if (delay < 0.0) delay = FETCH_DEFAULT_HEDGE_MS / 1000.0;
+        }
+        request->hedge_at = request->started + delay;
+    }
+
+    if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+        log_error("Unable to add request to cURL multi handle: %s\n",
+                  request->url);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int8_t Fetch_StartAlt(CURLM* multi, Fetch_Request_TypeDef* request) {
+    request->alt_handle = HttpPool_Acquire();
+    if (request->alt_handle == NULL) {
+        return -1;
+    }
+
+    // Not cached, the primary request owns the cache entry
+    CURL* curl = request->alt_handle->curl;
+    curl_easy_setopt(curl, CURLOPT_URL, request->alt_url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->alt_headers);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    if (request->body != NULL) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->body);
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA,
+                     (void *) &request->alt_handle->buffer);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *) request);
+    request->alt_started = Fetch_Now();
+
+    if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+        log_error("Unable to add request to cURL multi handle: %s\n",
+                  request->alt_url);
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool Fetch_ProbeComplete(CURLM* multi, Fetch_Request_TypeDef* request,
+                                CURLcode* result) {
+    CURL* curl = request->handle->curl;
+    request->probing = false;
+
+    if (*result == CURLE_OK &&
+        Cache_ProbeUnchanged(&request->cache, curl, &request->handle->buffer)) {
+        return false;
+    }
+
+    // Download the file on the same handle (and control connection)
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    Utils_ReqDataReset(&request->handle->buffer, curl);
+    if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+        log_error("Unable to add request to cURL multi handle: %s\n",
+                  request->url);
+        *result = CURLE_FAILED_INIT;
+        return false;
+    }
+
+    return true;
+}
+
+static void Fetch_Complete(Fetch_Batch_TypeDef* batch,
+                           Fetch_Request_TypeDef* request, CURLcode result) {
+    if (result != CURLE_OK) {
+        log_error("Curl request failed: %s (%s)\n",
+                  curl_easy_strerror(result), request->url);
+    }
+
+    if (request->handle != NULL && !request->used_alt &&
+        !request->handle->buffer.not_modified) {
+        Cache_Finish(&request->cache, request->handle->curl, result,
+                     &request->handle->buffer);
+    }
+    curl_slist_free_all(request->cache_headers);
+    request->cache_headers = NULL;
+
+    if (request->handle != NULL) {
+        Transport_Record(request->used_alt ? request->alt_url : request->url,
+                         request->body, request->handle->curl, result,
+                         &request->handle->buffer);
+    }
+
+    // Callback sees the request as it was given
+    if (request->swapped) {
+        Fetch_SwapEndpoints(request);
+        request->used_alt = !request->used_alt;
+    }
+
+    // Callback borrows the pooled buffer (there is none if the start failed)
+    if (request->on_complete != NULL) {
+        Utils_ReqData_TypeDef empty = {0};
+        double started = Transport_Now();
+        request->on_complete(request, result,
+                             (request->handle != NULL) ?
+                             &request->handle->buffer : &empty);
+        batch->callback_time += Transport_Now() - started;
+    }
+
+    HttpPool_Release(request->handle);
+    request->handle = NULL;
+}
+
+static size_t Fetch_WriteCallback(void* contents, size_t size, size_t nmemb,
+                                  void* userp) {
+    Fetch_Request_TypeDef* request = (Fetch_Request_TypeDef*) userp;
+    size_t realsize = size * nmemb;
+
+    // cURL passes the file time and size lines of an FTP probe as data
+    if (request->probing) {
+        return realsize;
+    }
+
+    if (request->on_data(request, contents, realsize) != realsize) {
+        return 0;
+    }
+
+    // Cache and corpus need the whole body
+    if (request->keep_body) {
+        return WriteMemoryCallback(contents, size, nmemb,
+                                   &request->handle->buffer);
+    }
+
+    return realsize;
+}
+
+static int8_t Fetch_Replay(Fetch_Batch_TypeDef* batch) {
+    Utils_ReqData_TypeDef buffer;
+    if (Utils_ReqDataInit(&buffer, NULL) != 0) {
+        return -1;
+    }
+
+    log_info("Replaying %zu requests (%d at a time).\n", batch->n_requests,
+             batch->opts.max_total);
+
+    for (size_t i = 0; i < batch->n_requests; i++) {
+        // Requests in the same group share one injected latency
+        if (i % batch->opts.max_total == 0) {
+            Transport_InjectLatency();
+        }
+
+        // Hedged requests were recorded under the URL that answered
+        Fetch_Request_TypeDef* request = &batch->requests[i];
+        request->used_alt = request->alt_url != NULL &&
+                            !Transport_Recorded(request->url, request->body);
+        CURLcode result = Transport_Load(request->used_alt ?
+                                         request->alt_url : request->url,
+                                         request->body, &buffer);
+
+        bool restored = result == CURLE_OK &&
+                        Fetch_ReplayProbe(request, &buffer);
+
+        if (result == CURLE_OK && !restored && request->on_data != NULL &&
+            request->alt_url == NULL &&
+            request->on_data(request, buffer.memory, buffer.size) !=
+            buffer.size) {
+            result = CURLE_WRITE_ERROR;
+        }
+        if (request->cache.ftp && !restored) {
+            Cache_Finish(&request->cache, NULL, result, &buffer);
+        }
+
+        if (request->on_complete != NULL) {
+            request->on_complete(request, result, &buffer);
+        }
+    }
+
+    free(buffer.memory);
+
+    return 0;
+}
+
+static bool Fetch_ReplayProbe(Fetch_Request_TypeDef* request,
+                              Utils_ReqData_TypeDef* data) {
+    if (strncasecmp(request->url, "ftp://", 6) != 0 ||
+        !Cache_Lookup(&request->cache, request->url, request->body)) {
+        return false;
+    }
+
+    // Lines cURL emulates for a NOBODY transfer of an unchanged file
+    if (request->on_data != NULL) {
+        char lines[FETCH_PROBE_LINES_SIZE];
+        int length = snprintf(lines, sizeof(lines),
+                              "Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT"
+                              "\r\nContent-Length: %zu\r\n"
+                              "Accept-ranges: bytes\r\n", data->size);
+        request->probing = true;
+        Fetch_WriteCallback(lines, 1, (size_t)length, request);
+        request->probing = false;
+    }
+
+    return Cache_ProbeUnchanged(&request->cache, NULL, data);
+}
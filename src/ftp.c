@@ -6,28 +6,77 @@
  * This FTP request is required to communicate with the Buerau of Meterology
  * FTP server. A URL is provided (denoting the base ftp server name and the
  * path to the file of interest). A stream is also give to hold the raw data
- * provided from this FTP request.
+ * provided from this FTP request. The cURL handle is taken from the handle
+ * pool so the control connection to the FTP server is reused between calls.
+ * If the response cache is enabled (see cache.h) and the remote file time and
+ * size match the cached copy, the download is skipped and the cached copy is
+ * returned (with `not_modified` set). In record or replay mode (see
+ * transport.h) the file is saved to or served from the corpus.
  *
  * @param url URL to file of interest on FTP server.
  * @param stream Stream to hold data from response (see utils.h).
  * @return Curl status code representing FTP errors.
  */
 CURLcode FTPRequest(const char *url, Utils_ReqData_TypeDef *stream) {
-    CURL *curl = curl_easy_init();
+    stream->memory = NULL;
+    stream->size = 0;
 
-    curl_easy_setopt(curl, CURLOPT_URL, url);
+    HttpPool_Handle_TypeDef *handle = HttpPool_Acquire();
+    if (!handle) {
+        log_error("Curl not found. Exiting.\n");
+        return CURLE_FUNCTION_NOT_FOUND;
+    }
 
-    stream->memory = malloc(1);
-    stream->size = 0;
+    // Served from the corpus, no network access
+    if (Transport_Mode() == TRANSPORT_REPLAY) {
+        CURLcode replayed = Transport_Replay(url, NULL, &handle->buffer);
+        HttpPool_DetachBuffer(handle, stream);
+        HttpPool_Release(handle);
+        return replayed;
+    }
+
+    CURL *curl = handle->curl;
+    curl_easy_setopt(curl, CURLOPT_URL, url);
 
     curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) stream);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &handle->buffer);
 
-    CURLcode result = curl_easy_perform(curl);
+    Cache_Entry_TypeDef cache;
+    Cache_Lookup(&cache, url, NULL);
+    Cache_Setup(&cache, curl, NULL);
 
-    curl_easy_cleanup(curl);
+    char host[RATE_LIMIT_HOST_SIZE];
+    RateLimit_ParseHost(url, host, sizeof(host));
+
+    CURLcode result = CURLE_OK;
+    bool unchanged = false;
+    double started = Transport_Now();
+    if (cache.found) {
+        // Only ask for the file time (MDTM) and size (SIZE)
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        RateLimit_Acquire(host);
+        result = curl_easy_perform(curl);
+        HttpPool_RecordTransfer(curl);
+        RateLimit_Release(host, curl, result);
+        unchanged = (result == CURLE_OK) &&
+                    Cache_ProbeUnchanged(&cache, curl, &handle->buffer);
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    }
+
+    if (!unchanged) {
+        Utils_ReqDataReset(&handle->buffer, curl);
+        RateLimit_Acquire(host);
+        result = curl_easy_perform(curl);
+        HttpPool_RecordTransfer(curl);
+        RateLimit_Release(host, curl, result);
+        Cache_Finish(&cache, curl, result, &handle->buffer);
+    }
+    Transport_AddNetworkTime(Transport_Now() - started);
+    Transport_Record(url, NULL, curl, result, &handle->buffer);
+
+    HttpPool_DetachBuffer(handle, stream);
+    HttpPool_Release(handle);
 
     return result;
 }
-
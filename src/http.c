@@ -1,11 +1,21 @@
 #include "http.h"
 
+/// Perform a request on a pooled handle (response is left in its buffer)
+static CURLcode HttpPerform(HttpPool_Handle_TypeDef *handle, const char *URL,
+                            struct curl_slist *headers, int8_t post,
+                            const char *body);
+
 /**
  * Basic HTTP request using CURL.
  *
  * Most initialisation is done outside of this function. This function just
  * handles the HTTP request and puts the data inside a provided cJSON
- * object. Note this function has a memory leak on a Mac M1 ->
+ * object. The cURL handle is taken from the handle pool (see http_pool.h) so
+ * consecutive requests to the same host reuse DNS, TLS and connection state.
+ * If the response cache is enabled (see cache.h) unchanged responses are
+ * revalidated rather than downloaded again. In record or replay mode (see
+ * transport.h) the response is saved to or served from the corpus.
+ * Note this function has a memory leak on a Mac M1 ->
  * (curl_easy_perform()) has 13 leaks, totalling 496 bytes per call.
  *
  * @code
@@ -34,12 +44,87 @@
 CURLcode HttpRequest(cJSON **response, const char *URL,
                      struct curl_slist *headers, int8_t post, const char *body) {
 
-    CURL *curl = curl_easy_init();
-    if (!curl) {
+    HttpPool_Handle_TypeDef *handle = HttpPool_Acquire();
+    if (!handle) {
         log_error("Curl not found. Exiting.\n");
         return CURLE_FUNCTION_NOT_FOUND;
     }
 
+    CURLcode result = HttpPerform(handle, URL, headers, post, body);
+
+    if (result == CURLE_OK) {
+        // Parsed straight from the pooled buffer (no copy). Length is already
+        // known so cJSON doesn't need to scan for it.
+        *response = cJSON_ParseWithLength(handle->buffer.memory,
+                                          handle->buffer.size);
+    }
+
+    HttpPool_Release(handle);
+
+    return result;
+}
+
+/**
+ * Basic HTTP request using CURL which hands the raw response to the caller.
+ *
+ * The response buffer and its length are given to the caller instead of
+ * being parsed. This lets parsers borrow the bytes (e.g. parse in place or
+ * use cJSON_ParseWithLength()) rather than copying and rescanning them. The
+ * buffer is always null-terminated and must be freed by the caller, even if
+ * the request fails.
+ *
+ * @code
+ *      Utils_ReqData_TypeDef response;
+ *      CURLcode result = HttpRequestRaw(&response, URL, headers, 0, NULL);
+ *      if (result == CURLE_OK) {
+ *          cJSON *json = cJSON_ParseWithLength(response.memory,
+ *                                              response.size);
+ *          ...
+ *      }
+ *      free(response.memory);
+ * @endcode
+ *
+ * @param response Response buffer and length to populate.
+ * @param URL The request URL.
+ * @param headers Headers to include in request.
+ * @param post Interger flag to request POST request (set to 1).
+ * @param body POST request body.
+ * @return Status code representing the response status.
+ */
+CURLcode HttpRequestRaw(Utils_ReqData_TypeDef *response, const char *URL,
+                        struct curl_slist *headers, int8_t post,
+                        const char *body) {
+
+    response->memory = NULL;
+    response->size = 0;
+
+    HttpPool_Handle_TypeDef *handle = HttpPool_Acquire();
+    if (!handle) {
+        log_error("Curl not found. Exiting.\n");
+        return CURLE_FUNCTION_NOT_FOUND;
+    }
+
+    CURLcode result = HttpPerform(handle, URL, headers, post, body);
+
+    // Response outlives the handle so the caller takes the buffer
+    HttpPool_DetachBuffer(handle, response);
+    HttpPool_Release(handle);
+
+    return result;
+}
+
+static CURLcode HttpPerform(HttpPool_Handle_TypeDef *handle, const char *URL,
+                            struct curl_slist *headers, int8_t post,
+                            const char *body) {
+
+    // Served from the corpus, no network access
+    if (Transport_Mode() == TRANSPORT_REPLAY) {
+        return Transport_Replay(URL, (post == 1) ? body : NULL,
+                                &handle->buffer);
+    }
+
+    CURL *curl = handle->curl;
+
     curl_easy_setopt(curl, CURLOPT_URL, URL);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT); // Needed sometimes
@@ -50,24 +135,38 @@ CURLcode HttpRequest(cJSON **response, const char *URL,
         curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
     }
 
-    Utils_ReqData_TypeDef chunk;
-    chunk.memory = malloc(1);
-    chunk.size = 0;
-
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &chunk);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &handle->buffer);
+
+    // Revalidate a cached copy rather than downloading it again
+    Cache_Entry_TypeDef cache;
+    Cache_Lookup(&cache, URL, (post == 1) ? body : NULL);
+    struct curl_slist *cache_headers = Cache_Setup(&cache, curl, headers);
 
-    CURLcode result = curl_easy_perform(curl);
+    // Held to the providers quota, sent again if throttled (429/503)
+    char host[RATE_LIMIT_HOST_SIZE];
+    RateLimit_ParseHost(URL, host, sizeof(host));
+    CURLcode result;
+    uint8_t attempts = 0;
+    double started = Transport_Now();
+    do {
+        Utils_ReqDataReset(&handle->buffer, curl);
+        RateLimit_Acquire(host);
+        result = curl_easy_perform(curl);
+        HttpPool_RecordTransfer(curl);
+    } while (RateLimit_Release(host, curl, result) &&
+             attempts++ < RATE_LIMIT_MAX_RETRIES);
+    Transport_AddNetworkTime(Transport_Now() - started);
 
     if (result != CURLE_OK) {
         log_error("Curl request failed: %s\n",
                   curl_easy_strerror(result));
-    } else {
-        *response = cJSON_Parse(chunk.memory);
     }
 
-    free(chunk.memory);
-    curl_easy_cleanup(curl);
+    Cache_Finish(&cache, curl, result, &handle->buffer);
+    curl_slist_free_all(cache_headers);
+    Transport_Record(URL, (post == 1) ? body : NULL, curl, result,
+                     &handle->buffer);
 
     return result;
 }
@@ -0,0 +1,305 @@
+#include "http_pool.h"
+
+/// Pool of idle easy handles which all use the same cURL share object
+static struct {
+    bool initialised; ///< Set once HttpPool_Init() has succeeded
+    CURLSH* share; ///< Shared DNS, TLS session and connection cache
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST]; ///< One lock per data
+    pthread_mutex_t lock; ///< Protects the idle list and statistics
+    HttpPool_Handle_TypeDef* idle[HTTP_POOL_SIZE]; ///< Idle handles
+    uint16_t idle_count; ///< Number of idle handles
+    HttpPool_Stats_TypeDef stats; ///< Transfer statistics
+} HttpPool;
+
+/// Free a handle and its response buffer
+static void HttpPool_Free(HttpPool_Handle_TypeDef* handle);
+
+/// Lock callback required by cURL to share data between handles
+static void HttpPool_ShareLock(CURL* handle, curl_lock_data data,
+                               curl_lock_access access, void* userptr);
+
+/// Unlock callback required by cURL to share data between handles
+static void HttpPool_ShareUnlock(CURL* handle, curl_lock_data data,
+                                 void* userptr);
+
+/**
+ * Initialise the cURL handle pool.
+ *
+ * Creates a cURL share object holding the DNS cache, TLS session cache and
+ * connection cache. Every handle obtained from HttpPool_Acquire() uses this
+ * share, so back-to-back requests to the same host (e.g. one request per
+ * station to ftp.bom.gov.au) reuse an already open connection instead of
+ * performing a new DNS lookup, TCP handshake and TLS negotiation.
+ *
+ * @code
+ * curl_global_init(CURL_GLOBAL_ALL);
+ * HttpPool_Init();
+ * ... // HttpRequest() and FTPRequest() now use pooled handles
+ * HttpPool_Cleanup();
+ * curl_global_cleanup();
+ * @endcode
+ *
+ * @note Must be called after curl_global_init().
+ *
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t HttpPool_Init(void) {
+    if (HttpPool.initialised) {
+        return 0;
+    }
+
+    HttpPool.share = curl_share_init();
+    if (HttpPool.share == NULL) {
+        log_error("Unable to create cURL share object.\n");
+        return -1;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&HttpPool.share_locks[i], NULL);
+    }
+    pthread_mutex_init(&HttpPool.lock, NULL);
+
+    curl_share_setopt(HttpPool.share, CURLSHOPT_LOCKFUNC, HttpPool_ShareLock);
+    curl_share_setopt(HttpPool.share, CURLSHOPT_UNLOCKFUNC,
+                      HttpPool_ShareUnlock);
+    curl_share_setopt(HttpPool.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(HttpPool.share, CURLSHOPT_SHARE,
+                      CURL_LOCK_DATA_SSL_SESSION);
+    if (curl_share_setopt(HttpPool.share, CURLSHOPT_SHARE,
+                          CURL_LOCK_DATA_CONNECT) != CURLSHE_OK) {
+        log_warn("cURL connection cache cannot be shared. Only DNS and TLS "
+                 "sessions will be reused.\n");
+    }
+
+    HttpPool.idle_count = 0;
+    memset(&HttpPool.stats, 0, sizeof(HttpPool.stats));
+    HttpPool.initialised = true;
+
+    log_info("cURL handle pool initialised.\n");
+
+    return 0;
+}
+
+/**
+ * Free all idle handles and the shared cache.
+ *
+ * @note All handles must have been returned with HttpPool_Release().
+ */
+void HttpPool_Cleanup(void) {
+    if (!HttpPool.initialised) {
+        return;
+    }
+
+    pthread_mutex_lock(&HttpPool.lock);
+    for (uint16_t i = 0; i < HttpPool.idle_count; i++) {
+        HttpPool_Free(HttpPool.idle[i]);
+        HttpPool.idle[i] = NULL;
+    }
+    HttpPool.idle_count = 0;
+    HttpPool.initialised = false;
+    pthread_mutex_unlock(&HttpPool.lock);
+
+    curl_share_cleanup(HttpPool.share);
+    HttpPool.share = NULL;
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&HttpPool.share_locks[i]);
+    }
+    pthread_mutex_destroy(&HttpPool.lock);
+}
+
+/**
+ * Take an easy handle from the pool.
+ *
+ * An idle handle is returned if one is available, otherwise a new handle is
+ * created and attached to the shared cache. Each handle carries a response
+ * buffer which keeps its allocation between requests, so responses of a
+ * similar size don't need to be grown again. If the pool has not been
+ * initialised a plain (unshared) handle is returned.
+ *
+ * @code
+ * HttpPool_Handle_TypeDef* handle = HttpPool_Acquire();
+ * curl_easy_setopt(handle->curl, CURLOPT_URL, url);
+ * curl_easy_setopt(handle->curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+ * curl_easy_setopt(handle->curl, CURLOPT_WRITEDATA, &handle->buffer);
+ * curl_easy_perform(handle->curl);
+ * HttpPool_RecordTransfer(handle->curl);
+ * ... // Use handle->buffer
+ * HttpPool_Release(handle);
+ * @endcode
+ *
+ * @return Pooled handle (with an empty response buffer) or NULL on error.
+ */
+HttpPool_Handle_TypeDef* HttpPool_Acquire(void) {
+    HttpPool_Handle_TypeDef* handle = NULL;
+
+    if (HttpPool.initialised) {
+        pthread_mutex_lock(&HttpPool.lock);
+        if (HttpPool.idle_count > 0) {
+            handle = HttpPool.idle[--HttpPool.idle_count];
+        }
+        pthread_mutex_unlock(&HttpPool.lock);
+    }
+
+    if (handle == NULL) {
+        handle = calloc(1, sizeof(HttpPool_Handle_TypeDef));
+        if (handle == NULL) {
+            log_error("Not enough memory to hold cURL handle.\n");
+            return NULL;
+        }
+
+        handle->curl = curl_easy_init();
+        if (handle->curl == NULL) {
+            log_error("Unable to create cURL easy handle.\n");
+            free(handle);
+            return NULL;
+        }
+
+        if (HttpPool.initialised) {
+            curl_easy_setopt(handle->curl, CURLOPT_SHARE, HttpPool.share);
+            pthread_mutex_lock(&HttpPool.lock);
+            HttpPool.stats.handles_created++;
+            pthread_mutex_unlock(&HttpPool.lock);
+        }
+    }
+
+    // Buffer may have been detached (or freed) by the previous user
+    if (handle->buffer.memory == NULL) {
+        if (Utils_ReqDataInit(&handle->buffer, handle->curl) != 0) {
+            HttpPool_Free(handle);
+            return NULL;
+        }
+    } else {
+        Utils_ReqDataReset(&handle->buffer, handle->curl);
+    }
+
+    return handle;
+}
+
+/**
+ * Return an easy handle to the pool.
+ *
+ * The handles options are reset (headers, URL, callbacks etc.) but its
+ * connections and share remain attached so the next request can reuse them.
+ * The response buffer is kept unless it has grown larger than
+ * HTTP_POOL_MAX_BUFFER_SIZE. If the pool is full the handle is freed.
+ *
+ * @param handle Handle obtained from HttpPool_Acquire().
+ */
+void HttpPool_Release(HttpPool_Handle_TypeDef* handle) {
+    if (handle == NULL) {
+        return;
+    }
+
+    if (!HttpPool.initialised) {
+        HttpPool_Free(handle);
+        return;
+    }
+
+    if (handle->buffer.capacity > HTTP_POOL_MAX_BUFFER_SIZE) {
+        free(handle->buffer.memory);
+        handle->buffer.memory = NULL;
+        handle->buffer.capacity = 0;
+    }
+
+    curl_easy_reset(handle->curl);
+    curl_easy_setopt(handle->curl, CURLOPT_SHARE, HttpPool.share);
+
+    pthread_mutex_lock(&HttpPool.lock);
+    if (HttpPool.idle_count < HTTP_POOL_SIZE) {
+        HttpPool.idle[HttpPool.idle_count++] = handle;
+        handle = NULL;
+    }
+    pthread_mutex_unlock(&HttpPool.lock);
+
+    if (handle != NULL) {
+        HttpPool_Free(handle);
+    }
+}
+
+/**
+ * Take ownership of a handles response buffer.
+ *
+ * Used when the response needs to outlive the handle (e.g. HttpRequestRaw()).
+ * The caller must free data->memory. The handle allocates a new buffer the
+ * next time it is acquired.
+ *
+ * @param handle Handle holding the response.
+ * @param data Response buffer to populate.
+ */
+void HttpPool_DetachBuffer(HttpPool_Handle_TypeDef* handle,
+                           Utils_ReqData_TypeDef* data) {
+    *data = handle->buffer;
+    data->curl = NULL;
+    handle->buffer.memory = NULL;
+    handle->buffer.size = 0;
+    handle->buffer.capacity = 0;
+    handle->buffer.expected = 0;
+}
+
+static void HttpPool_Free(HttpPool_Handle_TypeDef* handle) {
+    curl_easy_cleanup(handle->curl);
+    free(handle->buffer.memory);
+    free(handle);
+}
+
+/**
+ * Update pool statistics after a transfer.
+ *
+ * cURL reports the number of new connections a transfer had to open. A value
+ * of zero means an existing (warm) connection was reused.
+ *
+ * @param curl Handle that has just completed a transfer.
+ */
+void HttpPool_RecordTransfer(CURL* curl) {
+    long n_connects = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &n_connects) !=
+        CURLE_OK) {
+        return;
+    }
+
+    pthread_mutex_lock(&HttpPool.lock);
+    HttpPool.stats.requests++;
+    if (n_connects == 0) {
+        HttpPool.stats.reused++;
+    }
+    pthread_mutex_unlock(&HttpPool.lock);
+}
+
+/**
+ * Get a copy of the current pool statistics.
+ *
+ * @return Pool statistics.
+ */
+HttpPool_Stats_TypeDef HttpPool_GetStats(void) {
+    HttpPool_Stats_TypeDef stats;
+    pthread_mutex_lock(&HttpPool.lock);
+    stats = HttpPool.stats;
+    pthread_mutex_unlock(&HttpPool.lock);
+    return stats;
+}
+
+/**
+ * Log how many requests reused a warm connection.
+ */
+void HttpPool_LogStats(void) {
+    HttpPool_Stats_TypeDef stats = HttpPool_GetStats();
+    log_info("cURL pool: %u requests, %u reused a connection, "
+             "%u handles created.\n", stats.requests, stats.reused,
+             stats.handles_created);
+}
+
+static void HttpPool_ShareLock(CURL* handle, curl_lock_data data,
+                               curl_lock_access access, void* userptr) {
+    (void)handle;
+    (void)access;
+    (void)userptr;
+    pthread_mutex_lock(&HttpPool.share_locks[data]);
+}
+
+static void HttpPool_ShareUnlock(CURL* handle, curl_lock_data data,
+                                 void* userptr) {
+    (void)handle;
+    (void)userptr;
+    pthread_mutex_unlock(&HttpPool.share_locks[data]);
+}
@@ -3,6 +3,12 @@
 int main(void) {
 
     curl_global_init(CURL_GLOBAL_ALL);
+    if (Transport_Init() != 0) {
+        return 1;
+    }
+    Transaction_Init();
+    HttpPool_Init();
+    Cache_Init(CACHE_DEFAULT_DIRECTORY);
 
     // Connect to postgres
     PGconn* psql_conn;
@@ -15,30 +21,58 @@ int main(void) {
         return 1;
     }
 
+    // Network and processing time of each stage (see transport.h)
+    Transport_Stage_TypeDef stage;
+
+    Transport_StageBegin(&stage, "Harvest areas");
     FA_HarvestAreas_TypeDef harvest_areas = {0};
     FA_GetHarvestAreas(&harvest_areas);
     FA_HarvestAreasToDB(&harvest_areas, psql_conn);
     FA_CreateLocationsLookupDB(psql_conn);
 
     T_LocationsLookup_TypeDef locations;
-    FA_UniqueLocationsFromDB(&locations, psql_conn);
+    FA_UniqueLocations(&locations, psql_conn);
+    Transport_StageEnd(&stage);
 
     //// BUILD BOM TIMESERIES DATASET
+    //Transport_StageBegin(&stage, "BOM timeseries");
+    //BOM_SetCSVArchive(BOM_CSV_ARCHIVE_DIRECTORY); // Keep .csv files on disk
     //const char* start_dt = "2022-08-01";
-    //BOM_TimeseriesToDB(start_dt, psql_conn);
+    //BOM_TimeseriesToDB(start_dt, BOM_SYNC_INCREMENTAL, psql_conn);
+    //Transport_StageEnd(&stage);
 
     ////// BUILD IBM TIMESERIES DATASET
     //const char* start_time = "2022-08-01";
     //const char* end_time = "2022-11-01";
+    //Transport_StageBegin(&stage, "IBM timeseries");
     //IBM_BuildTSDatabase(&locations, start_time, end_time, psql_conn);
+    //Transport_StageEnd(&stage);
 
     //// BUILD COMBINED WEATHER INFORMATION
     //T_BuildWeatherDB(&locations, psql_conn);
+    //T_MergeWeatherDB(psql_conn, T_ALL_PROGRAMS); // Server side, changes only
 
     // BUILD HARVEST AREA OUTLOOK
     //T_FloodPrediction(psql_conn);
 
+    //// BENCHMARK RESPONSE BUFFERS (replays downloaded BOM files)
+    //Bench_WriteCallback("datasets/bom/historical", 20);
+
+    //// BENCHMARK STATION DISTANCES (scalar vs batched)
+    //Bench_PointsDistance(BOM_STATIONS_FILE, 100);
+
+    //// CHECK CACHED BOM MONTHS STILL YIELD ROWS (replay mode only)
+    //Bench_CachedMonths(TRANSPORT_DEFAULT_CORPUS, "tmp/bench-cache");
+
+    BOM_WaitForCSVArchive();
+    BOM_UnmapStations();
+    Statements_Forget(psql_conn);
     PQfinish(psql_conn);
+    HttpPool_LogStats();
+    Cache_LogStats();
+    RateLimit_LogStats();
+    Transaction_LogStats();
+    HttpPool_Cleanup();
     curl_global_cleanup();
 
     return 0;
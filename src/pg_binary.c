@@ -0,0 +1,542 @@
+#include "pg_binary.h"
+
+/// Claim the next parameter (-1 if there are already PG_BINARY_MAX_PARAMS)
+static int PGBinary_Next(PGBinary_Params_TypeDef* params);
+
+/// Store the low `size` bytes of a value in network byte order
+static void PGBinary_Put(char* data, uint64_t value, int size);
+
+/// Add a one dimensional array parameter of 8 byte elements (returns the
+/// first element, NULL on error)
+static char* PGBinary_AddArray(PGBinary_Params_TypeDef* params, uint32_t oid,
+                               int count, Arena_TypeDef* arena);
+
+/// Read `size` bytes stored in network byte order
+static uint64_t PGBinary_Get(const char* data, int size);
+
+/**
+ * Remove all parameters.
+ *
+ * Text formatting every float, integer and timestamp (and parsing them back
+ * out of results) is slow and lossy (e.g. "%f" into a 10 byte buffer). These
+ * parameters are sent in libpq binary format instead: float8, int4 and
+ * timestamptz values are copied in network byte order and text is sent as
+ * is. The same parameters are used as the row of a binary COPY (see
+ * Bulk_AddRow()).
+ *
+ * Binary parameters must match the type the server expects exactly, so
+ * placeholders should be cast (e.g. $1::float8, $2::int, $3::timestamptz).
+ *
+ * @code
+ * PGBinary_Params_TypeDef params;
+ * PGBinary_Reset(&params);
+ * PGBinary_AddFloat8(&params, 1.2);
+ * PGBinary_AddInt4(&params, program_id);
+ * PGBinary_AddTimestamp(&params, time(NULL));
+ * PGresult* res = PGBinary_ExecPrepared(psql_conn, "UpdateRow", &params);
+ * @endcode
+ *
+ * @param params Parameters to reset.
+ */
+void PGBinary_Reset(PGBinary_Params_TypeDef* params) {
+    params->count = 0;
+}
+
+/**
+ * Add a float8 parameter.
+ *
+ * @param params Parameters to add to.
+ * @param value Value.
+ * @return Error code. 0 = OK ... -1 = ERROR (too many parameters)
+ */
+int8_t PGBinary_AddFloat8(PGBinary_Params_TypeDef* params, double value) {
+    int i = PGBinary_Next(params);
+    if (i < 0) {
+        return -1;
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PGBinary_Put(params->data[i], bits, 8);
+    params->values[i] = params->data[i];
+    params->lengths[i] = 8;
+    params->formats[i] = 1;
+    return 0;
+}
+
+/**
+ * Add an int4 parameter.
+ *
+ * @param params Parameters to add to.
+ * @param value Value.
+ * @return Error code. 0 = OK ... -1 = ERROR (too many parameters)
+ */
+int8_t PGBinary_AddInt4(PGBinary_Params_TypeDef* params, int32_t value) {
+    int i = PGBinary_Next(params);
+    if (i < 0) {
+        return -1;
+    }
+
+    PGBinary_Put(params->data[i], (uint32_t)value, 4);
+    params->values[i] = params->data[i];
+    params->lengths[i] = 4;
+    params->formats[i] = 1;
+    return 0;
+}
+
+/**
+ * Add a timestamptz parameter.
+ *
+ * A binary timestamptz is the number of microseconds since 2000-01-01 UTC,
+ * so unlike a formatted string it doesn't depend on the time zone of the
+ * client or the server.
+ *
+ * @param params Parameters to add to.
+ * @param value UNIX time.
+ * @return Error code. 0 = OK ... -1 = ERROR (too many parameters)
+ */
+int8_t PGBinary_AddTimestamp(PGBinary_Params_TypeDef* params, time_t value) {
+    int i = PGBinary_Next(params);
+    if (i < 0) {
+        return -1;
+    }
+
+    int64_t usecs = ((int64_t)value - PG_BINARY_EPOCH_OFFSET) *
+                    PG_BINARY_USECS_PER_SEC;
+    PGBinary_Put(params->data[i], (uint64_t)usecs, 8);
+    params->values[i] = params->data[i];
+    params->lengths[i] = 8;
+    params->formats[i] = 1;
+    return 0;
+}
+
+/**
+ * Add a text parameter.
+ *
+ * The string isn't copied so it must be valid until the parameters are
+ * used. Text is sent in text format so it can also be cast by the server
+ * (e.g. $1::timestamptz for a timestamp string from an API).
+ *
+ * @param params Parameters to add to.
+ * @param value Value (NULL for NULL).
+ * @return Error code. 0 = OK ... -1 = ERROR (too many parameters)
+ */
+int8_t PGBinary_AddText(PGBinary_Params_TypeDef* params, const char* value) {
+    int i = PGBinary_Next(params);
+    if (i < 0) {
+        return -1;
+    }
+
+    params->values[i] = value;
+    params->lengths[i] = value == NULL ? 0 : (int)strlen(value);
+    params->formats[i] = 0;
+    return 0;
+}
+
+/**
+ * Add a NULL parameter.
+ *
+ * @param params Parameters to add to.
+ * @return Error code. 0 = OK ... -1 = ERROR (too many parameters)
+ */
+int8_t PGBinary_AddNull(PGBinary_Params_TypeDef* params) {
+    return PGBinary_AddText(params, NULL);
+}
+
+/**
+ * Add a float8[] parameter.
+ *
+ * Lets a whole series be sent as one parameter, e.g. to update every row of
+ * a program in one statement with unnest():
+ *
+ * @code
+ * PGBinary_AddTimestampArray(&params, timestamps, n_rows, &arena);
+ * PGBinary_AddFloat8Array(&params, sums, n_rows, &arena);
+ * // UPDATE weather SET sum_precip = u.value
+ * // FROM unnest($1::timestamptz[], $2::float8[]) AS u(ts, value) ...
+ * @endcode
+ *
+ * @param params Parameters to add to.
+ * @param values Elements.
+ * @param count Number of elements.
+ * @param arena Arena holding the encoded array until the parameters are used.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t PGBinary_AddFloat8Array(PGBinary_Params_TypeDef* params,
+                               const double* values, int count,
+                               Arena_TypeDef* arena) {
+    char* element = PGBinary_AddArray(params, PG_BINARY_OID_FLOAT8, count,
+                                      arena);
+    if (element == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint64_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        PGBinary_Put(element, PG_BINARY_VALUE_SIZE, 4);
+        PGBinary_Put(element + 4, bits, 8);
+        element += 4 + PG_BINARY_VALUE_SIZE;
+    }
+    return 0;
+}
+
+/**
+ * Add a timestamptz[] parameter.
+ *
+ * @param params Parameters to add to.
+ * @param values Elements (UNIX time).
+ * @param count Number of elements.
+ * @param arena Arena holding the encoded array until the parameters are used.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t PGBinary_AddTimestampArray(PGBinary_Params_TypeDef* params,
+                                  const int64_t* values, int count,
+                                  Arena_TypeDef* arena) {
+    char* element = PGBinary_AddArray(params, PG_BINARY_OID_TIMESTAMPTZ,
+                                      count, arena);
+    if (element == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int64_t usecs = (values[i] - PG_BINARY_EPOCH_OFFSET) *
+                        PG_BINARY_USECS_PER_SEC;
+        PGBinary_Put(element, PG_BINARY_VALUE_SIZE, 4);
+        PGBinary_Put(element + 4, (uint64_t)usecs, 8);
+        element += 4 + PG_BINARY_VALUE_SIZE;
+    }
+    return 0;
+}
+
+/**
+ * Add a value from a result as is.
+ *
+ * Passes a value straight from one statement to another without decoding
+ * it (e.g. a timestamp read from one table and written to another). The
+ * value keeps the format of the result, so the result column must be of
+ * the type the parameter expects. The value isn't copied so the result must
+ * not be cleared until the parameters are used.
+ *
+ * @param params Parameters to add to.
+ * @param res Query result.
+ * @param row Row of the value.
+ * @param column Column of the value.
+ * @return Error code. 0 = OK ... -1 = ERROR (too many parameters)
+ */
+int8_t PGBinary_AddValue(PGBinary_Params_TypeDef* params, const PGresult* res,
+                         int row, int column) {
+    int i = PGBinary_Next(params);
+    if (i < 0) {
+        return -1;
+    }
+
+    if (PQgetisnull(res, row, column)) {
+        params->values[i] = NULL;
+        params->lengths[i] = 0;
+        params->formats[i] = 0;
+        return 0;
+    }
+
+    params->values[i] = PQgetvalue(res, row, column);
+    params->lengths[i] = PQgetlength(res, row, column);
+    params->formats[i] = PQfformat(res, column);
+    return 0;
+}
+
+/**
+ * Run a statement with binary parameters and results.
+ *
+ * Results are returned in binary format, values should be read with the
+ * PGBinary_Get functions (text columns can still be read with PQgetvalue()).
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @param query Statement.
+ * @param params Parameters ($1, $2 ...) or NULL if there are none.
+ * @return Query result (cleared with PQclear()).
+ */
+PGresult* PGBinary_Exec(PGconn* psql_conn, const char* query,
+                        const PGBinary_Params_TypeDef* params) {
+    if (params == NULL) {
+        return PQexecParams(psql_conn, query, 0, NULL, NULL, NULL, NULL, 1);
+    }
+    return PQexecParams(psql_conn, query, params->count, NULL, params->values,
+                        params->lengths, params->formats, 1);
+}
+
+/**
+ * Run a prepared statement with binary parameters and results.
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @param stmt_name Prepared statement (see Statements_Prepare()).
+ * @param params Parameters ($1, $2 ...).
+ * @return Query result (cleared with PQclear()).
+ */
+PGresult* PGBinary_ExecPrepared(PGconn* psql_conn, const char* stmt_name,
+                                const PGBinary_Params_TypeDef* params) {
+    return PQexecPrepared(psql_conn, stmt_name, params->count, params->values,
+                          params->lengths, params->formats, 1);
+}
+
+/**
+ * Value of a float8 column.
+ *
+ * float4 columns and text format results are also accepted. NULL values
+ * (e.g. precipitation that hasn't been observed) are read as 0.
+ *
+ * @param res Query result.
+ * @param row Row of the value.
+ * @param column Column of the value.
+ * @return Value.
+ */
+double PGBinary_GetFloat8(const PGresult* res, int row, int column) {
+    if (PQgetisnull(res, row, column)) {
+        return 0;
+    }
+
+    const char* value = PQgetvalue(res, row, column);
+    if (PQfformat(res, column) == 0) {
+        return strtod(value, NULL);
+    }
+
+    switch (PQgetlength(res, row, column)) {
+        case 8: {
+            uint64_t bits = PGBinary_Get(value, 8);
+            double result;
+            memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+        case 4: {
+            uint32_t bits = (uint32_t)PGBinary_Get(value, 4);
+            float result;
+            memcpy(&result, &bits, sizeof(result));
+            return (double)result;
+        }
+        default:
+            log_error("Column %s is not a float.\n", PQfname(res, column));
+            return 0;
+    }
+}
+
+/**
+ * Value of an int4 column.
+ *
+ * Text format results are also accepted. NULL values are read as 0.
+ *
+ * @param res Query result.
+ * @param row Row of the value.
+ * @param column Column of the value.
+ * @return Value.
+ */
+int32_t PGBinary_GetInt4(const PGresult* res, int row, int column) {
+    if (PQgetisnull(res, row, column)) {
+        return 0;
+    }
+
+    const char* value = PQgetvalue(res, row, column);
+    if (PQfformat(res, column) == 0) {
+        return (int32_t)strtol(value, NULL, 10);
+    }
+
+    if (PQgetlength(res, row, column) != 4) {
+        log_error("Column %s is not an int4.\n", PQfname(res, column));
+        return 0;
+    }
+    return (int32_t)(uint32_t)PGBinary_Get(value, 4);
+}
+
+/**
+ * Value of a timestamptz column as UNIX time.
+ *
+ * Only binary results are accepted. Microseconds are truncated (rounded
+ * down) to the second. NULL values are read as 0.
+ *
+ * @param res Query result.
+ * @param row Row of the value.
+ * @param column Column of the value.
+ * @return UNIX time.
+ */
+time_t PGBinary_GetTimestamp(const PGresult* res, int row, int column) {
+    if (PQgetisnull(res, row, column)) {
+        return 0;
+    }
+
+    if (PQfformat(res, column) == 0 || PQgetlength(res, row, column) != 8) {
+        log_error("Column %s is not a binary timestamp.\n",
+                  PQfname(res, column));
+        return 0;
+    }
+
+    int64_t usecs = (int64_t)PGBinary_Get(PQgetvalue(res, row, column), 8);
+    int64_t secs = usecs / PG_BINARY_USECS_PER_SEC;
+    if (usecs % PG_BINARY_USECS_PER_SEC < 0) {
+        secs--;
+    }
+    return (time_t)(secs + PG_BINARY_EPOCH_OFFSET);
+}
+
+/**
+ * Decode the columns of a query result into arrays.
+ *
+ * Each column is decoded in a single pass over the rows into an array
+ * allocated from the arena, so reading a result costs one allocation per
+ * column rather than one (or a switch) per value. Strings are interned so
+ * repeated values share one copy. The arrays outlive the result, so it can
+ * be cleared straight away, and are freed with Arena_Free().
+ *
+ * @code
+ * Arena_TypeDef arena;
+ * Arena_Init(&arena);
+ * PGBinary_Column_TypeDef columns[2] = {
+ *         {.type = PG_BINARY_COLUMN_EPOCH},
+ *         {.type = PG_BINARY_COLUMN_FLOAT}
+ * };
+ * int n_rows = PGBinary_DecodeColumns(res, columns, 2, &arena);
+ * PQclear(res);
+ * for (int i = 0; i < n_rows; i++) {
+ *     printf("%lld %f\n", (long long)columns[0].epochs[i],
+ *            (double)columns[1].floats[i]);
+ * }
+ * Arena_Free(&arena);
+ * @endcode
+ *
+ * @param res Query result (binary results are required for timestamps).
+ * @param columns Type of each column to decode (populated with its values).
+ * @param n_columns Number of columns to decode (from the first column).
+ * @param arena Arena the values are allocated from.
+ * @return Number of rows decoded (-1 on error).
+ */
+int PGBinary_DecodeColumns(const PGresult* res,
+                           PGBinary_Column_TypeDef* columns, int n_columns,
+                           Arena_TypeDef* arena) {
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQnfields(res) < n_columns) {
+        log_error("Unable to decode %d columns from query result.\n",
+                  n_columns);
+        return -1;
+    }
+
+    int n_rows = PQntuples(res);
+    // Arrays are never empty so a column always has a valid pointer
+    size_t n_values = n_rows > 0 ? (size_t)n_rows : 1;
+
+    for (int j = 0; j < n_columns; j++) {
+        PGBinary_Column_TypeDef* column = &columns[j];
+        switch (column->type) {
+            case PG_BINARY_COLUMN_EPOCH:
+                column->epochs = Arena_Alloc(arena, n_values * sizeof(int64_t));
+                if (column->epochs == NULL) {
+                    return -1;
+                }
+                for (int i = 0; i < n_rows; i++) {
+                    column->epochs[i] =
+                            (int64_t)PGBinary_GetTimestamp(res, i, j);
+                }
+                break;
+            case PG_BINARY_COLUMN_FLOAT:
+                column->floats = Arena_Alloc(arena, n_values * sizeof(float));
+                if (column->floats == NULL) {
+                    return -1;
+                }
+                for (int i = 0; i < n_rows; i++) {
+                    column->floats[i] = (float)PGBinary_GetFloat8(res, i, j);
+                }
+                break;
+            case PG_BINARY_COLUMN_INT:
+                column->ints = Arena_Alloc(arena, n_values * sizeof(int32_t));
+                if (column->ints == NULL) {
+                    return -1;
+                }
+                for (int i = 0; i < n_rows; i++) {
+                    column->ints[i] = PGBinary_GetInt4(res, i, j);
+                }
+                break;
+            case PG_BINARY_COLUMN_STRING:
+                column->strings = Arena_Alloc(arena,
+                                              n_values * sizeof(const char*));
+                if (column->strings == NULL) {
+                    return -1;
+                }
+                for (int i = 0; i < n_rows; i++) {
+                    column->strings[i] = Arena_Intern(
+                            arena, PQgetvalue(res, i, j),
+                            (size_t)PQgetlength(res, i, j));
+                    if (column->strings[i] == NULL) {
+                        return -1;
+                    }
+                }
+                break;
+            case PG_BINARY_COLUMN_DOUBLE:
+                column->doubles = Arena_Alloc(arena,
+                                              n_values * sizeof(double));
+                if (column->doubles == NULL) {
+                    return -1;
+                }
+                for (int i = 0; i < n_rows; i++) {
+                    column->doubles[i] = PQgetisnull(res, i, j) ?
+                                         (double)NAN :
+                                         PGBinary_GetFloat8(res, i, j);
+                }
+                break;
+            default:
+                log_error("Unknown column type %u.\n", column->type);
+                return -1;
+        }
+    }
+
+    return n_rows;
+}
+
+static char* PGBinary_AddArray(PGBinary_Params_TypeDef* params, uint32_t oid,
+                               int count, Arena_TypeDef* arena) {
+    size_t size = PG_BINARY_ARRAY_HEADER_SIZE +
+                  (size_t)count * (4 + PG_BINARY_VALUE_SIZE);
+    if (count < 0 || size > INT32_MAX) {
+        log_error("Array of %d elements is too large.\n", count);
+        return NULL;
+    }
+    char* data = Arena_Alloc(arena, size);
+    if (data == NULL) {
+        return NULL;
+    }
+    int i = PGBinary_Next(params);
+    if (i < 0) {
+        return NULL;
+    }
+
+    // Dimensions, has nulls, element type, then length and lower bound (an
+    // empty array has no dimensions)
+    PGBinary_Put(data, count > 0 ? 1 : 0, 4);
+    PGBinary_Put(data + 4, 0, 4);
+    PGBinary_Put(data + 8, oid, 4);
+    PGBinary_Put(data + 12, (uint32_t)count, 4);
+    PGBinary_Put(data + 16, 1, 4);
+
+    params->values[i] = data;
+    params->lengths[i] = count > 0 ? (int)size : 12;
+    params->formats[i] = 1;
+    return data + PG_BINARY_ARRAY_HEADER_SIZE;
+}
+
+static int PGBinary_Next(PGBinary_Params_TypeDef* params) {
+    if (params->count >= PG_BINARY_MAX_PARAMS) {
+        log_error("Too many statement parameters (max %d).\n",
+                  PG_BINARY_MAX_PARAMS);
+        return -1;
+    }
+    return params->count++;
+}
+
+static void PGBinary_Put(char* data, uint64_t value, int size) {
+    for (int i = size - 1; i >= 0; i--) {
+        data[i] = (char)(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static uint64_t PGBinary_Get(const char* data, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value = (value << 8) | (uint8_t)data[i];
+    }
+    return value;
+}
@@ -0,0 +1,350 @@
+#include "rate_limit.h"
+
+/// Known provider quotas (the last entry is used for all other hosts)
+static const RateLimit_Provider_TypeDef RateLimit_Providers[] = {
+        {"api.willyweather.com.au",         5.0, 5, 2, 8},
+        {"pairs.res.ibm.com",               2.0, 2, 2, 4},
+        {"ibmpairs-mvp2-api.mybluemix.net", 2.0, 2, 2, 4},
+        {"auth-b2b-twc.ibm.com",            1.0, 1, 1, 1},
+        {"ubidots.com.au",                  4.0, 4, 2, 4},
+        {"ubidots.com",                     4.0, 4, 2, 4},
+        {"foodauthority.nsw.gov.au",        2.0, 2, 1, 2},
+        {"ftp.bom.gov.au",                  5.0, 5, 4, 8},
+        {NULL,                              5.0, 5, 2, 8}
+};
+
+/// Rate limit and concurrency state of a single host
+typedef struct {
+    char host[RATE_LIMIT_HOST_SIZE]; ///< Host name
+    const RateLimit_Provider_TypeDef* provider; ///< Quota of host
+    double tokens; ///< Requests that may be sent now
+    double last_refill; ///< Time tokens were last added (s)
+    double limit; ///< Current concurrency limit (adapted, >= 1)
+    uint16_t in_flight; ///< Requests currently running
+    double blocked_until; ///< No requests are sent before this time (s)
+    double backoff; ///< Back-off used for the next throttled response (s)
+    double latency; ///< Smoothed request latency (s)
+    double latency_floor; ///< Lowest smoothed latency seen (s)
+    double samples[RATE_LIMIT_LATENCY_SAMPLES]; ///< Recent latencies (s)
+    uint16_t n_samples; ///< Number of latencies in samples
+    uint16_t next_sample; ///< Index the next latency is written to
+    uint32_t requests; ///< Requests completed
+    uint32_t throttled; ///< Requests rejected with 429 or 503
+} RateLimit_Host_TypeDef;
+
+/// Rate limit state of every host
+static struct {
+    pthread_mutex_t lock; ///< Protects the hosts table
+    RateLimit_Host_TypeDef hosts[RATE_LIMIT_MAX_HOSTS]; ///< Hosts table
+    uint16_t n_hosts; ///< Number of hosts in table
+} RateLimit = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/// Monotonic time in seconds
+static double RateLimit_Now(void);
+
+/// Find (or add) a host (lock must be held)
+static RateLimit_Host_TypeDef* RateLimit_GetHost(const char* host);
+
+/// Add a latency to a hosts ring buffer (lock must be held)
+static void RateLimit_AddSample(RateLimit_Host_TypeDef* state, double latency);
+
+/// Compare two latencies (for qsort)
+static int RateLimit_CompareLatency(const void* a, const void* b);
+
+/**
+ * Extract the host name from a URL.
+ *
+ * @param url URL (e.g. https://api.willyweather.com.au/v2/...).
+ * @param host Host name to populate (e.g. api.willyweather.com.au).
+ * @param host_size Size of host buffer.
+ */
+void RateLimit_ParseHost(const char* url, char* host, size_t host_size) {
+    memset(host, 0, host_size);
+    if (url == NULL) {
+        return;
+    }
+
+    const char* start = strstr(url, "://");
+    start = (start != NULL) ? start + 3 : url;
+
+    size_t i = 0;
+    while (start[i] != '\0' && start[i] != '/' && start[i] != ':' &&
+           start[i] != '?' && i < host_size - 1) {
+        host[i] = start[i];
+        i++;
+    }
+}
+
+/**
+ * Take a request slot for a host without blocking.
+ *
+ * Each host has a token bucket (requests per second and burst size from the
+ * provider table) and a concurrency limit. A slot is only given if a token is
+ * available, the host is below its concurrency limit and the host is not
+ * backing off after a 429/503 response. Every slot taken must be given back
+ * with RateLimit_Release().
+ *
+ * @param host Host name (see RateLimit_ParseHost()).
+ * @return 0 if a slot was taken, otherwise seconds to wait before retrying.
+ */
+double RateLimit_TryAcquire(const char* host) {
+    double now = RateLimit_Now();
+    double wait = 0.0;
+
+    pthread_mutex_lock(&RateLimit.lock);
+    RateLimit_Host_TypeDef* state = RateLimit_GetHost(host);
+    if (state == NULL) {
+        pthread_mutex_unlock(&RateLimit.lock);
+        return 0.0;
+    }
+
+    const RateLimit_Provider_TypeDef* provider = state->provider;
+    state->tokens += (now - state->last_refill) * provider->rate;
+    if (state->tokens > provider->burst) state->tokens = provider->burst;
+    state->last_refill = now;
+
+    if (now < state->blocked_until) {
+        wait = state->blocked_until - now;
+    } else if (state->in_flight >= (uint16_t)state->limit) {
+        // A slot is freed when a request completes
+        wait = 1.0 / provider->rate;
+    } else if (state->tokens < 1.0) {
+        wait = (1.0 - state->tokens) / provider->rate;
+    } else {
+        state->tokens -= 1.0;
+        state->in_flight++;
+    }
+    pthread_mutex_unlock(&RateLimit.lock);
+
+    return wait;
+}
+
+/**
+ * Take a request slot for a host, sleeping until one is available.
+ *
+ * Used by blocking requests (HttpRequest(), FTPRequest()).
+ *
+ * @param host Host name (see RateLimit_ParseHost()).
+ */
+void RateLimit_Acquire(const char* host) {
+    double wait;
+    while ((wait = RateLimit_TryAcquire(host)) > 0.0) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)wait;
+        ts.tv_nsec = (long)((wait - (double)ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+    }
+}
+
+/**
+ * Give back a request slot and adapt the hosts limits.
+ *
+ * - 429 or 503: the concurrency limit is halved and the host is blocked for
+ *   the Retry-After period (or an exponential back-off if none was given).
+ * - Success with latency close to the lowest seen: the concurrency limit is
+ *   raised by about one request per round trip (up to the provider max).
+ * - Success with latency more than double the lowest seen: the limit is
+ *   lowered slightly before the server starts rejecting requests.
+ *
+ * @param host Host name (see RateLimit_ParseHost()).
+ * @param curl Handle which performed the request (NULL if never started).
+ * @param result Result of the request.
+ * @return True if the request was throttled and should be retried.
+ */
+bool RateLimit_Release(const char* host, CURL* curl, CURLcode result) {
+    long response_code = 0;
+    curl_off_t retry_after = 0;
+    curl_off_t total_time = 0;
+    if (curl != NULL) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+        curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_time);
+    }
+
+    double now = RateLimit_Now();
+    bool throttled = (response_code == 429 || response_code == 503);
+
+    pthread_mutex_lock(&RateLimit.lock);
+    RateLimit_Host_TypeDef* state = RateLimit_GetHost(host);
+    if (state == NULL) {
+        pthread_mutex_unlock(&RateLimit.lock);
+        return throttled;
+    }
+    if (state->in_flight > 0) state->in_flight--;
+    state->requests++;
+
+    if (throttled) {
+        state->throttled++;
+        state->limit /= 2.0;
+        if (state->limit < 1.0) state->limit = 1.0;
+
+        double delay = (retry_after > 0) ? (double)retry_after :
+                       state->backoff;
+        if (delay > RATE_LIMIT_MAX_BACKOFF) delay = RATE_LIMIT_MAX_BACKOFF;
+        if (now + delay > state->blocked_until) {
+            state->blocked_until = now + delay;
+        }
+        state->backoff *= 2.0;
+        if (state->backoff > RATE_LIMIT_MAX_BACKOFF) {
+            state->backoff = RATE_LIMIT_MAX_BACKOFF;
+        }
+
+        log_warn("%s throttled (HTTP %ld). Backing off %.1f s with at most "
+                 "%d requests in flight.\n", state->host, response_code,
+                 delay, (int)state->limit);
+    } else if (result == CURLE_OK && total_time > 0) {
+        state->backoff = RATE_LIMIT_DEFAULT_BACKOFF;
+
+        double latency = (double)total_time / 1e6;
+        RateLimit_AddSample(state, latency);
+        state->latency = (state->latency == 0.0) ? latency :
+                         0.8 * state->latency + 0.2 * latency;
+        if (state->latency_floor == 0.0 ||
+            state->latency < state->latency_floor) {
+            state->latency_floor = state->latency;
+        }
+
+        double max_limit = state->provider->max_in_flight;
+        if (state->latency < 1.5 * state->latency_floor) {
+            state->limit += 1.0 / state->limit;
+            if (state->limit > max_limit) state->limit = max_limit;
+        } else if (state->latency > 2.0 * state->latency_floor) {
+            state->limit *= 0.95;
+            if (state->limit < 1.0) state->limit = 1.0;
+        }
+    }
+    pthread_mutex_unlock(&RateLimit.lock);
+
+    return throttled;
+}
+
+/**
+ * Record the latency of a request that was abandoned before completing.
+ *
+ * Used when a hedged request is cancelled because the other endpoint
+ * answered first. The time waited is a lower bound of the latency, so
+ * recording it stops a slow endpoint looking fast just because only its
+ * quick answers complete. The concurrency limit is not changed.
+ *
+ * @param host Host name (see RateLimit_ParseHost()).
+ * @param latency Time the request was in flight (s).
+ */
+void RateLimit_RecordLatency(const char* host, double latency) {
+    pthread_mutex_lock(&RateLimit.lock);
+    RateLimit_Host_TypeDef* state = RateLimit_GetHost(host);
+    if (state != NULL) {
+        RateLimit_AddSample(state, latency);
+    }
+    pthread_mutex_unlock(&RateLimit.lock);
+}
+
+/**
+ * Latency percentile of the most recent requests to a host.
+ *
+ * @code
+ * double p95 = RateLimit_LatencyPercentile("pairs.res.ibm.com", 95.0);
+ * @endcode
+ *
+ * @param host Host name (see RateLimit_ParseHost()).
+ * @param percentile Percentile to return (0 - 100).
+ * @return Latency in seconds, or -1 if fewer than RATE_LIMIT_MIN_SAMPLES
+ * requests have completed.
+ */
+double RateLimit_LatencyPercentile(const char* host, double percentile) {
+    double samples[RATE_LIMIT_LATENCY_SAMPLES];
+    uint16_t n_samples = 0;
+
+    pthread_mutex_lock(&RateLimit.lock);
+    RateLimit_Host_TypeDef* state = RateLimit_GetHost(host);
+    if (state != NULL) {
+        n_samples = state->n_samples;
+        memcpy(samples, state->samples, n_samples * sizeof(double));
+    }
+    pthread_mutex_unlock(&RateLimit.lock);
+
+    if (n_samples < RATE_LIMIT_MIN_SAMPLES) {
+        return -1.0;
+    }
+
+    qsort(samples, n_samples, sizeof(double), RateLimit_CompareLatency);
+
+    if (percentile < 0.0) percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+    size_t index = (size_t)(percentile / 100.0 * (n_samples - 1) + 0.5);
+
+    return samples[index];
+}
+
+/**
+ * Log the requests sent, requests throttled and final concurrency limit of
+ * each host.
+ */
+void RateLimit_LogStats(void) {
+    pthread_mutex_lock(&RateLimit.lock);
+    for (uint16_t i = 0; i < RateLimit.n_hosts; i++) {
+        RateLimit_Host_TypeDef* state = &RateLimit.hosts[i];
+        log_info("%s: %u requests, %u throttled, %d in flight allowed, "
+                 "%.0f ms latency.\n", state->host, state->requests,
+                 state->throttled, (int)state->limit,
+                 state->latency * 1000.0);
+    }
+    pthread_mutex_unlock(&RateLimit.lock);
+}
+
+static double RateLimit_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void RateLimit_AddSample(RateLimit_Host_TypeDef* state,
+                                double latency) {
+    state->samples[state->next_sample] = latency;
+    state->next_sample = (uint16_t)((state->next_sample + 1) %
+                                    RATE_LIMIT_LATENCY_SAMPLES);
+    if (state->n_samples < RATE_LIMIT_LATENCY_SAMPLES) {
+        state->n_samples++;
+    }
+}
+
+static int RateLimit_CompareLatency(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static RateLimit_Host_TypeDef* RateLimit_GetHost(const char* host) {
+    for (uint16_t i = 0; i < RateLimit.n_hosts; i++) {
+        if (strcmp(RateLimit.hosts[i].host, host) == 0) {
+            return &RateLimit.hosts[i];
+        }
+    }
+
+    if (RateLimit.n_hosts >= RATE_LIMIT_MAX_HOSTS) {
+        log_warn("Max number of hosts exceeded. No rate limit applied to "
+                 "%s\n", host);
+        return NULL;
+    }
+
+    // Match provider by domain suffix (e.g. industrial.api.ubidots.com)
+    const RateLimit_Provider_TypeDef* provider = RateLimit_Providers;
+    size_t host_len = strlen(host);
+    for (; provider->host != NULL; provider++) {
+        size_t len = strlen(provider->host);
+        if (host_len >= len &&
+            strcasecmp(host + host_len - len, provider->host) == 0) {
+            break;
+        }
+    }
+
+    RateLimit_Host_TypeDef* state = &RateLimit.hosts[RateLimit.n_hosts++];
+    memset(state, 0, sizeof(RateLimit_Host_TypeDef));
+    strncpy(state->host, host, RATE_LIMIT_HOST_SIZE - 1);
+    state->provider = provider;
+    state->tokens = provider->burst;
+    state->last_refill = RateLimit_Now();
+    state->limit = provider->initial_in_flight;
+    state->backoff = RATE_LIMIT_DEFAULT_BACKOFF;
+
+    return state;
+}
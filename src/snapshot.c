@@ -0,0 +1,197 @@
+#include "snapshot.h"
+
+/// Size of chunks read when hashing a file
+#define SNAPSHOT_READ_CHUNK_SIZE        16384
+
+/// Add bytes to a 64 bit FNV-1a hash
+static uint64_t Snapshot_Hash(uint64_t hash, const void* data, size_t size);
+
+/**
+ * Checksum of a file (64 bit FNV-1a over its contents).
+ *
+ * Used as the source of a snapshot so the snapshot can be rebuilt when the
+ * file it was built from changes.
+ *
+ * @param path File to hash.
+ * @param checksum Checksum to populate.
+ * @return Error code. 0 = OK ... -1 = ERROR (unable to read file)
+ */
+int8_t Snapshot_FileChecksum(const char* path, uint64_t* checksum) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    char buffer[SNAPSHOT_READ_CHUNK_SIZE];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = Snapshot_Hash(hash, buffer, n);
+    }
+
+    int8_t status = ferror(file) ? -1 : 0;
+    fclose(file);
+
+    *checksum = hash;
+    return status;
+}
+
+/**
+ * Write a payload to a snapshot file.
+ *
+ * A snapshot is a SNAPSHOT_HEADER_SIZE header followed by the raw bytes of a
+ * fixed size struct (e.g. BOM_WeatherStations_TypeDef), so once mapped with
+ * Snapshot_Map() the payload is used in place without any parsing. The file
+ * is written next to `path` and renamed over it, so processes that have the
+ * previous snapshot mapped keep a consistent copy.
+ *
+ * @code
+ * uint64_t source;
+ * Snapshot_FileChecksum(BOM_STATIONS_FILE, &source);
+ * Snapshot_Write(BOM_STATIONS_SNAPSHOT, SNAPSHOT_TYPE_STATIONS, source,
+ *                stations, sizeof(BOM_WeatherStations_TypeDef));
+ * @endcode
+ *
+ * @param path Snapshot file.
+ * @param type Payload type (e.g. SNAPSHOT_TYPE_STATIONS).
+ * @param source Checksum of the data the payload was built from.
+ * @param data Payload.
+ * @param size Payload size.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Snapshot_Write(const char* path, uint32_t type, uint64_t source,
+                      const void* data, size_t size) {
+    char header[SNAPSHOT_HEADER_SIZE] = {0};
+    Snapshot_Header_TypeDef info = {
+            .magic = SNAPSHOT_MAGIC,
+            .version = SNAPSHOT_VERSION,
+            .type = type,
+            .size = size,
+            .source = source,
+            .checksum = Snapshot_Hash(14695981039346656037ULL, data, size)
+    };
+    memcpy(header, &info, sizeof(info));
+
+    char tmp_path[SNAPSHOT_PATH_SIZE + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path, (long)getpid());
+
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        log_error("Unable to write snapshot: %s\n", tmp_path);
+        return -1;
+    }
+
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+                   && fwrite(data, 1, size, file) == size;
+    if (fclose(file) != 0 || !written || rename(tmp_path, path) != 0) {
+        log_error("Unable to write snapshot: %s\n", path);
+        remove(tmp_path);
+        return -1;
+    }
+
+    log_info("Snapshot written: %s (%zu bytes)\n", path, size);
+    return 0;
+}
+
+/**
+ * Map a snapshot file read-only.
+ *
+ * The snapshot is rejected (and should be rebuilt) if it was written by a
+ * different SNAPSHOT_VERSION, holds a different type or size of payload
+ * (e.g. after a struct changed), was built from different source data or
+ * fails its checksum. Processes mapping the same snapshot share one copy in
+ * the page cache.
+ *
+ * @param snapshot Mapping to populate.
+ * @param path Snapshot file.
+ * @param type Expected payload type.
+ * @param source Expected source checksum (NULL to accept any source).
+ * @param size Expected payload size.
+ * @return Error code. 0 = OK ... -1 = ERROR (missing or stale)
+ */
+int8_t Snapshot_Map(Snapshot_TypeDef* snapshot, const char* path,
+                    uint32_t type, const uint64_t* source, size_t size) {
+    memset(snapshot, 0, sizeof(Snapshot_TypeDef));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        (size_t)info.st_size != SNAPSHOT_HEADER_SIZE + size) {
+        log_info("Snapshot out of date (size): %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_error("Unable to map snapshot: %s\n", path);
+        return -1;
+    }
+
+    Snapshot_Header_TypeDef header;
+    memcpy(&header, map, sizeof(header));
+    const char* data = (const char*)map + SNAPSHOT_HEADER_SIZE;
+
+    const char* stale = NULL;
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0 ||
+        header.version != SNAPSHOT_VERSION) {
+        stale = "version";
+    } else if (header.type != type || header.size != size) {
+        stale = "layout";
+    } else if (source != NULL && header.source != *source) {
+        stale = "source changed";
+    } else if (header.checksum !=
+               Snapshot_Hash(14695981039346656037ULL, data, size)) {
+        stale = "checksum";
+    }
+
+    if (stale != NULL) {
+        log_info("Snapshot out of date (%s): %s\n", stale, path);
+        munmap(map, (size_t)info.st_size);
+        return -1;
+    }
+
+    snapshot->data = data;
+    snapshot->size = size;
+    snapshot->map = map;
+    snapshot->map_size = (size_t)info.st_size;
+
+    return 0;
+}
+
+/**
+ * Unmap a snapshot.
+ *
+ * @param snapshot Mapping from Snapshot_Map().
+ */
+void Snapshot_Unmap(Snapshot_TypeDef* snapshot) {
+    if (snapshot->map != NULL) {
+        munmap(snapshot->map, snapshot->map_size);
+    }
+    memset(snapshot, 0, sizeof(Snapshot_TypeDef));
+}
+
+/**
+ * Remove a snapshot file (e.g. once the data it holds has been replaced).
+ *
+ * @param path Snapshot file.
+ */
+void Snapshot_Remove(const char* path) {
+    if (remove(path) == 0) {
+        log_info("Snapshot removed: %s\n", path);
+    }
+}
+
+static uint64_t Snapshot_Hash(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,414 @@
+#include "statements.h"
+
+/// Every statement prepared on a connection
+static const Statements_Statement_TypeDef Statements_Known[] = {
+        {"SelectPrograms",
+         "SELECT fa_program_name, fa_program_id::int FROM harvest_lookup;", 0},
+        // One row per program, written by FA_CreateLocationsLookupDB()
+        {"UpsertHarvestLookup",
+         "INSERT INTO harvest_lookup (last_updated, fa_program_name, "
+         "ww_location, ww_location_id, ww_latitude, ww_longitude, "
+         "bom_location, bom_location_id, bom_latitude, bom_longitude, "
+         "bom_distance) VALUES (NOW(), $1::text, $2::text, $3::int, "
+         "$4::float8, $5::float8, $6::text, $7::text, $8::float8, "
+         "$9::float8, $10::float8) "
+         "ON CONFLICT (fa_program_name) DO UPDATE SET "
+         "last_updated = NOW();", 10},
+        {"SelectForecastPrecip",
+         "SELECT (ts AT TIME ZONE 'AEST')::timestamptz, precipitation::float8, "
+         "last_updated FROM weather_ibm_eis WHERE bom_location_id = $1::text "
+         "ORDER BY (ts) DESC;", 1},
+        {"SelectObservedPrecip",
+         "SELECT (ts AT TIME ZONE 'AEST')::timestamptz, precipitation::float8, "
+         "last_updated FROM weather_bom WHERE location_id = $1::text "
+         "ORDER BY (ts) DESC;", 1},
+        // Only programs still in harvest_lookup are transformed
+        {"SelectWeatherSeries",
+         "SELECT program_id, program_name, ts, "
+         "(ts::date - DATE '1970-01-01'), "
+         "observed_precipitation::float8, forecast_precipitation::float8, "
+         "precipitation::float8 FROM weather "
+         "WHERE program_id IN (SELECT fa_program_id::int "
+         "FROM harvest_lookup) "
+         "ORDER BY program_id, ts ASC;", 0},
+        {"UpdateStoredWindow",
+         "UPDATE weather w SET sum_precip = u.sum_precip, "
+         "normalised_precip = u.normalised_precip "
+         "FROM unnest($2::timestamptz[], $3::float8[], $4::float8[]) "
+         "AS u(ts, sum_precip, normalised_precip) "
+         "WHERE w.program_id = $1::int AND w.ts = u.ts;", 4},
+        // Source rows newer than the latest build of their program mark the
+        // days to rebuild, each day is then merged from every source row
+        // (observed precipitation wins over the forecast)
+        {"MergeWeather",
+         "WITH programs AS ("
+         "SELECT h.fa_program_id, h.fa_program_name, h.bom_location_id, "
+         "h.ww_latitude, h.ww_longitude, "
+         "COALESCE((SELECT MAX(w.last_updated) FROM weather w "
+         "WHERE w.program_id = h.fa_program_id), "
+         "'-infinity'::timestamptz) AS built "
+         "FROM harvest_lookup h "
+         "WHERE $1::int IS NULL OR h.fa_program_id = $1::int), "
+         "forecast AS ("
+         "SELECT DISTINCT ON (fa_program_id, ts) fa_program_id, ts, "
+         "precipitation, changed FROM ("
+         "SELECT p.fa_program_id, (i.ts AT TIME ZONE 'AEST')::timestamptz "
+         "AS ts, COALESCE(i.precipitation, 0) AS precipitation, "
+         "i.last_updated > p.built AS changed, i.last_updated "
+         "FROM programs p JOIN weather_ibm_eis i "
+         "ON i.bom_location_id = p.bom_location_id) f "
+         "ORDER BY fa_program_id, ts, last_updated DESC), "
+         "observed AS ("
+         "SELECT DISTINCT ON (fa_program_id, ts) fa_program_id, ts, "
+         "precipitation, changed FROM ("
+         "SELECT p.fa_program_id, (b.ts AT TIME ZONE 'AEST')::timestamptz "
+         "AS ts, COALESCE(b.precipitation, 0) AS precipitation, "
+         "b.last_updated > p.built AS changed, b.last_updated "
+         "FROM programs p JOIN weather_bom b "
+         "ON b.location_id = p.bom_location_id) o "
+         "ORDER BY fa_program_id, ts, last_updated DESC) "
+         "INSERT INTO weather (last_updated, latitude, longitude, ts, "
+         "program_name, program_id, bom_location_id, data_type, "
+         "precipitation, forecast_precipitation, observed_precipitation) "
+         "SELECT NOW(), p.ww_latitude, p.ww_longitude, ts, "
+         "p.fa_program_name, fa_program_id, p.bom_location_id, "
+         "CASE WHEN o.ts IS NULL THEN 'forecast' ELSE 'observed' END, "
+         "COALESCE(o.precipitation, f.precipitation), f.precipitation, "
+         "o.precipitation "
+         "FROM forecast f FULL JOIN observed o USING (fa_program_id, ts) "
+         "JOIN programs p USING (fa_program_id) "
+         "WHERE f.changed OR o.changed "
+         "ON CONFLICT (ts, program_name) DO UPDATE SET "
+         "last_updated = NOW(), "
+         "data_type = EXCLUDED.data_type, "
+         "precipitation = EXCLUDED.precipitation, "
+         "forecast_precipitation = COALESCE(EXCLUDED.forecast_precipitation, "
+         "weather.forecast_precipitation), "
+         "observed_precipitation = COALESCE(EXCLUDED.observed_precipitation, "
+         "weather.observed_precipitation);", 1},
+};
+
+/// Number of known statements
+#define STATEMENTS_N_KNOWN  (sizeof(Statements_Known) / \
+                             sizeof(Statements_Known[0]))
+
+/// Connections the known statements have been prepared on
+static struct {
+    struct {
+        PGconn* psql_conn; ///< Connection (NULL if the slot is free)
+        int backend_pid; ///< Server session the statements belong to
+        bool missing[STATEMENTS_N_KNOWN]; ///< Statements to prepare again
+    } connections[STATEMENTS_MAX_CONNECTIONS];
+    pthread_mutex_t lock; ///< Protects the connections
+} Statements = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/// Known statement with a name (NULL if unknown)
+static const Statements_Statement_TypeDef* Statements_Find(const char* name);
+
+/// Is a connection tracked with the statements of its current session?
+static bool Statements_IsPrepared(PGconn* psql_conn, int backend_pid);
+
+/// Track a connection once its statements are prepared
+static void Statements_Track(PGconn* psql_conn, int backend_pid);
+
+/// Remember that a statement is missing from the session of a connection
+static void Statements_SetMissing(PGconn* psql_conn, size_t index);
+
+/// Was a statement missing from the session? (forgets it if so)
+static bool Statements_TakeMissing(PGconn* psql_conn, size_t index);
+
+/// Send every known statement to the server in one round trip
+static int8_t Statements_SendAll(PGconn* psql_conn);
+
+/// Prepare a single known statement (e.g. after DISCARD ALL)
+static int8_t Statements_PrepareOne(PGconn* psql_conn,
+                                    const Statements_Statement_TypeDef* stmt);
+
+/**
+ * Prepare every known statement on a connection.
+ *
+ * Prepared statements belong to a server session, so each connection (and
+ * each session after a reconnect) needs its own. The statements are sent
+ * together in one round trip the first time a connection is used and the
+ * connection is then tracked locally, so later calls cost no round trips
+ * (nothing is described on the server). A connection that has been lost is
+ * reset first and, as its session has changed, prepared again. The reset
+ * also loses any transaction open on the connection, so the stage that
+ * owned it is started again (see Transaction_Reconnected()).
+ *
+ * @code
+ * Statements_Prepare(psql_conn);
+ * PGresult* res = PGBinary_ExecPrepared(psql_conn, "SelectPrograms",
+ *                                       &params);
+ * @endcode
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Statements_Prepare(PGconn* psql_conn) {
+    bool reset = false;
+    if (PQstatus(psql_conn) != CONNECTION_OK) {
+        log_warn("PostgreSQL connection lost, reconnecting.\n");
+        PQreset(psql_conn);
+        if (PQstatus(psql_conn) != CONNECTION_OK) {
+            log_error("Unable to reconnect to PostgreSQL: %s\n",
+                      PQerrorMessage(psql_conn));
+            return -1;
+        }
+        reset = true;
+    }
+
+    int8_t status = 0;
+    int backend_pid = PQbackendPID(psql_conn);
+    if (reset || !Statements_IsPrepared(psql_conn, backend_pid)) {
+        // Prepared before the stage's transaction is started again, so a
+        // failure can't abort it
+        status = Statements_SendAll(psql_conn);
+        if (status == 0) {
+            Statements_Track(psql_conn, backend_pid);
+            log_debug("Prepared %zu statements (PostgreSQL backend %d).\n",
+                      STATEMENTS_N_KNOWN, backend_pid);
+        }
+    }
+
+    if (reset && Transaction_Reconnected(psql_conn) != 0) {
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * Run a known statement with binary parameters and results.
+ *
+ * The statements of the connection are prepared first if needed (see
+ * Statements_Prepare()). If the connection was lost it is reset and the
+ * statement is retried once. If the server no longer has the statement
+ * (e.g. after DISCARD ALL) only that statement is prepared again and
+ * retried, unless the failure has aborted a transaction: nothing can run
+ * until the stage rolls back, so the error is returned and the statement
+ * is prepared again the next time it is run outside a failed transaction.
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @param stmt_name Name of a known statement (e.g. "SelectPrograms").
+ * @param params Parameters ($1, $2 ...).
+ * @return Query result (NULL if the statement is unknown or can't be sent).
+ */
+PGresult* Statements_Exec(PGconn* psql_conn, const char* stmt_name,
+                          const PGBinary_Params_TypeDef* params) {
+    const Statements_Statement_TypeDef* stmt = Statements_Find(stmt_name);
+    if (stmt == NULL) {
+        log_error("Unknown prepared statement: %s\n", stmt_name);
+        return NULL;
+    }
+    if (params->count != stmt->nparams) {
+        log_error("Prepared statement %s takes %d parameters (%d given).\n",
+                  stmt_name, stmt->nparams, params->count);
+        return NULL;
+    }
+
+    const size_t index = (size_t)(stmt - Statements_Known);
+    for (int attempt = 0; ; attempt++) {
+        if (Statements_Prepare(psql_conn) != 0) {
+            return NULL;
+        }
+
+        // Missing since a failed transaction, which has now rolled back
+        if (PQtransactionStatus(psql_conn) != PQTRANS_INERROR &&
+            Statements_TakeMissing(psql_conn, index)) {
+            log_warn("Preparing %s again.\n", stmt_name);
+            if (Statements_PrepareOne(psql_conn, stmt) != 0) {
+                return NULL;
+            }
+        }
+
+        PGresult* res = PGBinary_ExecPrepared(psql_conn, stmt_name, params);
+        ExecStatusType status = PQresultStatus(res);
+        if (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK ||
+            attempt > 0) {
+            return res;
+        }
+
+        // Statements_Prepare() resets the connection
+        if (PQstatus(psql_conn) != CONNECTION_OK) {
+            log_warn("PostgreSQL connection lost running %s.\n", stmt_name);
+            PQclear(res);
+            continue;
+        }
+
+        const char* sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+        if (sqlstate == NULL ||
+            strcmp(sqlstate, STATEMENTS_SQLSTATE_MISSING) != 0) {
+            return res;
+        }
+        if (PQtransactionStatus(psql_conn) == PQTRANS_INERROR) {
+            log_error("Prepared statement %s is missing inside a "
+                      "transaction, not retried.\n", stmt_name);
+            Statements_SetMissing(psql_conn, index);
+            return res;
+        }
+
+        log_warn("Preparing %s again.\n", stmt_name);
+        PQclear(res);
+        if (Statements_PrepareOne(psql_conn, stmt) != 0) {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Stop tracking a connection.
+ *
+ * Call this before PQfinish() so a new connection allocated at the same
+ * address is prepared.
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ */
+void Statements_Forget(PGconn* psql_conn) {
+    pthread_mutex_lock(&Statements.lock);
+    for (int i = 0; i < STATEMENTS_MAX_CONNECTIONS; i++) {
+        if (Statements.connections[i].psql_conn == psql_conn) {
+            Statements.connections[i].psql_conn = NULL;
+        }
+    }
+    pthread_mutex_unlock(&Statements.lock);
+}
+
+static const Statements_Statement_TypeDef* Statements_Find(const char* name) {
+    for (size_t i = 0; i < STATEMENTS_N_KNOWN; i++) {
+        if (strcmp(Statements_Known[i].name, name) == 0) {
+            return &Statements_Known[i];
+        }
+    }
+    return NULL;
+}
+
+static bool Statements_IsPrepared(PGconn* psql_conn, int backend_pid) {
+    bool prepared = false;
+    pthread_mutex_lock(&Statements.lock);
+    for (int i = 0; i < STATEMENTS_MAX_CONNECTIONS; i++) {
+        if (Statements.connections[i].psql_conn == psql_conn) {
+            prepared = Statements.connections[i].backend_pid == backend_pid;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&Statements.lock);
+    return prepared;
+}
+
+static void Statements_Track(PGconn* psql_conn, int backend_pid) {
+    pthread_mutex_lock(&Statements.lock);
+    int slot = -1;
+    for (int i = 0; i < STATEMENTS_MAX_CONNECTIONS; i++) {
+        if (Statements.connections[i].psql_conn == psql_conn) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && Statements.connections[i].psql_conn == NULL) {
+            slot = i;
+        }
+    }
+    if (slot >= 0) {
+        Statements.connections[slot].psql_conn = psql_conn;
+        Statements.connections[slot].backend_pid = backend_pid;
+        memset(Statements.connections[slot].missing, 0,
+               sizeof(Statements.connections[slot].missing));
+    } else {
+        log_warn("More than %d PostgreSQL connections, statements will be "
+                 "prepared again.\n", STATEMENTS_MAX_CONNECTIONS);
+    }
+    pthread_mutex_unlock(&Statements.lock);
+}
+
+static void Statements_SetMissing(PGconn* psql_conn, size_t index) {
+    pthread_mutex_lock(&Statements.lock);
+    for (int i = 0; i < STATEMENTS_MAX_CONNECTIONS; i++) {
+        if (Statements.connections[i].psql_conn == psql_conn) {
+            Statements.connections[i].missing[index] = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&Statements.lock);
+}
+
+static bool Statements_TakeMissing(PGconn* psql_conn, size_t index) {
+    bool missing = false;
+    pthread_mutex_lock(&Statements.lock);
+    for (int i = 0; i < STATEMENTS_MAX_CONNECTIONS; i++) {
+        if (Statements.connections[i].psql_conn == psql_conn) {
+            missing = Statements.connections[i].missing[index];
+            Statements.connections[i].missing[index] = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&Statements.lock);
+    return missing;
+}
+
+static int8_t Statements_SendAll(PGconn* psql_conn) {
+    if (PQenterPipelineMode(psql_conn) != 1) {
+        log_error("Unable to enter PostgreSQL pipeline mode: %s\n",
+                  PQerrorMessage(psql_conn));
+        return -1;
+    }
+
+    // Each statement has its own sync point so one failure doesn't abort
+    // the others
+    size_t sent = 0;
+    for (; sent < STATEMENTS_N_KNOWN; sent++) {
+        const Statements_Statement_TypeDef* stmt = &Statements_Known[sent];
+        if (PQsendPrepare(psql_conn, stmt->name, stmt->sql, stmt->nparams,
+                          NULL) != 1 ||
+            PQpipelineSync(psql_conn) != 1) {
+            log_error("Unable to send prepared statement %s: %s\n",
+                      stmt->name, PQerrorMessage(psql_conn));
+            break;
+        }
+    }
+
+    int8_t status = sent == STATEMENTS_N_KNOWN ? 0 : -1;
+    for (size_t i = 0; i < sent; i++) {
+        // Result of the prepare, then NULL, then its sync point
+        // Statements prepared on the session before it was tracked are kept
+        PGresult* res = PQgetResult(psql_conn);
+        const char* sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK &&
+            (sqlstate == NULL ||
+             strcmp(sqlstate, STATEMENTS_SQLSTATE_DUPLICATE) != 0)) {
+            log_error("Unable to prepare statement %s: %s\n",
+                      Statements_Known[i].name, PQresultErrorMessage(res));
+            status = -1;
+        }
+        PQclear(res);
+
+        while ((res = PQgetResult(psql_conn)) != NULL) {
+            PQclear(res);
+        }
+
+        res = PQgetResult(psql_conn);
+        PQclear(res);
+    }
+
+    if (PQexitPipelineMode(psql_conn) != 1) {
+        log_error("Unable to leave PostgreSQL pipeline mode: %s\n",
+                  PQerrorMessage(psql_conn));
+        status = -1;
+    }
+    return status;
+}
+
+static int8_t Statements_PrepareOne(PGconn* psql_conn,
+                                    const Statements_Statement_TypeDef* stmt) {
+    PGresult* res = PQprepare(psql_conn, stmt->name, stmt->sql, stmt->nparams,
+                              NULL);
+    const char* sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK &&
+        (sqlstate == NULL ||
+         strcmp(sqlstate, STATEMENTS_SQLSTATE_DUPLICATE) != 0)) {
+        log_error("Unable to prepare statement %s: %s\n", stmt->name,
+                  PQresultErrorMessage(res));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
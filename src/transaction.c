@@ -0,0 +1,355 @@
+#include "transaction.h"
+
+/// Transaction open on a connection
+typedef struct {
+    PGconn* psql_conn; ///< Connection (NULL if the slot is free)
+    uint16_t stage; ///< Index of the stage in the run summary
+    uint16_t depth; ///< Nested Transaction_Begin() calls
+    uint16_t units_open; ///< Nested Transaction_UnitBegin() calls
+    uint64_t pending; ///< Rows written since the last commit
+    bool unit_lost; ///< Open unit lost its rows to a reconnect
+} Transaction_Active_TypeDef;
+
+/// Open transactions and the run summary
+static struct {
+    Transaction_Active_TypeDef active[TRANSACTION_MAX_ACTIVE];
+    Transaction_Stats_TypeDef stages[TRANSACTION_MAX_STAGES];
+    uint16_t n_stages; ///< Stages in the run summary
+    uint32_t rows_per_commit; ///< Rows written before each commit
+    pthread_mutex_t lock; ///< Protects the slots and the run summary
+} Transaction = {.rows_per_commit = TRANSACTION_DEFAULT_ROWS_PER_COMMIT,
+                 .lock = PTHREAD_MUTEX_INITIALIZER};
+
+/// Transaction open on a connection (NULL if there isn't one)
+static Transaction_Active_TypeDef* Transaction_Find(PGconn* psql_conn);
+
+/// Index of a stage in the run summary (added if new, -1 if full)
+static int Transaction_StageIndex(const char* stage);
+
+/// Run a statement that returns no rows
+static int8_t Transaction_Command(PGconn* psql_conn, const char* command);
+
+/// Commit the open transaction and record the time it took
+static int8_t Transaction_Commit(PGconn* psql_conn, uint16_t stage);
+
+/**
+ * Read the rows written per commit from the environment.
+ *
+ * TRANSACTION_ROWS_PER_COMMIT sets how many rows a stage writes before it
+ * commits (TRANSACTION_DEFAULT_ROWS_PER_COMMIT if not set).
+ */
+void Transaction_Init(void) {
+    const char* rows = getenv(TRANSACTION_ROWS_ENV);
+    if (rows == NULL) {
+        return;
+    }
+
+    char* end = NULL;
+    unsigned long value = strtoul(rows, &end, 10);
+    if (end == rows || *end != '\0' || value == 0 || value > UINT32_MAX) {
+        log_warn("Invalid %s: %s (using %u).\n", TRANSACTION_ROWS_ENV, rows,
+                 TRANSACTION_DEFAULT_ROWS_PER_COMMIT);
+        return;
+    }
+
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction.rows_per_commit = (uint32_t)value;
+    pthread_mutex_unlock(&Transaction.lock);
+}
+
+/**
+ * Start the transaction of a stage.
+ *
+ * Without an explicit transaction every statement commits on its own and
+ * waits for the WAL to be flushed. A stage writes inside one transaction
+ * instead and commits every TRANSACTION_ROWS_PER_COMMIT rows, at the end of
+ * a unit of work (see Transaction_UnitBegin()). A unit that fails is rolled
+ * back to its savepoint and the stage keeps going.
+ *
+ * A stage started while another is open on the same connection joins it
+ * (e.g. BOM_TimeseriesToDB() calling BOM_HistoricalWeatherToDB()).
+ *
+ * @code
+ * Transaction_Begin(psql_conn, "BOM");
+ * Bulk_Begin(&load, psql_conn, ...); // Sets a savepoint
+ * Bulk_AddRow(&load, &row);
+ * Bulk_End(&load); // Releases the savepoint, commits every n rows
+ * Transaction_End(psql_conn);
+ * @endcode
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @param stage Stage name in the run summary (must outlive the run).
+ * @return Error code. 0 = OK ... -1 = ERROR (statements autocommit)
+ */
+int8_t Transaction_Begin(PGconn* psql_conn, const char* stage) {
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction_Active_TypeDef* active = Transaction_Find(psql_conn);
+    if (active != NULL) {
+        active->depth++;
+        pthread_mutex_unlock(&Transaction.lock);
+        return 0;
+    }
+
+    int index = Transaction_StageIndex(stage);
+    active = Transaction_Find(NULL);
+    if (index < 0 || active == NULL) {
+        pthread_mutex_unlock(&Transaction.lock);
+        log_warn("Too many transactions, %s will autocommit.\n", stage);
+        return -1;
+    }
+    *active = (Transaction_Active_TypeDef){
+            .psql_conn = psql_conn,
+            .stage = (uint16_t)index,
+            .depth = 1
+    };
+    pthread_mutex_unlock(&Transaction.lock);
+
+    if (Transaction_Command(psql_conn, "BEGIN;") != 0) {
+        pthread_mutex_lock(&Transaction.lock);
+        active->psql_conn = NULL;
+        pthread_mutex_unlock(&Transaction.lock);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Commit the transaction of a stage.
+ *
+ * Only the outermost call commits (see Transaction_Begin()).
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Transaction_End(PGconn* psql_conn) {
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction_Active_TypeDef* active = Transaction_Find(psql_conn);
+    if (active == NULL) {
+        pthread_mutex_unlock(&Transaction.lock);
+        return -1;
+    }
+    if (--active->depth > 0) {
+        pthread_mutex_unlock(&Transaction.lock);
+        return 0;
+    }
+    uint16_t stage = active->stage;
+    active->psql_conn = NULL;
+    pthread_mutex_unlock(&Transaction.lock);
+
+    return Transaction_Commit(psql_conn, stage);
+}
+
+/**
+ * Set a savepoint before a unit of work (e.g. a bulk load).
+ *
+ * If no transaction is open on the connection nothing is done. Units
+ * started inside a unit join it.
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Transaction_UnitBegin(PGconn* psql_conn) {
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction_Active_TypeDef* active = Transaction_Find(psql_conn);
+    bool outer = active != NULL && active->units_open++ == 0;
+    pthread_mutex_unlock(&Transaction.lock);
+    if (!outer) {
+        return 0;
+    }
+
+    // A statement outside any unit failed, so only a rollback can recover
+    if (PQtransactionStatus(psql_conn) == PQTRANS_INERROR) {
+        log_error("Transaction aborted outside a savepoint, rows written "
+                  "since the last commit are lost.\n");
+        Transaction_Command(psql_conn, "ROLLBACK;");
+        Transaction_Command(psql_conn, "BEGIN;");
+        pthread_mutex_lock(&Transaction.lock);
+        active->pending = 0;
+        pthread_mutex_unlock(&Transaction.lock);
+    }
+
+    return Transaction_Command(psql_conn,
+                               "SAVEPOINT " TRANSACTION_SAVEPOINT ";");
+}
+
+/**
+ * Finish a unit of work.
+ *
+ * A unit that failed is rolled back to its savepoint, so the rest of the
+ * transaction is kept. Otherwise the savepoint is released and, once the
+ * rows written since the last commit reach TRANSACTION_ROWS_PER_COMMIT, the
+ * transaction is committed and a new one started.
+ *
+ * @param psql_conn PostgreSQL connection handler.
+ * @param rows Rows written by the unit (-1 if it failed).
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Transaction_UnitEnd(PGconn* psql_conn, int64_t rows) {
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction_Active_TypeDef* active = Transaction_Find(psql_conn);
+    if (active == NULL || active->units_open == 0 ||
+        --active->units_open > 0) {
+        pthread_mutex_unlock(&Transaction.lock);
+        return 0;
+    }
+    Transaction_Stats_TypeDef* stats = &Transaction.stages[active->stage];
+    if (active->unit_lost) {
+        active->unit_lost = false;
+        rows = -1;
+    }
+    pthread_mutex_unlock(&Transaction.lock);
+
+    if (rows < 0) {
+        log_warn("Rolling back a failed unit of %s.\n", stats->name);
+        pthread_mutex_lock(&Transaction.lock);
+        stats->rollbacks++;
+        pthread_mutex_unlock(&Transaction.lock);
+        return Transaction_Command(psql_conn,
+                                   "ROLLBACK TO SAVEPOINT "
+                                   TRANSACTION_SAVEPOINT "; "
+                                   "RELEASE SAVEPOINT "
+                                   TRANSACTION_SAVEPOINT ";");
+    }
+
+    if (Transaction_Command(psql_conn, "RELEASE SAVEPOINT "
+                                       TRANSACTION_SAVEPOINT ";") != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&Transaction.lock);
+    stats->units++;
+    stats->rows += (uint64_t)rows;
+    active->pending += (uint64_t)rows;
+    bool commit = active->pending >= Transaction.rows_per_commit;
+    if (commit) {
+        active->pending = 0;
+    }
+    uint16_t stage = active->stage;
+    pthread_mutex_unlock(&Transaction.lock);
+
+    if (!commit) {
+        return 0;
+    }
+    if (Transaction_Commit(psql_conn, stage) != 0) {
+        return -1;
+    }
+    return Transaction_Command(psql_conn, "BEGIN;");
+}
+
+/**
+ * Start the transaction of a stage again after its connection was reset.
+ *
+ * A reset (see Statements_Prepare()) opens a new server session, so the
+ * transaction of the stage and every row written since the last commit are
+ * gone. The loss is logged and the transaction is started again (with the
+ * savepoint of an open unit) so the rest of the stage is still written in
+ * a transaction. The open unit has lost its earlier rows, so it is rolled
+ * back when it ends (see Transaction_UnitEnd()).
+ *
+ * Does nothing if no transaction is open on the connection.
+ *
+ * @param psql_conn PostgreSQL connection handler (just reset).
+ * @return Error code. 0 = OK ... -1 = ERROR (the stage's slot is released
+ * and its statements autocommit)
+ */
+int8_t Transaction_Reconnected(PGconn* psql_conn) {
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction_Active_TypeDef* active = Transaction_Find(psql_conn);
+    if (active == NULL) {
+        pthread_mutex_unlock(&Transaction.lock);
+        return 0;
+    }
+    Transaction_Stats_TypeDef* stats = &Transaction.stages[active->stage];
+    bool unit = active->units_open > 0;
+    active->pending = 0;
+    active->unit_lost = unit;
+    pthread_mutex_unlock(&Transaction.lock);
+
+    log_error("PostgreSQL connection reset during %s, rows written since "
+              "the last commit are lost.\n", stats->name);
+
+    if (Transaction_Command(psql_conn, "BEGIN;") != 0 ||
+        (unit && Transaction_Command(psql_conn, "SAVEPOINT "
+                                     TRANSACTION_SAVEPOINT ";") != 0)) {
+        log_error("Unable to restart the transaction of %s, its statements "
+                  "will autocommit.\n", stats->name);
+        pthread_mutex_lock(&Transaction.lock);
+        active->psql_conn = NULL;
+        pthread_mutex_unlock(&Transaction.lock);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Log the units, rows, commits and time spent committing of each stage.
+ *
+ * Commit time is bound by the WAL flush (fsync) of each commit, which is
+ * what writing more rows per commit saves.
+ */
+void Transaction_LogStats(void) {
+    pthread_mutex_lock(&Transaction.lock);
+    for (uint16_t i = 0; i < Transaction.n_stages; i++) {
+        Transaction_Stats_TypeDef* stats = &Transaction.stages[i];
+        log_info("%s: %llu rows in %u units (%u rolled back), %u commits, "
+                 "%.3f s committing.\n", stats->name,
+                 (unsigned long long)stats->rows, stats->units,
+                 stats->rollbacks, stats->commits, stats->commit_time);
+    }
+    pthread_mutex_unlock(&Transaction.lock);
+}
+
+static Transaction_Active_TypeDef* Transaction_Find(PGconn* psql_conn) {
+    for (int i = 0; i < TRANSACTION_MAX_ACTIVE; i++) {
+        if (Transaction.active[i].psql_conn == psql_conn) {
+            return &Transaction.active[i];
+        }
+    }
+    return NULL;
+}
+
+static int Transaction_StageIndex(const char* stage) {
+    for (uint16_t i = 0; i < Transaction.n_stages; i++) {
+        if (strcmp(Transaction.stages[i].name, stage) == 0) {
+            return i;
+        }
+    }
+    if (Transaction.n_stages == TRANSACTION_MAX_STAGES) {
+        return -1;
+    }
+    Transaction.stages[Transaction.n_stages].name = stage;
+    return Transaction.n_stages++;
+}
+
+static int8_t Transaction_Command(PGconn* psql_conn, const char* command) {
+    PGresult* res = PQexec(psql_conn, command);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        log_error("Unable to run %s Error: %s\n", command,
+                  PQerrorMessage(psql_conn));
+        PQclear(res);
+        return -1;
+    }
+    PQclear(res);
+    return 0;
+}
+
+static int8_t Transaction_Commit(PGconn* psql_conn, uint16_t stage) {
+    // COMMIT of an aborted transaction silently rolls back
+    if (PQtransactionStatus(psql_conn) == PQTRANS_INERROR) {
+        log_error("Transaction aborted, rows written since the last commit "
+                  "are lost.\n");
+        return Transaction_Command(psql_conn, "ROLLBACK;");
+    }
+
+    double started = Transport_Now();
+    int8_t status = Transaction_Command(psql_conn, "COMMIT;");
+    double elapsed = Transport_Now() - started;
+
+    pthread_mutex_lock(&Transaction.lock);
+    Transaction.stages[stage].commit_time += elapsed;
+    if (status == 0) {
+        Transaction.stages[stage].commits++;
+    }
+    pthread_mutex_unlock(&Transaction.lock);
+    return status;
+}
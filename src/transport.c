@@ -0,0 +1,545 @@
+#include "transport.h"
+
+/// Characters in a corpus key (64 bit hash as hex + null)
+#define TRANSPORT_KEY_SIZE              17
+/// Max characters in a line of a .meta file
+#define TRANSPORT_META_LINE_SIZE        2048
+/// Number of JSON fields scrubbed from recorded bodies
+#define TRANSPORT_N_SECRET_FIELDS       3
+
+/// JSON fields of responses holding credentials (e.g. OAuth2 token grants)
+static const char* const Transport_SecretFields[TRANSPORT_N_SECRET_FIELDS] = {
+        "\"access_token\"", "\"refresh_token\"", "\"id_token\""
+};
+
+/// Transport settings, registered secrets and network time
+static struct {
+    uint8_t mode; ///< TRANSPORT_LIVE, TRANSPORT_RECORD or TRANSPORT_REPLAY
+    char corpus[TRANSPORT_PATH_SIZE]; ///< Directory holding the corpus
+    double latency; ///< Latency injected for each replayed response (s)
+    pthread_mutex_t lock; ///< Protects the secrets and counters
+    char* secrets[TRANSPORT_MAX_SECRETS]; ///< Credentials hidden from keys
+    uint8_t n_secrets; ///< Number of registered secrets
+    double network_time; ///< Time spent waiting on the network (s)
+    uint32_t recorded; ///< Responses written to the corpus
+    uint32_t replayed; ///< Responses served from the corpus
+} Transport = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/// Hash a request (URL and body, secrets hidden) into a corpus key
+static void Transport_Key(const char* url, const char* body, char* key);
+
+/// Add a string to a hash (registered secrets hash as a placeholder)
+static uint64_t Transport_HashString(uint64_t hash, const char* str);
+
+/// Path of a corpus file (`ext` is "body" or "meta")
+static void Transport_Path(const char* key, const char* ext, char* path,
+                           size_t path_size);
+
+/// Write a response body with the value of each credential field replaced
+static bool Transport_WriteBody(FILE* file, const char* data, size_t size);
+
+/**
+ * Read the transport mode from the environment.
+ *
+ * The mode is set with TRANSPORT_MODE:
+ *
+ * - live (default): requests go to the network as normal.
+ * - record: requests go to the network and every request/response pair is
+ *   saved to the corpus (TRANSPORT_CORPUS, default tmp/corpus).
+ * - replay: no network access. Responses are served from the corpus after
+ *   waiting TRANSPORT_REPLAY_LATENCY_MS (default 0).
+ *
+ * Record and replay apply to HttpRequest(), HttpRequestRaw(), FTPRequest()
+ * and Fetch_Batch(). A recorded corpus lets the whole pipeline run offline
+ * (e.g. against a local PostgreSQL database) without any API credentials so
+ * parse and database throughput can be measured apart from network time
+ * (see Transport_StageBegin()).
+ *
+ * @code
+ * // TRANSPORT_MODE=record ./program   (with credentials, once)
+ * // TRANSPORT_MODE=replay TRANSPORT_REPLAY_LATENCY_MS=50 ./program
+ * curl_global_init(CURL_GLOBAL_ALL);
+ * Transport_Init();
+ * @endcode
+ *
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Transport_Init(void) {
+    const char* mode = getenv(TRANSPORT_MODE_ENV);
+    const char* corpus = getenv(TRANSPORT_CORPUS_ENV);
+    const char* latency = getenv(TRANSPORT_LATENCY_ENV);
+
+    Transport.mode = TRANSPORT_LIVE;
+    if (mode != NULL && strcasecmp(mode, "record") == 0) {
+        Transport.mode = TRANSPORT_RECORD;
+    } else if (mode != NULL && strcasecmp(mode, "replay") == 0) {
+        Transport.mode = TRANSPORT_REPLAY;
+    } else if (mode != NULL && mode[0] != '\0' &&
+               strcasecmp(mode, "live") != 0) {
+        log_error("Unknown transport mode: %s (expected live, record or "
+                  "replay)\n", mode);
+        return -1;
+    }
+
+    snprintf(Transport.corpus, sizeof(Transport.corpus), "%s",
+             (corpus != NULL && corpus[0] != '\0') ? corpus :
+             TRANSPORT_DEFAULT_CORPUS);
+    Transport.latency = (latency != NULL) ? strtod(latency, NULL) / 1000.0 :
+                        0.0;
+    if (Transport.latency < 0.0) Transport.latency = 0.0;
+
+    if (Transport.mode == TRANSPORT_RECORD) {
+        // Create each parent directory (e.g. tmp then tmp/corpus)
+        char path[TRANSPORT_PATH_SIZE];
+        snprintf(path, sizeof(path), "%s", Transport.corpus);
+        for (char* c = path + 1; *c != '\0'; c++) {
+            if (*c == '/') {
+                *c = '\0';
+                MakeDirectory(path);
+                *c = '/';
+            }
+        }
+        if (MakeDirectory(path) != 0) {
+            log_error("Unable to create corpus directory. Requests will not "
+                      "be recorded.\n");
+            Transport.mode = TRANSPORT_LIVE;
+            return -1;
+        }
+        log_info("Recording responses to %s\n", Transport.corpus);
+    } else if (Transport.mode == TRANSPORT_REPLAY) {
+        log_info("Replaying responses from %s (%.0f ms latency)\n",
+                 Transport.corpus, Transport.latency * 1000.0);
+    }
+
+    return 0;
+}
+
+/**
+ * Current transport mode.
+ *
+ * @return TRANSPORT_LIVE, TRANSPORT_RECORD or TRANSPORT_REPLAY.
+ */
+uint8_t Transport_Mode(void) {
+    return Transport.mode;
+}
+
+/**
+ * Latency injected for each replayed response.
+ *
+ * @return Latency (s).
+ */
+double Transport_ReplayLatency(void) {
+    return Transport.latency;
+}
+
+/**
+ * Hide a credential from corpus keys.
+ *
+ * Some credentials are sent in the URL (Willy Weather) or body (IBM EIS
+ * authentication). Registered secrets are replaced by a placeholder before a
+ * request is hashed, so a corpus recorded with real credentials can be
+ * replayed with TRANSPORT_REPLAY_SECRET in their place. Registered secrets
+ * are hidden in the URLs of the corpus, and credentials received in a
+ * response (see Transport_Record()) are replaced before it is saved.
+ *
+ * @param secret Credential (copied).
+ */
+void Transport_AddSecret(const char* secret) {
+    if (secret == NULL || secret[0] == '\0') {
+        return;
+    }
+
+    pthread_mutex_lock(&Transport.lock);
+    for (uint8_t i = 0; i < Transport.n_secrets; i++) {
+        if (strcmp(Transport.secrets[i], secret) == 0) {
+            pthread_mutex_unlock(&Transport.lock);
+            return;
+        }
+    }
+    if (Transport.n_secrets < TRANSPORT_MAX_SECRETS) {
+        Transport.secrets[Transport.n_secrets] = strdup(secret);
+        if (Transport.secrets[Transport.n_secrets] != NULL) {
+            Transport.n_secrets++;
+        }
+    } else {
+        log_warn("Max number of transport secrets exceeded.\n");
+    }
+    pthread_mutex_unlock(&Transport.lock);
+}
+
+/**
+ * Check if a request has been recorded.
+ *
+ * @param url Request URL.
+ * @param body POST body (NULL for GET or FTP requests).
+ * @return True if the corpus holds a response to the request.
+ */
+bool Transport_Recorded(const char* url, const char* body) {
+    char key[TRANSPORT_KEY_SIZE];
+    Transport_Key(url, body, key);
+
+    char path[TRANSPORT_PATH_SIZE];
+    Transport_Path(key, "meta", path, sizeof(path));
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * Load a recorded response into a response buffer.
+ *
+ * The result of the original transfer is returned so failed requests are
+ * replayed as failures. Replayed responses are never flagged as not
+ * modified, so callers parse (and write) every one of them.
+ *
+ * @param url Request URL.
+ * @param body POST body (NULL for GET or FTP requests).
+ * @param data Response buffer to populate.
+ * @return Result of the recorded transfer (CURLE_COULDNT_CONNECT if the
+ * request was never recorded).
+ */
+CURLcode Transport_Load(const char* url, const char* body,
+                        Utils_ReqData_TypeDef* data) {
+    char key[TRANSPORT_KEY_SIZE];
+    Transport_Key(url, body, key);
+
+    char path[TRANSPORT_PATH_SIZE];
+    Transport_Path(key, "meta", path, sizeof(path));
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        log_error("No recorded response for %s\n", url);
+        return CURLE_COULDNT_CONNECT;
+    }
+
+    CURLcode result = CURLE_OK;
+    char line[TRANSPORT_META_LINE_SIZE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "result ", 7) == 0) {
+            result = (CURLcode)strtol(line + 7, NULL, 10);
+        }
+    }
+    fclose(file);
+
+    Transport_Path(key, "body", path, sizeof(path));
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        log_error("Recorded response for %s is missing its body.\n", url);
+        return CURLE_COULDNT_CONNECT;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    Utils_ReqDataReset(data, NULL);
+    data->expected = (file_size > 0) ? (size_t)file_size : 0;
+
+    char chunk[TRANSPORT_READ_CHUNK_SIZE];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        if (WriteMemoryCallback(chunk, 1, n, data) != n) {
+            fclose(file);
+            return CURLE_OUT_OF_MEMORY;
+        }
+    }
+    fclose(file);
+
+    pthread_mutex_lock(&Transport.lock);
+    Transport.replayed++;
+    pthread_mutex_unlock(&Transport.lock);
+
+    return result;
+}
+
+/**
+ * Load a recorded response and wait for the injected latency.
+ *
+ * The injected latency is counted as network time.
+ *
+ * @param url Request URL.
+ * @param body POST body (NULL for GET or FTP requests).
+ * @param data Response buffer to populate.
+ * @return Result of the recorded transfer.
+ */
+CURLcode Transport_Replay(const char* url, const char* body,
+                          Utils_ReqData_TypeDef* data) {
+    CURLcode result = Transport_Load(url, body, data);
+    Transport_InjectLatency();
+    return result;
+}
+
+/**
+ * Wait for the latency injected in replay mode.
+ *
+ * The latency is counted as network time. Does nothing outside of replay
+ * mode or if no latency has been set.
+ */
+void Transport_InjectLatency(void) {
+    if (Transport.mode != TRANSPORT_REPLAY || Transport.latency <= 0.0) {
+        return;
+    }
+
+    struct timespec delay = {
+            .tv_sec = (time_t)Transport.latency,
+            .tv_nsec = (long)((Transport.latency -
+                               (double)(time_t)Transport.latency) * 1e9)
+    };
+    nanosleep(&delay, NULL);
+    Transport_AddNetworkTime(Transport.latency);
+}
+
+/**
+ * Save a request/response pair to the corpus.
+ *
+ * Does nothing unless the transport is in record mode. The body is written
+ * before the .meta file so an interrupted write never leaves a .meta file
+ * pointing at a partial body. The .meta file holds the URL (secrets hidden),
+ * the cURL result and the response code.
+ *
+ * Tokens granted by an authentication response are never saved: the values
+ * of its access_token, refresh_token and id_token fields are replaced with
+ * TRANSPORT_REPLAY_SECRET. Callers sending a granted token in a later URL or
+ * body register it with Transport_AddSecret() so the request is keyed the
+ * same way when the placeholder is sent in replay mode.
+ *
+ * @param url Request URL.
+ * @param body POST body (NULL for GET or FTP requests).
+ * @param curl Handle used for the transfer (may be NULL).
+ * @param result Result of the transfer.
+ * @param data Response buffer.
+ */
+void Transport_Record(const char* url, const char* body, CURL* curl,
+                      CURLcode result, const Utils_ReqData_TypeDef* data) {
+    if (Transport.mode != TRANSPORT_RECORD) {
+        return;
+    }
+
+    char key[TRANSPORT_KEY_SIZE];
+    Transport_Key(url, body, key);
+
+    char path[TRANSPORT_PATH_SIZE];
+    Transport_Path(key, "meta", path, sizeof(path));
+    remove(path);
+
+    Transport_Path(key, "body", path, sizeof(path));
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        log_error("Unable to record response: %s\n", path);
+        return;
+    }
+    size_t size = (data->memory != NULL) ? data->size : 0;
+    bool written = Transport_WriteBody(file, data->memory, size);
+    fclose(file);
+    if (!written) {
+        log_error("Unable to record response: %s\n", path);
+        return;
+    }
+
+    long response_code = 0;
+    if (curl != NULL) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+    }
+
+    Transport_Path(key, "meta", path, sizeof(path));
+    file = fopen(path, "w");
+    if (file == NULL) {
+        log_error("Unable to record response: %s\n", path);
+        return;
+    }
+
+    // URL is only kept to make the corpus readable, secrets are hidden
+    fprintf(file, "url ");
+    pthread_mutex_lock(&Transport.lock);
+    for (const char* c = url; *c != '\0';) {
+        bool hidden = false;
+        for (uint8_t i = 0; i < Transport.n_secrets && !hidden; i++) {
+            size_t length = strlen(Transport.secrets[i]);
+            if (strncmp(c, Transport.secrets[i], length) == 0) {
+                fprintf(file, "{secret}");
+                c += length;
+                hidden = true;
+            }
+        }
+        if (!hidden) fputc(*c++, file);
+    }
+    pthread_mutex_unlock(&Transport.lock);
+    fprintf(file, "\n");
+    fprintf(file, "result %d\n", (int)result);
+    fprintf(file, "response_code %ld\n", response_code);
+    fclose(file);
+
+    pthread_mutex_lock(&Transport.lock);
+    Transport.recorded++;
+    pthread_mutex_unlock(&Transport.lock);
+}
+
+/**
+ * Add time spent waiting on the network.
+ *
+ * In live and record mode this is the time spent in transfers. In replay
+ * mode it is the injected latency.
+ *
+ * @param seconds Time to add (s).
+ */
+void Transport_AddNetworkTime(double seconds) {
+    pthread_mutex_lock(&Transport.lock);
+    Transport.network_time += seconds;
+    pthread_mutex_unlock(&Transport.lock);
+}
+
+/**
+ * Monotonic time in seconds.
+ *
+ * @return Time (s).
+ */
+double Transport_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Start timing a stage of the pipeline.
+ *
+ * @code
+ * Transport_Stage_TypeDef stage;
+ * Transport_StageBegin(&stage, "BOM timeseries");
+ * BOM_TimeseriesToDB(start_dt, BOM_SYNC_INCREMENTAL, psql_conn);
+ * Transport_StageEnd(&stage);
+ * // BOM timeseries: 12.400 s (network 9.100 s, processing 3.300 s)
+ * @endcode
+ *
+ * @param stage Stage timer to start.
+ * @param name Name of the stage (must outlive the timer).
+ */
+void Transport_StageBegin(Transport_Stage_TypeDef* stage, const char* name) {
+    stage->name = name;
+    pthread_mutex_lock(&Transport.lock);
+    stage->network_at_start = Transport.network_time;
+    pthread_mutex_unlock(&Transport.lock);
+    stage->started = Transport_Now();
+}
+
+/**
+ * Log the time of a stage split into network and processing time.
+ *
+ * Processing time is everything else (parsing, database writes etc.). When
+ * requests run concurrently (see Fetch_Batch()) network time is the time
+ * the batch spent waiting on transfers, not the sum of every transfer.
+ *
+ * @param stage Stage timer from Transport_StageBegin().
+ */
+void Transport_StageEnd(Transport_Stage_TypeDef* stage) {
+    double total = Transport_Now() - stage->started;
+
+    pthread_mutex_lock(&Transport.lock);
+    double network = Transport.network_time - stage->network_at_start;
+    uint32_t recorded = Transport.recorded;
+    uint32_t replayed = Transport.replayed;
+    pthread_mutex_unlock(&Transport.lock);
+
+    if (network > total) network = total;
+
+    log_info("%s: %.3f s (network %.3f s, processing %.3f s)\n",
+             stage->name, total, network, total - network);
+    if (Transport.mode == TRANSPORT_RECORD) {
+        log_info("%u responses recorded so far.\n", recorded);
+    } else if (Transport.mode == TRANSPORT_REPLAY) {
+        log_info("%u responses replayed so far.\n", replayed);
+    }
+}
+
+/**
+ * Hash a request into a corpus key using 64 bit FNV-1a.
+ *
+ * @param url Request URL.
+ * @param body POST body (may be NULL).
+ * @param key Key to populate (TRANSPORT_KEY_SIZE characters).
+ */
+static void Transport_Key(const char* url, const char* body, char* key) {
+    pthread_mutex_lock(&Transport.lock);
+    uint64_t hash = Transport_HashString(14695981039346656037ULL, url);
+
+    // Separator so "ab" + "c" and "a" + "bc" differ
+    hash ^= 0xFF;
+    hash *= 1099511628211ULL;
+
+    if (body != NULL) {
+        hash = Transport_HashString(hash, body);
+    }
+    pthread_mutex_unlock(&Transport.lock);
+
+    snprintf(key, TRANSPORT_KEY_SIZE, "%016llx", (unsigned long long)hash);
+}
+
+static uint64_t Transport_HashString(uint64_t hash, const char* str) {
+    const char* c = str;
+    while (*c != '\0') {
+        bool hidden = false;
+        for (uint8_t i = 0; i < Transport.n_secrets && !hidden; i++) {
+            size_t length = strlen(Transport.secrets[i]);
+            if (strncmp(c, Transport.secrets[i], length) == 0) {
+                for (const char* p = "{secret}"; *p != '\0'; p++) {
+                    hash ^= (uint8_t)*p;
+                    hash *= 1099511628211ULL;
+                }
+                c += length;
+                hidden = true;
+            }
+        }
+        if (!hidden) {
+            hash ^= (uint8_t)*c++;
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static void Transport_Path(const char* key, const char* ext, char* path,
+                           size_t path_size) {
+    snprintf(path, path_size, "%s/%s.%s", Transport.corpus, key, ext);
+}
+
+static bool Transport_WriteBody(FILE* file, const char* data, size_t size) {
+    size_t start = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != '"') continue;
+
+        // A credential field is followed by optional spaces, a colon and a
+        // string value
+        size_t value = 0;
+        for (uint8_t f = 0; f < TRANSPORT_N_SECRET_FIELDS && value == 0; f++) {
+            size_t length = strlen(Transport_SecretFields[f]);
+            if (size - i < length ||
+                memcmp(data + i, Transport_SecretFields[f], length) != 0) {
+                continue;
+            }
+            size_t c = i + length;
+            while (c < size && isspace((unsigned char)data[c])) c++;
+            if (c >= size || data[c++] != ':') continue;
+            while (c < size && isspace((unsigned char)data[c])) c++;
+            if (c < size && data[c] == '"') value = c + 1;
+        }
+        if (value == 0) continue;
+
+        size_t end = value;
+        while (end < size && data[end] != '"') {
+            end += (data[end] == '\\') ? 2 : 1;
+        }
+        if (end >= size) break;
+
+        // Everything up to the opening quote, then the placeholder
+        if (fwrite(data + start, 1, value - start, file) != value - start ||
+            fputs(TRANSPORT_REPLAY_SECRET, file) == EOF) {
+            return false;
+        }
+        start = end;
+        i = end;
+    }
+
+    return fwrite(data + start, 1, size - start, file) == size - start;
+}
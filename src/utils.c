@@ -1,5 +1,75 @@
 #include "utils.h"
 
+/// Points handled per call to the haversine kernel by Utils_PointsNearest()
+#define UTILS_POINTS_CHUNK              64
+
+/// Send a command that returns no rows in pipeline mode (e.g. SAVEPOINT)
+static int8_t Utils_PipelineSendCommand(PGconn* psql_conn,
+                                        const char* command);
+
+/// Send a statement of the current block
+static int8_t Utils_PipelineSend(Utils_Pipeline_TypeDef* pipeline,
+                                 const Utils_PipelineRow_TypeDef* row);
+
+/// Sync the current block and collect its results (sending it again if a
+/// statement failed), then start the next block if `next` is set
+static int8_t Utils_PipelineCollect(Utils_Pipeline_TypeDef* pipeline,
+                                    bool next);
+
+/// Haversine term (sin^2 of half the angle) for points start to end
+static void Utils_PointsHaversine(double latitude, double longitude,
+                                  const Utils_Points_TypeDef* points,
+                                  size_t start, size_t end, double* h);
+
+/**
+ * Allocate an empty (null-terminated) response buffer.
+ *
+ * @code
+ *      Utils_ReqData_TypeDef chunk;
+ *      Utils_ReqDataInit(&chunk, curl);
+ *      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+ *      curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+ *      free(chunk.memory) // Don't forget to free allocation
+ * @endcode
+ *
+ * @param data Response buffer to initialise.
+ * @param curl Handle that will receive the data (may be NULL).
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Utils_ReqDataInit(Utils_ReqData_TypeDef *data, CURL *curl) {
+    data->memory = malloc(UTILS_REQ_DATA_MIN_SIZE);
+    data->capacity = (data->memory != NULL) ? UTILS_REQ_DATA_MIN_SIZE : 0;
+    data->size = 0;
+    data->expected = 0;
+    data->curl = curl;
+    data->not_modified = false;
+    if (data->memory == NULL) {
+        log_error("Not enough memory to hold HTTP response data.\n");
+        return -1;
+    }
+    data->memory[0] = '\0';
+    return 0;
+}
+
+/**
+ * Empty a response buffer so it can be reused for another transfer.
+ *
+ * The allocation is kept so the next transfer doesn't need to grow the
+ * buffer again (see http_pool.h).
+ *
+ * @param data Response buffer to reset.
+ * @param curl Handle that will receive the data (may be NULL).
+ */
+void Utils_ReqDataReset(Utils_ReqData_TypeDef *data, CURL *curl) {
+    data->size = 0;
+    data->expected = 0;
+    data->curl = curl;
+    data->not_modified = false;
+    if (data->memory != NULL) {
+        data->memory[0] = '\0';
+    }
+}
+
 /**
  * Callback function to save HTTP response data to a character array.
  *
@@ -8,10 +78,14 @@
  * filled with the response string. This character array is then used to create
  * cJSON objects and other items.
  *
+ * The buffer is grown geometrically (doubling) rather than by the size of
+ * each chunk, which avoids copying the whole response on every chunk. When
+ * the server provides a Content-Length (or the FTP SIZE) the buffer is
+ * pre-sized to hold the whole response in one allocation.
+ *
  * @code
- *      MemoryStruct_TypeDef chunk;
- *      chunk.memory = malloc(1);
- *      chunk.size = 0;
+ *      Utils_ReqData_TypeDef chunk;
+ *      Utils_ReqDataInit(&chunk, curl);
  *      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
  *      curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
  *      free(chunk.memory) // Don't forget to free allocation
@@ -31,14 +105,39 @@ size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb,
 
     Utils_ReqData_TypeDef *mem = (Utils_ReqData_TypeDef *) userp;
 
-    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
+    size_t required = mem->size + realsize + 1;
+    if (required > mem->capacity) {
+        // Expected size is known once the response headers have arrived
+        if (mem->expected == 0 && mem->curl != NULL) {
+            curl_off_t content_length = -1;
+            if (curl_easy_getinfo(mem->curl,
+                                  CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                                  &content_length) == CURLE_OK &&
+                content_length > 0 &&
+                content_length < UTILS_REQ_DATA_MAX_PRESIZE) {
+                mem->expected = (size_t)content_length;
+            }
+        }
 
-    if (ptr == NULL) {
-        log_error("Not enough memory to hold HTTP response data.\n");
-        return 0;
+        size_t new_capacity = mem->capacity * 2;
+        if (mem->expected + 1 > new_capacity) {
+            new_capacity = mem->expected + 1;
+        }
+        if (required > new_capacity) {
+            new_capacity = required;
+        }
+
+        char *ptr = realloc(mem->memory, new_capacity);
+
+        if (ptr == NULL) {
+            log_error("Not enough memory to hold HTTP response data.\n");
+            return 0;
+        }
+
+        mem->memory = ptr;
+        mem->capacity = new_capacity;
     }
 
-    mem->memory = ptr;
     memcpy(&(mem->memory[mem->size]), contents, realsize);
     mem->size += realsize;
     mem->memory[mem->size] = 0;
@@ -136,13 +235,18 @@ void WriteTimeseriesToFile(const char *filename, time_t *dates, double *values,
  *
  * @see https://github.com/DaveGamble/cJSON/blob/master/cJSON.c#L2838
  *
+ * The new length of the string is returned so callers don't need to scan
+ * the (minified) string again with strlen().
+ *
  * @param json The string to minify (parse).
+ * @return Length of the minified string.
  */
-void cJSON_Minify_Mod(char *json) {
+size_t cJSON_Minify_Mod(char *json) {
     char *into = json;
+    const char *start = json;
 
     if (json == NULL) {
-        return;
+        return 0;
     }
 
     char prev_char;
@@ -172,6 +276,8 @@ void cJSON_Minify_Mod(char *json) {
 
     /* and null-terminate. */
     *into = '\0';
+
+    return (size_t)(into - start);
 }
 
 /**
@@ -199,18 +305,543 @@ double Utils_PointsDistance(double latitude,
 }
 
 
-void Utils_PrepareStatement(PGconn* psql_conn, const char* stmt_name,
-                            const char* stmt, const int nparams){
-    // Get historical and future forecast information
-    PGresult* info = PQdescribePrepared(psql_conn, stmt_name);
-    if(PQresultStatus(info) != PGRES_COMMAND_OK){
-        PGresult* prepare = PQprepare(psql_conn, stmt_name, stmt,
-                                      nparams, NULL);
-        if(PQresultStatus(prepare) != PGRES_COMMAND_OK){
-            log_error("PostgreSQL prepare error: %s\n",
+/**
+ * Allocate packed points.
+ *
+ * Points are held as a structure of arrays rather than interleaved with
+ * other data (e.g. BOM_WeatherStation_TypeDef names), so a batch of
+ * distances streams through memory in order. Each array is aligned for
+ * SIMD loads.
+ *
+ * Station lookups in the pipeline go through the k-d tree (see
+ * BOM_StationIndexBuild()), which visits O(log n) stations. Packed points
+ * are only used by Bench_PointsDistance(), as the batched brute force
+ * reference it times against Utils_PointsDistance().
+ *
+ * @code
+ * Utils_Points_TypeDef points;
+ * Utils_PointsInit(&points, (size_t)stations.count);
+ * for (int16_t i = 0; i < stations.count; i++) {
+ *     Utils_PointsAdd(&points, stations.stations[i].latitude,
+ *                     stations.stations[i].longitude);
+ * }
+ * double distance;
+ * int64_t closest = Utils_PointsNearest(-35.9, 150.1, &points, &distance);
+ * Utils_PointsFree(&points);
+ * @endcode
+ *
+ * @param points Points to initialise.
+ * @param capacity Max number of points.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Utils_PointsInit(Utils_Points_TypeDef* points, size_t capacity) {
+    memset(points, 0, sizeof(Utils_Points_TypeDef));
+
+    // Padding keeps every array aligned and whole vectors in bounds
+    capacity = (capacity + UTILS_POINTS_ALIGN - 1) /
+               UTILS_POINTS_ALIGN * UTILS_POINTS_ALIGN;
+    if (capacity == 0) capacity = UTILS_POINTS_ALIGN;
+
+    double* arrays[4] = {NULL, NULL, NULL, NULL};
+    for (uint8_t i = 0; i < 4; i++) {
+        void* memory = NULL;
+        if (posix_memalign(&memory, UTILS_POINTS_ALIGN * sizeof(double),
+                           capacity * sizeof(double)) != 0) {
+            log_error("Not enough memory to hold points.\n");
+            for (uint8_t j = 0; j < i; j++) free(arrays[j]);
+            return -1;
+        }
+        arrays[i] = memory;
+        memset(arrays[i], 0, capacity * sizeof(double));
+    }
+
+    points->sin_latitude = arrays[0];
+    points->cos_latitude = arrays[1];
+    points->sin_longitude = arrays[2];
+    points->cos_longitude = arrays[3];
+    points->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ * Add a point.
+ *
+ * The sine and cosine of the latitude and longitude are computed once here
+ * rather than for every distance.
+ *
+ * @param points Points from Utils_PointsInit().
+ * @param latitude Latitude of point.
+ * @param longitude Longitude of point.
+ * @return Error code. 0 = OK ... -1 = ERROR (full)
+ */
+int8_t Utils_PointsAdd(Utils_Points_TypeDef* points, double latitude,
+                       double longitude) {
+    if (points->count >= points->capacity) {
+        log_error("Unable to add point. Max number of points exceeded.\n");
+        return -1;
+    }
+
+    double p = M_PI / 180;
+    points->sin_latitude[points->count] = sin(latitude * p);
+    points->cos_latitude[points->count] = cos(latitude * p);
+    points->sin_longitude[points->count] = sin(longitude * p);
+    points->cos_longitude[points->count] = cos(longitude * p);
+    points->count++;
+
+    return 0;
+}
+
+/**
+ * Free packed points.
+ *
+ * @param points Points from Utils_PointsInit().
+ */
+void Utils_PointsFree(Utils_Points_TypeDef* points) {
+    free(points->sin_latitude);
+    free(points->cos_latitude);
+    free(points->sin_longitude);
+    free(points->cos_longitude);
+    memset(points, 0, sizeof(Utils_Points_TypeDef));
+}
+
+/**
+ * Distance in km between a point and every packed point.
+ *
+ * Same result as Utils_PointsDistance() (the scalar reference) for each
+ * point. The haversine terms are rewritten with
+ * sin^2(d / 2) = (1 - cos(a)cos(b) - sin(a)sin(b)) / 2, so with the
+ * trigonometry of each packed point precomputed the inner loop is only
+ * multiplies and adds. It runs 4 points at a time with AVX or 2 with SSE2
+ * (whichever the compiler targets), and only asin() and sqrt() are left per
+ * point.
+ *
+ * @param latitude Latitude of point of interest.
+ * @param longitude Longitude of point of interest.
+ * @param points Points to measure to.
+ * @param distances Distance to each point in km (points->count values).
+ */
+void Utils_PointsDistanceBatch(double latitude, double longitude,
+                               const Utils_Points_TypeDef* points,
+                               double* distances) {
+    Utils_PointsHaversine(latitude, longitude, points, 0, points->count,
+                          distances);
+    for (size_t i = 0; i < points->count; i++) {
+        distances[i] = 12742.0 * asin(sqrt(distances[i]));
+    }
+}
+
+/**
+ * Find the closest packed point.
+ *
+ * The haversine term grows with distance, so points are compared on it and
+ * asin() and sqrt() are only evaluated once for the closest point.
+ *
+ * @param latitude Latitude of point of interest.
+ * @param longitude Longitude of point of interest.
+ * @param points Points to search.
+ * @param distance Distance to the closest point in km (may be NULL).
+ * @return Index of the closest point (-1 if there are no points).
+ */
+int64_t Utils_PointsNearest(double latitude, double longitude,
+                            const Utils_Points_TypeDef* points,
+                            double* distance) {
+    int64_t closest = -1;
+    double min_h = INFINITY;
+    double h[UTILS_POINTS_CHUNK];
+
+    for (size_t start = 0; start < points->count;
+         start += UTILS_POINTS_CHUNK) {
+        size_t end = start + UTILS_POINTS_CHUNK;
+        if (end > points->count) end = points->count;
+
+        Utils_PointsHaversine(latitude, longitude, points, start, end, h);
+        for (size_t i = start; i < end; i++) {
+            if (h[i - start] < min_h) {
+                min_h = h[i - start];
+                closest = (int64_t)i;
+            }
+        }
+    }
+
+    if (distance != NULL && closest >= 0) {
+        *distance = 12742.0 * asin(sqrt(min_h));
+    }
+
+    return closest;
+}
+
+static void Utils_PointsHaversine(double latitude, double longitude,
+                                  const Utils_Points_TypeDef* points,
+                                  size_t start, size_t end, double* h) {
+    double p = M_PI / 180;
+    double sin_lat = sin(latitude * p);
+    double cos_lat = cos(latitude * p);
+    double sin_lng = sin(longitude * p);
+    double cos_lng = cos(longitude * p);
+
+    size_t i = start;
+#if defined(__AVX__)
+    if (start % UTILS_POINTS_ALIGN == 0) {
+        __m256d v_sin_lat = _mm256_set1_pd(sin_lat);
+        __m256d v_cos_lat = _mm256_set1_pd(cos_lat);
+        __m256d v_sin_lng = _mm256_set1_pd(sin_lng);
+        __m256d v_cos_lng = _mm256_set1_pd(cos_lng);
+        __m256d v_one = _mm256_set1_pd(1.0);
+        __m256d v_half = _mm256_set1_pd(0.5);
+        for (; i + 4 <= end; i += 4) {
+            __m256d s_lat = _mm256_load_pd(points->sin_latitude + i);
+            __m256d c_lat = _mm256_load_pd(points->cos_latitude + i);
+            __m256d s_lng = _mm256_load_pd(points->sin_longitude + i);
+            __m256d c_lng = _mm256_load_pd(points->cos_longitude + i);
+
+            __m256d cc_lat = _mm256_mul_pd(v_cos_lat, c_lat);
+            __m256d cos_dlat = _mm256_add_pd(cc_lat,
+                                             _mm256_mul_pd(v_sin_lat, s_lat));
+            __m256d cos_dlng = _mm256_add_pd(_mm256_mul_pd(v_cos_lng, c_lng),
+                                             _mm256_mul_pd(v_sin_lng, s_lng));
+            __m256d term = _mm256_add_pd(
+                    _mm256_sub_pd(v_one, cos_dlat),
+                    _mm256_mul_pd(cc_lat, _mm256_sub_pd(v_one, cos_dlng)));
+            _mm256_storeu_pd(h + (i - start), _mm256_mul_pd(v_half, term));
+        }
+    }
+#elif defined(__SSE2__)
+    if (start % 2 == 0) {
+        __m128d v_sin_lat = _mm_set1_pd(sin_lat);
+        __m128d v_cos_lat = _mm_set1_pd(cos_lat);
+        __m128d v_sin_lng = _mm_set1_pd(sin_lng);
+        __m128d v_cos_lng = _mm_set1_pd(cos_lng);
+        __m128d v_one = _mm_set1_pd(1.0);
+        __m128d v_half = _mm_set1_pd(0.5);
+        for (; i + 2 <= end; i += 2) {
+            __m128d s_lat = _mm_load_pd(points->sin_latitude + i);
+            __m128d c_lat = _mm_load_pd(points->cos_latitude + i);
+            __m128d s_lng = _mm_load_pd(points->sin_longitude + i);
+            __m128d c_lng = _mm_load_pd(points->cos_longitude + i);
+
+            __m128d cc_lat = _mm_mul_pd(v_cos_lat, c_lat);
+            __m128d cos_dlat = _mm_add_pd(cc_lat, _mm_mul_pd(v_sin_lat, s_lat));
+            __m128d cos_dlng = _mm_add_pd(_mm_mul_pd(v_cos_lng, c_lng),
+                                          _mm_mul_pd(v_sin_lng, s_lng));
+            __m128d term = _mm_add_pd(
+                    _mm_sub_pd(v_one, cos_dlat),
+                    _mm_mul_pd(cc_lat, _mm_sub_pd(v_one, cos_dlng)));
+            _mm_storeu_pd(h + (i - start), _mm_mul_pd(v_half, term));
+        }
+    }
+#endif
+
+    // Remaining points (or every point without SIMD)
+    for (; i < end; i++) {
+        double cc_lat = cos_lat * points->cos_latitude[i];
+        double cos_dlat = cc_lat + sin_lat * points->sin_latitude[i];
+        double cos_dlng = cos_lng * points->cos_longitude[i] +
+                          sin_lng * points->sin_longitude[i];
+        h[i - start] = 0.5 * ((1.0 - cos_dlat) + cc_lat * (1.0 - cos_dlng));
+    }
+
+    // Rounding can push a term just outside of asin(sqrt()) range
+    for (size_t j = 0; j < end - start; j++) {
+        if (h[j] < 0.0) h[j] = 0.0;
+        if (h[j] > 1.0) h[j] = 1.0;
+    }
+}
+
+/**
+ * Put a connection into pipeline mode.
+ *
+ * Calling PQexecPrepared() in a loop waits a full round trip for every row.
+ * In pipeline mode each statement is sent as soon as it is queued and the
+ * results of a block of UTILS_PIPELINE_MAX_QUEUED statements are collected
+ * after a single sync point, so the server is kept busy instead of waiting
+ * on the client. Use this for writes that need per-row logic (e.g. an
+ * upsert of one row per harvest area), otherwise see Bulk_Begin().
+ *
+ * The statements of a block succeed or fail together: outside a transaction
+ * a block is one implicit transaction, inside one (see Transaction_Begin())
+ * it is wrapped in the UTILS_PIPELINE_SAVEPOINT savepoint. So as with the
+ * PQexecPrepared() loop it replaces, a failed statement doesn't lose the
+ * others: it is logged with its label and the rest of its block is sent
+ * again without it. Each failure costs one more round trip.
+ *
+ * @code
+ * Utils_Pipeline_TypeDef pipeline;
+ * Statements_Prepare(psql_conn);
+ * Utils_PipelineBegin(&pipeline, psql_conn);
+ * for (int i = 0; i < n_rows; i++) {
+ *     Utils_PipelineExecPrepared(&pipeline, "UpsertHarvestLookup",
+ *                                &params[i], names[i]);
+ * }
+ * uint32_t failed = Utils_PipelineEnd(&pipeline);
+ * @endcode
+ *
+ * @param pipeline Pipeline to start.
+ * @param psql_conn PostgreSQL connection handler (statements are prepared,
+ * see Statements_Prepare()).
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t Utils_PipelineBegin(Utils_Pipeline_TypeDef* pipeline,
+                           PGconn* psql_conn) {
+    memset(pipeline, 0, sizeof(Utils_Pipeline_TypeDef));
+    pipeline->psql_conn = psql_conn;
+
+    PGTransactionStatusType status = PQtransactionStatus(psql_conn);
+    if (status != PQTRANS_IDLE && status != PQTRANS_INTRANS) {
+        log_error("PostgreSQL connection isn't ready for a pipeline.\n");
+        return -1;
+    }
+    pipeline->savepoint = status == PQTRANS_INTRANS;
+
+    pipeline->rows = malloc(UTILS_PIPELINE_MAX_QUEUED *
+                            sizeof(Utils_PipelineRow_TypeDef));
+    if (pipeline->rows == NULL) {
+        log_error("Not enough memory to hold a pipeline.\n");
+        return -1;
+    }
+    Arena_Init(&pipeline->arena);
+
+    if (PQenterPipelineMode(psql_conn) != 1) {
+        log_error("Unable to enter PostgreSQL pipeline mode: %s\n",
+                  PQerrorMessage(psql_conn));
+        free(pipeline->rows);
+        pipeline->rows = NULL;
+        return -1;
+    }
+
+    if (pipeline->savepoint &&
+        Utils_PipelineSendCommand(psql_conn, "SAVEPOINT "
+                                  UTILS_PIPELINE_SAVEPOINT ";") != 0) {
+        PQexitPipelineMode(psql_conn);
+        free(pipeline->rows);
+        pipeline->rows = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Queue a prepared statement in a pipeline.
+ *
+ * The statement is sent straight away. Its parameters are copied (text
+ * values included) so their buffers can be reused, and the copy is kept
+ * until the block is collected in case the block has to be sent again.
+ *
+ * @param pipeline Pipeline from Utils_PipelineBegin().
+ * @param stmt_name Prepared statement (see Statements_Prepare()), must
+ * outlive the pipeline.
+ * @param params Parameters (see PGBinary_Reset()).
+ * @param label Logged if the statement fails (e.g. harvest area name).
+ * @return Error code. 0 = OK ... -1 = ERROR (statement not sent)
+ */
+int8_t Utils_PipelineExecPrepared(Utils_Pipeline_TypeDef* pipeline,
+                                  const char* stmt_name,
+                                  const PGBinary_Params_TypeDef* params,
+                                  const char* label) {
+    if (pipeline->rows == NULL) {
+        return -1;
+    }
+    if (pipeline->queued >= UTILS_PIPELINE_MAX_QUEUED &&
+        Utils_PipelineCollect(pipeline, true) != 0) {
+        pipeline->failed++;
+        return -1;
+    }
+
+    Utils_PipelineRow_TypeDef* row = &pipeline->rows[pipeline->queued];
+    row->stmt_name = stmt_name;
+    row->params = *params;
+    row->failed = false;
+    snprintf(row->label, UTILS_PIPELINE_LABEL_SIZE, "%s", label);
+
+    // Fixed size values point into the copy, text values are copied
+    for (int i = 0; i < params->count; i++) {
+        const char* value = params->values[i];
+        if (value == NULL) continue;
+        ptrdiff_t offset = value - (const char*) params->data;
+        if (offset >= 0 && (size_t) offset < sizeof(params->data)) {
+            row->params.values[i] = (const char*) row->params.data + offset;
+            continue;
+        }
+        size_t length = (params->formats[i] == 0) ?
+                        strlen(value) + 1 : (size_t) params->lengths[i];
+        char* copy = Arena_Alloc(&pipeline->arena, length);
+        if (copy == NULL) {
+            log_error("Not enough memory to queue %s.\n", label);
+            pipeline->failed++;
+            return -1;
+        }
+        memcpy(copy, value, length);
+        row->params.values[i] = copy;
+    }
+
+    if (Utils_PipelineSend(pipeline, row) != 0) {
+        pipeline->failed++;
+        return -1;
+    }
+    pipeline->queued++;
+    pipeline->sent++;
+    return 0;
+}
+
+/**
+ * Collect the remaining results of a pipeline and leave pipeline mode.
+ *
+ * @param pipeline Pipeline from Utils_PipelineBegin().
+ * @return Number of statements that failed.
+ */
+uint32_t Utils_PipelineEnd(Utils_Pipeline_TypeDef* pipeline) {
+    if (pipeline->rows == NULL) {
+        return pipeline->failed;
+    }
+
+    Utils_PipelineCollect(pipeline, false);
+
+    if (PQexitPipelineMode(pipeline->psql_conn) != 1) {
+        log_error("Unable to leave PostgreSQL pipeline mode: %s\n",
+                  PQerrorMessage(pipeline->psql_conn));
+    }
+
+    if (pipeline->failed > 0) {
+        log_error("%u of %u pipelined statements failed (%u sent again).\n",
+                  pipeline->failed, pipeline->sent, pipeline->resent);
+    }
+
+    free(pipeline->rows);
+    pipeline->rows = NULL;
+    Arena_Free(&pipeline->arena);
+    return pipeline->failed;
+}
+
+static int8_t Utils_PipelineSendCommand(PGconn* psql_conn,
+                                        const char* command) {
+    if (PQsendQueryParams(psql_conn, command, 0, NULL, NULL, NULL, NULL,
+                          0) != 1) {
+        log_error("Unable to send %s Error: %s\n", command,
+                  PQerrorMessage(psql_conn));
+        return -1;
+    }
+    return 0;
+}
+
+static int8_t Utils_PipelineSend(Utils_Pipeline_TypeDef* pipeline,
+                                 const Utils_PipelineRow_TypeDef* row) {
+    const PGBinary_Params_TypeDef* params = &row->params;
+    if (PQsendQueryPrepared(pipeline->psql_conn, row->stmt_name,
+                            params->count, params->values, params->lengths,
+                            params->formats, 1) != 1) {
+        log_error("PostgreSQL pipeline error for %s: %s\n", row->label,
+                  PQerrorMessage(pipeline->psql_conn));
+        return -1;
+    }
+    return 0;
+}
+
+static int8_t Utils_PipelineCollect(Utils_Pipeline_TypeDef* pipeline,
+                                    bool next) {
+    PGconn* psql_conn = pipeline->psql_conn;
+    Utils_PipelineRow_TypeDef* rows = pipeline->rows;
+    int8_t status = 0;
+
+    // Each round is (ROLLBACK TO) SAVEPOINT, the statements that haven't
+    // failed, RELEASE and a sync point
+    while (status == 0) {
+        if ((pipeline->savepoint &&
+             Utils_PipelineSendCommand(psql_conn, "RELEASE SAVEPOINT "
+                                       UTILS_PIPELINE_SAVEPOINT ";") != 0) ||
+            PQpipelineSync(psql_conn) != 1) {
+            log_error("Unable to sync PostgreSQL pipeline: %s\n",
+                      PQerrorMessage(psql_conn));
+            status = -1;
+            break;
+        }
+
+        bool lost = false;
+        uint16_t n_failed = 0;
+        int first = pipeline->savepoint ? -1 : 0;
+        int last = pipeline->queued + (pipeline->savepoint ? 1 : 0);
+        for (int i = first; i < last && !lost; i++) {
+            // Savepoint commands come before and after the statements
+            Utils_PipelineRow_TypeDef* row =
+                    (i >= 0 && i < pipeline->queued) ? &rows[i] : NULL;
+            if (row != NULL && row->failed) {
+                continue; // Not sent again
+            }
+
+            // Result, then NULL (PIPELINE_ABORTED once one has failed)
+            PGresult* res = PQgetResult(psql_conn);
+            if (res == NULL) {
+                lost = true;
+                break;
+            }
+            if (PQresultStatus(res) == PGRES_FATAL_ERROR) {
+                if (row != NULL) {
+                    log_error("PostgreSQL statement failed for %s: %s\n",
+                              row->label, PQresultErrorMessage(res));
+                    row->failed = true;
+                    pipeline->failed++;
+                    n_failed++;
+                } else {
+                    log_error("PostgreSQL pipeline command failed: %s\n",
+                              PQresultErrorMessage(res));
+                    lost = true;
+                }
+            }
+            PQclear(res);
+            while ((res = PQgetResult(psql_conn)) != NULL) {
+                PQclear(res);
+            }
+        }
+
+        PGresult* res = lost ? NULL : PQgetResult(psql_conn);
+        if (PQresultStatus(res) != PGRES_PIPELINE_SYNC) {
+            log_error("PostgreSQL pipeline out of sync: %s\n",
                       PQerrorMessage(psql_conn));
+            lost = true;
+        }
+        PQclear(res);
+
+        if (lost) {
+            status = -1;
+            break;
+        }
+        if (n_failed == 0) {
+            break;
+        }
+
+        // The block was rolled back, send it again without the failures
+        if (pipeline->savepoint &&
+            Utils_PipelineSendCommand(psql_conn, "ROLLBACK TO SAVEPOINT "
+                                      UTILS_PIPELINE_SAVEPOINT ";") != 0) {
+            status = -1;
+        }
+        for (uint16_t i = 0; i < pipeline->queued && status == 0; i++) {
+            if (rows[i].failed) continue;
+            if (Utils_PipelineSend(pipeline, &rows[i]) != 0) {
+                status = -1;
+            }
+            pipeline->resent++;
         }
-        PQclear(prepare);
     }
-    PQclear(info);
+
+    // Nothing left in the block can be trusted to have been written
+    for (uint16_t i = 0; i < pipeline->queued && status != 0; i++) {
+        if (!rows[i].failed) {
+            log_error("PostgreSQL statement not written for %s.\n",
+                      rows[i].label);
+            rows[i].failed = true;
+            pipeline->failed++;
+        }
+    }
+
+    // The parameters of the block are no longer needed
+    pipeline->queued = 0;
+    Arena_Free(&pipeline->arena);
+    Arena_Init(&pipeline->arena);
+
+    if (status == 0 && next && pipeline->savepoint &&
+        Utils_PipelineSendCommand(psql_conn, "SAVEPOINT "
+                                  UTILS_PIPELINE_SAVEPOINT ";") != 0) {
+        status = -1;
+    }
+    return status;
 }
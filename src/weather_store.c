@@ -0,0 +1,307 @@
+#include "weather_store.h"
+
+/// Value of a row, treating a missing value as no precipitation
+static inline double WeatherStore_Value(const double* values, int index) {
+    return isnan(values[index]) ? 0 : values[index];
+}
+
+/**
+ * Load the weather of every program in harvest_lookup from the weather table.
+ *
+ * Every transform used to query the weather table again for the program it
+ * works on. The store reads the table once (one statement for every
+ * program) into contiguous columns: the time and day of each row, and one
+ * float64 array each for observed, forecast and merged precipitation,
+ * window sums and normalised sums. Each program is a slice of those
+ * columns, so transforms run against memory and PostgreSQL is only written
+ * back to (see WeatherStore_Save()). A long running process can keep the
+ * store and load it again when the weather table changes.
+ *
+ * @code
+ * WeatherStore_TypeDef store;
+ * WeatherStore_Load(&store, psql_conn);
+ * for (int i = 0; i < store.n_series; i++) {
+ *     WeatherStore_Window(&store.series[i], T_WINDOW_START, T_WINDOW_END);
+ *     WeatherStore_Save(&store.series[i], psql_conn);
+ * }
+ * WeatherStore_Free(&store);
+ * @endcode
+ *
+ * @param store Store to load (free with WeatherStore_Free()).
+ * @param psql_conn PostgreSQL connection handler.
+ * @return Error code. 0 = OK ... -1 = ERROR (the store is left empty)
+ */
+int8_t WeatherStore_Load(WeatherStore_TypeDef* store, PGconn* psql_conn) {
+    memset(store, 0, sizeof(WeatherStore_TypeDef));
+    Arena_Init(&store->arena);
+
+    // Program ID and name, time, day, observed, forecast and merged
+    // precipitation
+    PGBinary_Column_TypeDef columns[7] = {
+            {.type = PG_BINARY_COLUMN_INT},
+            {.type = PG_BINARY_COLUMN_STRING},
+            {.type = PG_BINARY_COLUMN_EPOCH},
+            {.type = PG_BINARY_COLUMN_INT},
+            {.type = PG_BINARY_COLUMN_DOUBLE},
+            {.type = PG_BINARY_COLUMN_DOUBLE},
+            {.type = PG_BINARY_COLUMN_DOUBLE}
+    };
+    PGBinary_Params_TypeDef params;
+    PGBinary_Reset(&params);
+    PGresult* res = Statements_Exec(psql_conn, "SelectWeatherSeries",
+                                    &params);
+    int n_rows = PGBinary_DecodeColumns(res, columns, 7, &store->arena);
+    PQclear(res);
+    if (n_rows < 0) {
+        log_error("Unable to load the weather table: %s\n",
+                  PQerrorMessage(psql_conn));
+        WeatherStore_Free(store);
+        return -1;
+    }
+
+    size_t n_values = n_rows > 0 ? (size_t)n_rows : 1;
+    double* window_sum = Arena_Alloc(&store->arena,
+                                     n_values * sizeof(double));
+    double* normalised = Arena_Alloc(&store->arena,
+                                     n_values * sizeof(double));
+    if (window_sum == NULL || normalised == NULL) {
+        WeatherStore_Free(store);
+        return -1;
+    }
+
+    int n_series = 0;
+    for (int i = 0; i < n_rows; i++) {
+        window_sum[i] = NAN;
+        normalised[i] = NAN;
+        if (i == 0 || columns[0].ints[i] != columns[0].ints[i - 1]) {
+            n_series++;
+        }
+    }
+
+    store->series = Arena_Alloc(&store->arena,
+                                (n_series > 0 ? (size_t)n_series : 1) *
+                                sizeof(WeatherStore_Series_TypeDef));
+    if (store->series == NULL) {
+        WeatherStore_Free(store);
+        return -1;
+    }
+
+    // Rows are ordered by program, so each program is a slice of the columns
+    WeatherStore_Series_TypeDef* series = NULL;
+    for (int i = 0; i < n_rows; i++) {
+        if (series == NULL || columns[0].ints[i] != series->program_id) {
+            series = &store->series[store->n_series++];
+            *series = (WeatherStore_Series_TypeDef){
+                    .program_id = columns[0].ints[i],
+                    .program_name = columns[1].strings[i],
+                    .timestamps = &columns[2].epochs[i],
+                    .days = &columns[3].ints[i],
+                    .observed = &columns[4].doubles[i],
+                    .forecast = &columns[5].doubles[i],
+                    .merged = &columns[6].doubles[i],
+                    .window_sum = &window_sum[i],
+                    .normalised = &normalised[i]
+            };
+        }
+        series->count++;
+    }
+    store->n_rows = n_rows;
+
+    log_info("Weather store loaded: %d rows of %d programs (%zu bytes).\n",
+             n_rows, store->n_series, store->arena.allocated);
+    return 0;
+}
+
+/**
+ * Sum every full window of a daily series.
+ *
+ * The window of value i holds the w_start values before it, the value
+ * itself and the values after it up to (but not including) i + w_end. Only
+ * values with a full window are summed, i.e. w_start to n_values - w_end.
+ * Each sum is the previous one plus the value entering the window minus the
+ * value leaving it, so a series costs O(n) whatever the window size.
+ *
+ * @code
+ * double sums[n_values];
+ * int n_sums = WeatherStore_WindowSum(values, n_values, 5, 8, sums);
+ * // sums[0] = values[0] + ... + values[12] (the window of values[5])
+ * @endcode
+ *
+ * @param values Series of daily values.
+ * @param n_values Number of values.
+ * @param w_start Days before each value in its window.
+ * @param w_end Days from each value in its window (including the value).
+ * @param sums Sum of each full window (at least n_values long).
+ * @return Number of sums (0 if the series is shorter than the window).
+ */
+int WeatherStore_WindowSum(const double* values, int n_values, int w_start,
+                           int w_end, double* sums) {
+    const int width = w_start + w_end;
+    if (w_start < 0 || w_end < 1 || n_values < width) {
+        return 0;
+    }
+
+    double sum = 0;
+    for (int x = 0; x < width; x++) {
+        sum += values[x];
+    }
+    sums[0] = sum;
+
+    const int n_sums = n_values - width + 1;
+    for (int k = 1; k < n_sums; k++) {
+        sum += values[k + width - 1] - values[k - 1];
+        sums[k] = sum;
+    }
+
+    return n_sums;
+}
+
+/**
+ * Window and normalise the forecast of a program by calendar day.
+ *
+ * The forecast rows of each day are totalled into one value per day from
+ * the first to the last day of the program, so a day without rows counts as
+ * no precipitation and windows always cover calendar days rather than rows.
+ * The days are summed with WeatherStore_WindowSum() and each row gets the
+ * sum of its day (NAN if its day has no full window). Sums are normalised
+ * between the min and max sum of the program (0 if every sum is the same).
+ * Missing forecast values count as 0.
+ *
+ * @param series Weather of a program.
+ * @param w_start Days before each day in its window (e.g. 5).
+ * @param w_end Days from each day in its window, including the day (e.g. 8).
+ * @return Error code. 0 = OK ... -1 = ERROR (no row has a window sum)
+ */
+int8_t WeatherStore_Window(WeatherStore_Series_TypeDef* series, int w_start,
+                           int w_end) {
+    for (int i = 0; i < series->count; i++) {
+        series->window_sum[i] = NAN;
+        series->normalised[i] = NAN;
+    }
+    if (series->count == 0) {
+        return 0;
+    }
+
+    // Rows are ordered by time, so days run from the first row to the last
+    const int32_t first = series->days[0];
+    const int n_days = series->days[series->count - 1] - first + 1;
+
+    Arena_TypeDef arena;
+    Arena_Init(&arena);
+    double* daily = Arena_Alloc(&arena, (size_t)n_days * sizeof(double));
+    double* sums = Arena_Alloc(&arena, (size_t)n_days * sizeof(double));
+    if (daily == NULL || sums == NULL) {
+        log_error("Not enough memory to window %s.\n", series->program_name);
+        Arena_Free(&arena);
+        return -1;
+    }
+
+    for (int d = 0; d < n_days; d++) {
+        daily[d] = 0;
+    }
+    for (int i = 0; i < series->count; i++) {
+        daily[series->days[i] - first] +=
+                WeatherStore_Value(series->forecast, i);
+    }
+
+    // Sum k belongs to day w_start + k
+    int n_sums = WeatherStore_WindowSum(daily, n_days, w_start, w_end, sums);
+    if (n_sums == 0) {
+        Arena_Free(&arena);
+        return 0;
+    }
+
+    double min = sums[0];
+    double max = sums[0];
+    for (int k = 1; k < n_sums; k++) {
+        if (sums[k] < min) min = sums[k];
+        if (sums[k] > max) max = sums[k];
+    }
+
+    // A flat series has nothing to scale, every day is the minimum
+    const double range = max - min;
+    for (int i = 0; i < series->count; i++) {
+        int k = series->days[i] - first - w_start;
+        if (k >= 0 && k < n_sums) {
+            series->window_sum[i] = sums[k];
+            series->normalised[i] = range > 0 ? (sums[k] - min) / range : 0;
+        }
+    }
+
+    Arena_Free(&arena);
+    return 0;
+}
+
+/**
+ * Write the window sums of a program back to the weather table.
+ *
+ * Rows with a window sum are written in one UPDATE ... FROM unnest()
+ * statement (sum_precip and normalised_precip), matched on their exact time
+ * so each row is updated once.
+ *
+ * @param series Weather of a program (see WeatherStore_Window()).
+ * @param psql_conn PostgreSQL connection handler.
+ * @return Error code. 0 = OK ... -1 = ERROR
+ */
+int8_t WeatherStore_Save(const WeatherStore_Series_TypeDef* series,
+                         PGconn* psql_conn) {
+    Arena_TypeDef arena;
+    Arena_Init(&arena);
+
+    size_t n_values = series->count > 0 ? (size_t)series->count : 1;
+    int64_t* timestamps = Arena_Alloc(&arena, n_values * sizeof(int64_t));
+    double* sums = Arena_Alloc(&arena, n_values * sizeof(double));
+    double* normalised = Arena_Alloc(&arena, n_values * sizeof(double));
+    if (timestamps == NULL || sums == NULL || normalised == NULL) {
+        Arena_Free(&arena);
+        return -1;
+    }
+
+    int n_sums = 0;
+    for (int i = 0; i < series->count; i++) {
+        if (!isnan(series->window_sum[i])) {
+            timestamps[n_sums] = series->timestamps[i];
+            sums[n_sums] = series->window_sum[i];
+            normalised[n_sums] = series->normalised[i];
+            n_sums++;
+        }
+    }
+    if (n_sums == 0) {
+        Arena_Free(&arena);
+        return 0;
+    }
+
+    PGBinary_Params_TypeDef params;
+    PGBinary_Reset(&params);
+    PGBinary_AddInt4(&params, series->program_id);
+    if (PGBinary_AddTimestampArray(&params, timestamps, n_sums, &arena) != 0 ||
+        PGBinary_AddFloat8Array(&params, sums, n_sums, &arena) != 0 ||
+        PGBinary_AddFloat8Array(&params, normalised, n_sums, &arena) != 0) {
+        Arena_Free(&arena);
+        return -1;
+    }
+
+    int8_t status = 0;
+    PGresult* res = Statements_Exec(psql_conn, "UpdateStoredWindow", &params);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        log_error("Unable to write the window of %s: %s\n",
+                  series->program_name, PQerrorMessage(psql_conn));
+        status = -1;
+    }
+    PQclear(res);
+
+    Arena_Free(&arena);
+    return status;
+}
+
+/**
+ * Free every column of the store.
+ *
+ * @param store Store from WeatherStore_Load().
+ */
+void WeatherStore_Free(WeatherStore_TypeDef* store) {
+    Arena_Free(&store->arena);
+    store->series = NULL;
+    store->n_series = 0;
+    store->n_rows = 0;
+}
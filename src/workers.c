@@ -0,0 +1,324 @@
+#include "workers.h"
+
+/// Task handed out to the workers
+typedef struct {
+    Utils_ReqData_TypeDef log; ///< Log output of the task (written in order)
+    bool done; ///< The task has finished
+} Workers_Task_TypeDef;
+
+/// Tasks of the current run
+static struct {
+    Workers_Task_TypeDef* tasks; ///< Every task of the run
+    int n_tasks; ///< Number of tasks
+    int next_task; ///< Next task to hand out
+    int next_flush; ///< Next task whose log output is written
+    Workers_TaskFn task_fn; ///< Runs a task
+    void* userdata; ///< Passed to task_fn
+    const char** keywords; ///< Connection parameters of the extra workers
+    const char** values; ///< Value of each connection parameter
+    bool running; ///< A run is in progress (log output is buffered)
+    pthread_mutex_t lock; ///< Protects the tasks
+} Workers = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/// Task the calling thread is running (NULL outside a task)
+static _Thread_local Workers_Task_TypeDef* Workers_Current = NULL;
+
+/// Registers Workers_Log() with the log module once
+static pthread_once_t Workers_LogOnce = PTHREAD_ONCE_INIT;
+
+/// Serialises log output (the log module formats times with localtime())
+static pthread_mutex_t Workers_LogMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef LOG_USE_COLOR
+/// Colour of each log level (as the log module writes them to stderr)
+static const char* Workers_LogColors[] = {
+        "\x1b[94m", "\x1b[36m", "\x1b[32m", "\x1b[33m", "\x1b[31m", "\x1b[35m"
+};
+#endif
+
+/// Register the log callback
+static void Workers_AddLogCallback(void);
+
+/// Lock function of the log module
+static void Workers_LogLock(bool lock, void* udata);
+
+/// Buffer log output of a task (or write it if outside a task)
+static void Workers_Log(Log_Event* ev);
+
+/// Thread of an extra worker (connects, then runs tasks)
+static void* Workers_Thread(void* arg);
+
+/// Run tasks until there are none left
+static void Workers_Work(PGconn* psql_conn);
+
+/// Next task to run (-1 if there are none left)
+static int Workers_Take(void);
+
+/// Mark a task as done and write the log output of finished tasks in order
+static void Workers_Finish(int task);
+
+/**
+ * Number of workers used by Workers_Run().
+ *
+ * Set by WORKERS_THREADS, otherwise one per core. At most
+ * WORKERS_MAX_THREADS.
+ *
+ * @return Number of workers (at least 1).
+ */
+uint16_t Workers_Count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    const char* threads = getenv(WORKERS_THREADS_ENV);
+    if (threads != NULL) {
+        char* end = NULL;
+        long value = strtol(threads, &end, 10);
+        if (end != threads && *end == '\0' && value > 0) {
+            count = value;
+        } else {
+            log_warn("Invalid %s: %s\n", WORKERS_THREADS_ENV, threads);
+        }
+    }
+
+    if (count < 1) count = 1;
+    if (count > WORKERS_MAX_THREADS) count = WORKERS_MAX_THREADS;
+    return (uint16_t)count;
+}
+
+/**
+ * Run tasks on a pool of workers.
+ *
+ * Tasks that don't depend on each other (e.g. one per program) are handed
+ * out from a shared queue to Workers_Count() workers. The calling thread is
+ * a worker and uses psql_conn; every other worker opens its own connection
+ * with the same parameters, so each has its own session, prepared
+ * statements (see Statements_Prepare()) and transactions.
+ *
+ * Log output of each task is buffered and written in task order as tasks
+ * finish, so the log reads the same as a serial run whatever the order the
+ * tasks ran in. A task should write its results to its own slot (indexed by
+ * task) for the same reason. If an extra worker can't connect, the other
+ * workers run its share of the tasks.
+ *
+ * Workers_Run() is not reentrant (a task can't start another run).
+ *
+ * @code
+ * static void T_FloodPredictionTask(PGconn* psql_conn, int task,
+ *                                   void* userdata) {
+ *     WeatherStore_TypeDef* store = userdata;
+ *     WeatherStore_Window(&store->series[task], 5, 8);
+ *     WeatherStore_Save(&store->series[task], psql_conn);
+ * }
+ * Workers_Run(psql_conn, store.n_series, T_FloodPredictionTask, &store);
+ * @endcode
+ *
+ * @param psql_conn Connection of the calling thread.
+ * @param n_tasks Number of tasks (run as 0 ... n_tasks - 1).
+ * @param task_fn Runs a task.
+ * @param userdata Passed to task_fn.
+ * @return Error code. 0 = OK ... -1 = ERROR (no task was run)
+ */
+int8_t Workers_Run(PGconn* psql_conn, int n_tasks, Workers_TaskFn task_fn,
+                   void* userdata) {
+    if (n_tasks <= 0) {
+        return 0;
+    }
+
+    Workers_Task_TypeDef* tasks = calloc((size_t)n_tasks,
+                                         sizeof(Workers_Task_TypeDef));
+    if (tasks == NULL) {
+        log_error("Not enough memory to hold %d worker tasks.\n", n_tasks);
+        return -1;
+    }
+
+    // Connection parameters are copied before any worker starts, as
+    // psql_conn is in use by the calling thread
+    PQconninfoOption* options = PQconninfo(psql_conn);
+    size_t n_options = 0;
+    while (options != NULL && options[n_options].keyword != NULL) {
+        n_options++;
+    }
+    const char** keywords = calloc(n_options + 1, sizeof(const char*));
+    const char** values = calloc(n_options + 1, sizeof(const char*));
+    uint16_t n_workers = Workers_Count();
+    if (keywords == NULL || values == NULL) {
+        n_workers = 1;
+    } else {
+        size_t n_set = 0;
+        for (size_t i = 0; i < n_options; i++) {
+            if (options[i].val != NULL) {
+                keywords[n_set] = options[i].keyword;
+                values[n_set] = options[i].val;
+                n_set++;
+            }
+        }
+    }
+    if (n_workers > n_tasks) {
+        n_workers = (uint16_t)n_tasks;
+    }
+
+    pthread_once(&Workers_LogOnce, Workers_AddLogCallback);
+
+    pthread_mutex_lock(&Workers.lock);
+    Workers.tasks = tasks;
+    Workers.n_tasks = n_tasks;
+    Workers.next_task = 0;
+    Workers.next_flush = 0;
+    Workers.task_fn = task_fn;
+    Workers.userdata = userdata;
+    Workers.keywords = keywords;
+    Workers.values = values;
+    Workers.running = true;
+    pthread_mutex_unlock(&Workers.lock);
+    log_set_quiet(true);
+
+    log_debug("Running %d tasks on %u workers.\n", n_tasks, n_workers);
+
+    pthread_t threads[WORKERS_MAX_THREADS];
+    uint16_t n_threads = 0;
+    for (uint16_t i = 1; i < n_workers; i++) {
+        if (pthread_create(&threads[n_threads], NULL, Workers_Thread,
+                           NULL) == 0) {
+            n_threads++;
+        }
+    }
+    Workers_Work(psql_conn);
+    for (uint16_t i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&Workers.lock);
+    Workers.running = false;
+    Workers.tasks = NULL;
+    pthread_mutex_unlock(&Workers.lock);
+    log_set_quiet(false);
+
+    free(tasks);
+    free(keywords);
+    free(values);
+    PQconninfoFree(options);
+    return 0;
+}
+
+static void Workers_AddLogCallback(void) {
+    log_set_lock(Workers_LogLock, NULL);
+    if (log_add_callback(Workers_Log, NULL, LOG_TRACE) != 0) {
+        log_warn("Unable to buffer worker log output.\n");
+    }
+}
+
+static void Workers_LogLock(bool lock, void* udata) {
+    (void)udata;
+    if (lock) {
+        pthread_mutex_lock(&Workers_LogMutex);
+    } else {
+        pthread_mutex_unlock(&Workers_LogMutex);
+    }
+}
+
+static void Workers_Log(Log_Event* ev) {
+    pthread_mutex_lock(&Workers.lock);
+    bool running = Workers.running;
+    pthread_mutex_unlock(&Workers.lock);
+    if (!running) {
+        return;
+    }
+
+    // Same format as the log module writes to stderr
+    char line[WORKERS_LOG_LINE_SIZE];
+    size_t length = strftime(line, sizeof(line), "%H:%M:%S", ev->time);
+#ifdef LOG_USE_COLOR
+    int n = snprintf(line + length, sizeof(line) - length,
+                     " %s%-5s\x1b[0m \x1b[90m%s:%d:\x1b[0m ",
+                     Workers_LogColors[ev->level],
+                     log_level_string(ev->level), ev->file, ev->line);
+#else
+    int n = snprintf(line + length, sizeof(line) - length, " %-5s %s:%d: ",
+                     log_level_string(ev->level), ev->file, ev->line);
+#endif
+    if (n > 0) {
+        length += (size_t)n;
+    }
+    if (length < sizeof(line)) {
+        n = vsnprintf(line + length, sizeof(line) - length, ev->fmt, ev->ap);
+        if (n > 0) {
+            length += (size_t)n;
+        }
+    }
+    if (length >= sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+
+    Workers_Task_TypeDef* task = Workers_Current;
+    if (task == NULL) {
+        fwrite(line, 1, length, stderr);
+        return;
+    }
+
+    // Called with the log lock held, so nothing here may log (a line that
+    // doesn't fit in memory is dropped)
+    Utils_ReqData_TypeDef* log = &task->log;
+    if (log->size + length > log->capacity) {
+        size_t capacity = log->capacity * 2 + length;
+        char* memory = realloc(log->memory, capacity);
+        if (memory == NULL) {
+            return;
+        }
+        log->memory = memory;
+        log->capacity = capacity;
+    }
+    memcpy(log->memory + log->size, line, length);
+    log->size += length;
+}
+
+static void* Workers_Thread(void* arg) {
+    (void)arg;
+
+    PGconn* psql_conn = PQconnectdbParams(Workers.keywords, Workers.values,
+                                          0);
+    if (PQstatus(psql_conn) != CONNECTION_OK) {
+        log_warn("Worker unable to connect to PostgreSQL: %s",
+                 PQerrorMessage(psql_conn));
+        PQfinish(psql_conn);
+        return NULL;
+    }
+
+    Workers_Work(psql_conn);
+
+    Statements_Forget(psql_conn);
+    PQfinish(psql_conn);
+    return NULL;
+}
+
+static void Workers_Work(PGconn* psql_conn) {
+    int task;
+    while ((task = Workers_Take()) >= 0) {
+        Workers_Current = &Workers.tasks[task];
+        Workers.task_fn(psql_conn, task, Workers.userdata);
+        Workers_Current = NULL;
+        Workers_Finish(task);
+    }
+}
+
+static int Workers_Take(void) {
+    pthread_mutex_lock(&Workers.lock);
+    int task = Workers.next_task < Workers.n_tasks ? Workers.next_task++ : -1;
+    pthread_mutex_unlock(&Workers.lock);
+    return task;
+}
+
+static void Workers_Finish(int task) {
+    pthread_mutex_lock(&Workers.lock);
+    Workers.tasks[task].done = true;
+    while (Workers.next_flush < Workers.n_tasks &&
+           Workers.tasks[Workers.next_flush].done) {
+        Utils_ReqData_TypeDef* log = &Workers.tasks[Workers.next_flush].log;
+        if (log->size > 0) {
+            fwrite(log->memory, 1, log->size, stderr);
+        }
+        free(log->memory);
+        log->memory = NULL;
+        Workers.next_flush++;
+    }
+    fflush(stderr);
+    pthread_mutex_unlock(&Workers.lock);
+}